@@ -0,0 +1,1566 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+/*
+ * ArenaBench, a minimal headless OFX host used to benchmark the plugin bundles.
+ *
+ * Every plugin found in the given binaries is loaded, instantiated in its filter (or general,
+ * generator, reader) context and rendered on a synthetic float RGBA frame, once with default
+ * parameter values and once with stress values (numeric parameters at their display maximum).
+ * Each case runs in its own process, so a crashing plugin does not stop the run and the peak
+ * RSS is per case. Results are written as JSON.
+ *
+ * OpenCL plugins need an OpenCL platform, pocl is enough on a CPU only box.
+ */
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxMemory.h"
+#include "ofxMessage.h"
+#include "ofxMultiThread.h"
+#include "ofxParam.h"
+#include "ofxProperty.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define kBenchHostName "net.fxarena.ArenaBench"
+#define kBenchHostLabel "ArenaBench"
+#define kBenchDefaultIterations 3
+#define kBenchDefaultTimeout 600
+
+typedef int (*OfxGetNumberOfPluginsFunc)(void);
+typedef OfxPlugin* (*OfxGetPluginFunc)(int nth);
+
+// property sets
+
+struct Property
+{
+    Property() : type(0) {}
+    char type; // 'i', 'd', 's' or 'p'
+    std::vector<int> i;
+    std::vector<double> d;
+    std::vector<std::string> s;
+    std::vector<void*> p;
+
+    int dimension() const
+    {
+        switch (type) {
+        case 'i': return (int)i.size();
+        case 'd': return (int)d.size();
+        case 's': return (int)s.size();
+        case 'p': return (int)p.size();
+        }
+        return 0;
+    }
+};
+
+struct PropertySet
+{
+    std::map<std::string, Property> props;
+
+    Property& slot(const char *name, char type, int index)
+    {
+        Property &prop = props[name];
+        if (prop.type != type) {
+            prop = Property();
+            prop.type = type;
+        }
+        int size = index + 1;
+        if (prop.dimension() < size) {
+            prop.i.resize(type == 'i' ? size : 0);
+            prop.d.resize(type == 'd' ? size : 0);
+            prop.s.resize(type == 's' ? size : 0);
+            prop.p.resize(type == 'p' ? size : 0);
+        }
+        return prop;
+    }
+
+    void setInt(const char *name, int value, int index = 0) { slot(name, 'i', index).i[index] = value; }
+    void setDouble(const char *name, double value, int index = 0) { slot(name, 'd', index).d[index] = value; }
+    void setString(const char *name, const std::string &value, int index = 0) { slot(name, 's', index).s[index] = value; }
+    void setPointer(const char *name, void *value, int index = 0) { slot(name, 'p', index).p[index] = value; }
+
+    const Property* find(const char *name) const
+    {
+        std::map<std::string, Property>::const_iterator it = props.find(name);
+        return it == props.end() ? NULL : &it->second;
+    }
+
+    std::string getString(const char *name, int index = 0) const
+    {
+        const Property *prop = find(name);
+        return (prop && prop->type == 's' && index < (int)prop->s.size()) ? prop->s[index] : std::string();
+    }
+
+    double getDouble(const char *name, int index, double defaultValue) const
+    {
+        const Property *prop = find(name);
+        if (prop && prop->type == 'd' && index < (int)prop->d.size()) {
+            return prop->d[index];
+        }
+        if (prop && prop->type == 'i' && index < (int)prop->i.size()) {
+            return prop->i[index];
+        }
+        return defaultValue;
+    }
+};
+
+static PropertySet* toProps(OfxPropertySetHandle handle) { return (PropertySet*)handle; }
+static OfxPropertySetHandle toHandle(PropertySet *props) { return (OfxPropertySetHandle)props; }
+
+// params, clips, images and effects
+
+struct Param
+{
+    std::string name;
+    std::string type;
+    PropertySet props;
+    std::vector<double> values;
+    std::string text;
+};
+
+struct ParamSet
+{
+    PropertySet props;
+    std::vector<Param*> params;
+
+    ~ParamSet()
+    {
+        for (size_t i = 0; i < params.size(); ++i) {
+            delete params[i];
+        }
+    }
+
+    Param* find(const std::string &name) const
+    {
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (params[i]->name == name) {
+                return params[i];
+            }
+        }
+        return NULL;
+    }
+};
+
+struct Clip
+{
+    std::string name;
+    PropertySet props;
+    std::vector<float> pixels;
+    OfxRectI bounds;
+};
+
+struct Effect
+{
+    Effect() : aborted(false) {}
+    ~Effect()
+    {
+        for (size_t i = 0; i < clips.size(); ++i) {
+            delete clips[i];
+        }
+    }
+
+    Clip* findClip(const std::string &name) const
+    {
+        for (size_t i = 0; i < clips.size(); ++i) {
+            if (clips[i]->name == name) {
+                return clips[i];
+            }
+        }
+        return NULL;
+    }
+
+    PropertySet props;
+    ParamSet params;
+    std::vector<Clip*> clips;
+    bool aborted;
+};
+
+static PropertySet gHostProps;
+
+// property suite
+
+static OfxStatus
+propSetPointer(OfxPropertySetHandle h, const char *name, int index, void *value)
+{
+    if (!h || index < 0) return kOfxStatErrBadHandle;
+    toProps(h)->setPointer(name, value, index);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propSetString(OfxPropertySetHandle h, const char *name, int index, const char *value)
+{
+    if (!h || index < 0) return kOfxStatErrBadHandle;
+    toProps(h)->setString(name, value ? value : "", index);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propSetDouble(OfxPropertySetHandle h, const char *name, int index, double value)
+{
+    if (!h || index < 0) return kOfxStatErrBadHandle;
+    toProps(h)->setDouble(name, value, index);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propSetInt(OfxPropertySetHandle h, const char *name, int index, int value)
+{
+    if (!h || index < 0) return kOfxStatErrBadHandle;
+    toProps(h)->setInt(name, value, index);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propSetPointerN(OfxPropertySetHandle h, const char *name, int count, void *const*value)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        propSetPointer(h, name, i, value[i]);
+    }
+    return h ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+static OfxStatus
+propSetStringN(OfxPropertySetHandle h, const char *name, int count, const char *const*value)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        propSetString(h, name, i, value[i]);
+    }
+    return h ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+static OfxStatus
+propSetDoubleN(OfxPropertySetHandle h, const char *name, int count, const double *value)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        propSetDouble(h, name, i, value[i]);
+    }
+    return h ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+static OfxStatus
+propSetIntN(OfxPropertySetHandle h, const char *name, int count, const int *value)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        propSetInt(h, name, i, value[i]);
+    }
+    return h ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+static OfxStatus
+findProperty(OfxPropertySetHandle h, const char *name, int index, const Property **prop)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    *prop = toProps(h)->find(name);
+    if (!*prop) return kOfxStatErrUnknown;
+    if (index < 0 || index >= (*prop)->dimension()) return kOfxStatErrBadIndex;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetPointer(OfxPropertySetHandle h, const char *name, int index, void **value)
+{
+    const Property *prop;
+    OfxStatus stat = findProperty(h, name, index, &prop);
+    if (stat != kOfxStatOK) return stat;
+    if (prop->type != 'p') return kOfxStatErrValue;
+    *value = prop->p[index];
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetString(OfxPropertySetHandle h, const char *name, int index, char **value)
+{
+    const Property *prop;
+    OfxStatus stat = findProperty(h, name, index, &prop);
+    if (stat != kOfxStatOK) return stat;
+    if (prop->type != 's') return kOfxStatErrValue;
+    *value = (char*)prop->s[index].c_str();
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetDouble(OfxPropertySetHandle h, const char *name, int index, double *value)
+{
+    const Property *prop;
+    OfxStatus stat = findProperty(h, name, index, &prop);
+    if (stat != kOfxStatOK) return stat;
+    if (prop->type == 'd') {
+        *value = prop->d[index];
+    } else if (prop->type == 'i') {
+        *value = prop->i[index];
+    } else {
+        return kOfxStatErrValue;
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetInt(OfxPropertySetHandle h, const char *name, int index, int *value)
+{
+    const Property *prop;
+    OfxStatus stat = findProperty(h, name, index, &prop);
+    if (stat != kOfxStatOK) return stat;
+    if (prop->type == 'i') {
+        *value = prop->i[index];
+    } else if (prop->type == 'd') {
+        *value = (int)prop->d[index];
+    } else {
+        return kOfxStatErrValue;
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetPointerN(OfxPropertySetHandle h, const char *name, int count, void **value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetPointer(h, name, i, &value[i]);
+        if (stat != kOfxStatOK) return stat;
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetStringN(OfxPropertySetHandle h, const char *name, int count, char **value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetString(h, name, i, &value[i]);
+        if (stat != kOfxStatOK) return stat;
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetDoubleN(OfxPropertySetHandle h, const char *name, int count, double *value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetDouble(h, name, i, &value[i]);
+        if (stat != kOfxStatOK) return stat;
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetIntN(OfxPropertySetHandle h, const char *name, int count, int *value)
+{
+    for (int i = 0; i < count; ++i) {
+        OfxStatus stat = propGetInt(h, name, i, &value[i]);
+        if (stat != kOfxStatOK) return stat;
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propReset(OfxPropertySetHandle h, const char *name)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    toProps(h)->props.erase(name);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+propGetDimension(OfxPropertySetHandle h, const char *name, int *count)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    const Property *prop = toProps(h)->find(name);
+    if (!prop) return kOfxStatErrUnknown;
+    *count = prop->dimension();
+    return kOfxStatOK;
+}
+
+static OfxPropertySuiteV1 gPropertySuite = {
+    propSetPointer, propSetString, propSetDouble, propSetInt,
+    propSetPointerN, propSetStringN, propSetDoubleN, propSetIntN,
+    propGetPointer, propGetString, propGetDouble, propGetInt,
+    propGetPointerN, propGetStringN, propGetDoubleN, propGetIntN,
+    propReset, propGetDimension
+};
+
+// image effect suite
+
+static OfxStatus
+getPropertySet(OfxImageEffectHandle h, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    *props = toHandle(&((Effect*)h)->props);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+getParamSet(OfxImageEffectHandle h, OfxParamSetHandle *paramSet)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    *paramSet = (OfxParamSetHandle)&((Effect*)h)->params;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clipDefine(OfxImageEffectHandle h, const char *name, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Effect *effect = (Effect*)h;
+    Clip *clip = effect->findClip(name);
+    if (!clip) {
+        clip = new Clip;
+        clip->name = name;
+        clip->props.setString(kOfxPropType, kOfxTypeClip);
+        clip->props.setString(kOfxPropName, name);
+        clip->props.setInt(kOfxImageClipPropOptional, 0);
+        clip->props.setInt(kOfxImageClipPropIsMask, 0);
+        effect->clips.push_back(clip);
+    }
+    *props = toHandle(&clip->props);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clipGetHandle(OfxImageEffectHandle h, const char *name, OfxImageClipHandle *clip, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Clip *c = ((Effect*)h)->findClip(name);
+    if (!c) return kOfxStatErrUnknown;
+    *clip = (OfxImageClipHandle)c;
+    if (props) {
+        *props = toHandle(&c->props);
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clipGetPropertySet(OfxImageClipHandle clip, OfxPropertySetHandle *props)
+{
+    if (!clip) return kOfxStatErrBadHandle;
+    *props = toHandle(&((Clip*)clip)->props);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clipGetImage(OfxImageClipHandle h, OfxTime time, const OfxRectD * /*region*/, OfxPropertySetHandle *imageHandle)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Clip *clip = (Clip*)h;
+    if (clip->pixels.empty()) {
+        return kOfxStatFailed;
+    }
+    PropertySet *image = new PropertySet;
+    const OfxRectI &b = clip->bounds;
+    image->setString(kOfxPropType, kOfxTypeImage);
+    image->setPointer(kOfxImagePropData, &clip->pixels[0]);
+    image->setInt(kOfxImagePropBounds, b.x1, 0);
+    image->setInt(kOfxImagePropBounds, b.y1, 1);
+    image->setInt(kOfxImagePropBounds, b.x2, 2);
+    image->setInt(kOfxImagePropBounds, b.y2, 3);
+    image->setInt(kOfxImagePropRegionOfDefinition, b.x1, 0);
+    image->setInt(kOfxImagePropRegionOfDefinition, b.y1, 1);
+    image->setInt(kOfxImagePropRegionOfDefinition, b.x2, 2);
+    image->setInt(kOfxImagePropRegionOfDefinition, b.y2, 3);
+    image->setInt(kOfxImagePropRowBytes, (b.x2 - b.x1) * 4 * (int)sizeof(float));
+    image->setString(kOfxImageEffectPropPixelDepth, kOfxBitDepthFloat);
+    image->setString(kOfxImageEffectPropComponents, kOfxImageComponentRGBA);
+    image->setString(kOfxImageEffectPropPreMultiplication, kOfxImagePreMultiplied);
+    image->setDouble(kOfxImageEffectPropRenderScale, 1., 0);
+    image->setDouble(kOfxImageEffectPropRenderScale, 1., 1);
+    image->setDouble(kOfxImagePropPixelAspectRatio, 1.);
+    image->setString(kOfxImagePropField, kOfxImageFieldNone);
+    std::ostringstream id;
+    id << clip->name << "@" << time;
+    image->setString(kOfxImagePropUniqueIdentifier, id.str());
+    *imageHandle = toHandle(image);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clipReleaseImage(OfxPropertySetHandle imageHandle)
+{
+    if (!imageHandle) return kOfxStatErrBadHandle;
+    delete toProps(imageHandle);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clipGetRegionOfDefinition(OfxImageClipHandle h, OfxTime /*time*/, OfxRectD *bounds)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Clip *clip = (Clip*)h;
+    bounds->x1 = clip->bounds.x1;
+    bounds->y1 = clip->bounds.y1;
+    bounds->x2 = clip->bounds.x2;
+    bounds->y2 = clip->bounds.y2;
+    return kOfxStatOK;
+}
+
+static int
+effectAbort(OfxImageEffectHandle h)
+{
+    return (h && ((Effect*)h)->aborted) ? 1 : 0;
+}
+
+static OfxStatus
+imageMemoryAlloc(OfxImageEffectHandle /*h*/, size_t nBytes, OfxImageMemoryHandle *memory)
+{
+    void *data = std::malloc(nBytes);
+    if (!data) return kOfxStatErrMemory;
+    *memory = (OfxImageMemoryHandle)data;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+imageMemoryFree(OfxImageMemoryHandle memory)
+{
+    std::free(memory);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+imageMemoryLock(OfxImageMemoryHandle memory, void **data)
+{
+    *data = memory;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+imageMemoryUnlock(OfxImageMemoryHandle /*memory*/)
+{
+    return kOfxStatOK;
+}
+
+static OfxImageEffectSuiteV1 gImageEffectSuite = {
+    getPropertySet, getParamSet, clipDefine, clipGetHandle, clipGetPropertySet,
+    clipGetImage, clipReleaseImage, clipGetRegionOfDefinition, effectAbort,
+    imageMemoryAlloc, imageMemoryFree, imageMemoryLock, imageMemoryUnlock
+};
+
+// parameter suite
+
+static int
+paramDimension(const std::string &type)
+{
+    if (type == kOfxParamTypeRGBA) return 4;
+    if (type == kOfxParamTypeRGB || type == kOfxParamTypeDouble3D || type == kOfxParamTypeInteger3D) return 3;
+    if (type == kOfxParamTypeDouble2D || type == kOfxParamTypeInteger2D) return 2;
+    if (type == kOfxParamTypeInteger || type == kOfxParamTypeDouble ||
+        type == kOfxParamTypeBoolean || type == kOfxParamTypeChoice) return 1;
+    return 0;
+}
+
+static bool
+paramIsInteger(const std::string &type)
+{
+    return type == kOfxParamTypeInteger || type == kOfxParamTypeInteger2D || type == kOfxParamTypeInteger3D ||
+           type == kOfxParamTypeBoolean || type == kOfxParamTypeChoice;
+}
+
+static bool
+paramIsString(const std::string &type)
+{
+    return type == kOfxParamTypeString || type == kOfxParamTypeCustom;
+}
+
+static OfxStatus
+paramDefine(OfxParamSetHandle h, const char *paramType, const char *name, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    ParamSet *set = (ParamSet*)h;
+    if (set->find(name)) return kOfxStatErrExists;
+    Param *param = new Param;
+    param->name = name;
+    param->type = paramType;
+    param->props.setString(kOfxPropType, kOfxTypeParameter);
+    param->props.setString(kOfxParamPropType, paramType);
+    param->props.setString(kOfxPropName, name);
+    param->props.setInt(kOfxParamPropSecret, 0);
+    set->params.push_back(param);
+    if (props) {
+        *props = toHandle(&param->props);
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramGetHandle(OfxParamSetHandle h, const char *name, OfxParamHandle *param, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Param *p = ((ParamSet*)h)->find(name);
+    if (!p) return kOfxStatErrUnknown;
+    *param = (OfxParamHandle)p;
+    if (props) {
+        *props = toHandle(&p->props);
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramSetGetPropertySet(OfxParamSetHandle h, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    *props = toHandle(&((ParamSet*)h)->props);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramGetPropertySet(OfxParamHandle h, OfxPropertySetHandle *props)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    *props = toHandle(&((Param*)h)->props);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+getValue(Param *param, va_list ap)
+{
+    if (paramIsString(param->type)) {
+        char **value = va_arg(ap, char**);
+        *value = (char*)param->text.c_str();
+        return kOfxStatOK;
+    }
+    int dim = paramDimension(param->type);
+    if (dim == 0) return kOfxStatErrBadHandle;
+    for (int i = 0; i < dim; ++i) {
+        double v = i < (int)param->values.size() ? param->values[i] : 0.;
+        if (paramIsInteger(param->type)) {
+            *va_arg(ap, int*) = (int)v;
+        } else {
+            *va_arg(ap, double*) = v;
+        }
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+setValue(Param *param, va_list ap)
+{
+    if (paramIsString(param->type)) {
+        const char *value = va_arg(ap, const char*);
+        param->text = value ? value : "";
+        return kOfxStatOK;
+    }
+    int dim = paramDimension(param->type);
+    if (dim == 0) return kOfxStatOK; // push buttons, groups and pages
+    param->values.resize(dim);
+    for (int i = 0; i < dim; ++i) {
+        param->values[i] = paramIsInteger(param->type) ? va_arg(ap, int) : va_arg(ap, double);
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramGetValue(OfxParamHandle h, ...)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    va_list ap;
+    va_start(ap, h);
+    OfxStatus stat = getValue((Param*)h, ap);
+    va_end(ap);
+    return stat;
+}
+
+static OfxStatus
+paramGetValueAtTime(OfxParamHandle h, OfxTime time, ...)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    va_list ap;
+    va_start(ap, time);
+    OfxStatus stat = getValue((Param*)h, ap);
+    va_end(ap);
+    return stat;
+}
+
+static OfxStatus
+paramGetDerivative(OfxParamHandle h, OfxTime time, ...)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Param *param = (Param*)h;
+    int dim = paramDimension(param->type);
+    va_list ap;
+    va_start(ap, time);
+    for (int i = 0; i < dim; ++i) {
+        *va_arg(ap, double*) = 0.;
+    }
+    va_end(ap);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramGetIntegral(OfxParamHandle h, OfxTime time1, OfxTime time2, ...)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    Param *param = (Param*)h;
+    int dim = paramDimension(param->type);
+    va_list ap;
+    va_start(ap, time2);
+    for (int i = 0; i < dim; ++i) {
+        double v = i < (int)param->values.size() ? param->values[i] : 0.;
+        *va_arg(ap, double*) = v * (time2 - time1);
+    }
+    va_end(ap);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramSetValue(OfxParamHandle h, ...)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    va_list ap;
+    va_start(ap, h);
+    OfxStatus stat = setValue((Param*)h, ap);
+    va_end(ap);
+    return stat;
+}
+
+static OfxStatus
+paramSetValueAtTime(OfxParamHandle h, OfxTime time, ...)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    va_list ap;
+    va_start(ap, time);
+    OfxStatus stat = setValue((Param*)h, ap);
+    va_end(ap);
+    return stat;
+}
+
+static OfxStatus
+paramGetNumKeys(OfxParamHandle h, unsigned int *numberOfKeys)
+{
+    if (!h) return kOfxStatErrBadHandle;
+    *numberOfKeys = 0;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramGetKeyTime(OfxParamHandle /*h*/, unsigned int /*nthKey*/, OfxTime * /*time*/)
+{
+    return kOfxStatErrBadIndex;
+}
+
+static OfxStatus
+paramGetKeyIndex(OfxParamHandle /*h*/, OfxTime /*time*/, int /*direction*/, int * /*index*/)
+{
+    return kOfxStatFailed;
+}
+
+static OfxStatus
+paramDeleteKey(OfxParamHandle /*h*/, OfxTime /*time*/)
+{
+    return kOfxStatErrBadIndex;
+}
+
+static OfxStatus
+paramDeleteAllKeys(OfxParamHandle /*h*/)
+{
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramCopy(OfxParamHandle to, OfxParamHandle from, OfxTime /*dstOffset*/, const OfxRangeD * /*frameRange*/)
+{
+    if (!to || !from) return kOfxStatErrBadHandle;
+    ((Param*)to)->values = ((Param*)from)->values;
+    ((Param*)to)->text = ((Param*)from)->text;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramEditBegin(OfxParamSetHandle /*h*/, const char * /*name*/)
+{
+    return kOfxStatOK;
+}
+
+static OfxStatus
+paramEditEnd(OfxParamSetHandle /*h*/)
+{
+    return kOfxStatOK;
+}
+
+static OfxParameterSuiteV1 gParameterSuite = {
+    paramDefine, paramGetHandle, paramSetGetPropertySet, paramGetPropertySet,
+    paramGetValue, paramGetValueAtTime, paramGetDerivative, paramGetIntegral,
+    paramSetValue, paramSetValueAtTime, paramGetNumKeys, paramGetKeyTime,
+    paramGetKeyIndex, paramDeleteKey, paramDeleteAllKeys, paramCopy,
+    paramEditBegin, paramEditEnd
+};
+
+// memory suite
+
+static OfxStatus
+memoryAlloc(void * /*handle*/, size_t nBytes, void **data)
+{
+    *data = std::malloc(nBytes);
+    return *data ? kOfxStatOK : kOfxStatErrMemory;
+}
+
+static OfxStatus
+memoryFree(void *data)
+{
+    std::free(data);
+    return kOfxStatOK;
+}
+
+static OfxMemorySuiteV1 gMemorySuite = { memoryAlloc, memoryFree };
+
+// multithread suite
+
+static pthread_key_t gThreadIndexKey;
+
+struct ThreadJob
+{
+    OfxThreadFunctionV1 *func;
+    unsigned int index;
+    unsigned int count;
+    void *arg;
+};
+
+static void*
+threadMain(void *data)
+{
+    ThreadJob *job = (ThreadJob*)data;
+    // store index + 1, so 0 (unset) means the main thread
+    pthread_setspecific(gThreadIndexKey, (void*)(size_t)(job->index + 1));
+    job->func(job->index, job->count, job->arg);
+    return NULL;
+}
+
+static OfxStatus
+multiThread(OfxThreadFunctionV1 func, unsigned int nThreads, void *customArg)
+{
+    if (nThreads == 0) {
+        nThreads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nThreads <= 1) {
+        func(0, 1, customArg);
+        return kOfxStatOK;
+    }
+    std::vector<ThreadJob> jobs(nThreads);
+    std::vector<pthread_t> threads(nThreads);
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        jobs[i].func = func;
+        jobs[i].index = i;
+        jobs[i].count = nThreads;
+        jobs[i].arg = customArg;
+        if (pthread_create(&threads[i], NULL, threadMain, &jobs[i]) != 0) {
+            for (unsigned int j = 0; j < i; ++j) {
+                pthread_join(threads[j], NULL);
+            }
+            return kOfxStatFailed;
+        }
+    }
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    return kOfxStatOK;
+}
+
+static OfxStatus
+multiThreadNumCPUs(unsigned int *nCPUs)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    *nCPUs = n > 0 ? (unsigned int)n : 1;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+multiThreadIndex(unsigned int *threadIndex)
+{
+    size_t index = (size_t)pthread_getspecific(gThreadIndexKey);
+    *threadIndex = index ? (unsigned int)(index - 1) : 0;
+    return kOfxStatOK;
+}
+
+static int
+multiThreadIsSpawnedThread(void)
+{
+    return pthread_getspecific(gThreadIndexKey) != NULL;
+}
+
+static OfxStatus
+mutexCreate(OfxMutexHandle *mutex, int lockCount)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_t *m = new pthread_mutex_t;
+    pthread_mutex_init(m, &attr);
+    pthread_mutexattr_destroy(&attr);
+    for (int i = 0; i < lockCount; ++i) {
+        pthread_mutex_lock(m);
+    }
+    *mutex = (OfxMutexHandle)m;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+mutexDestroy(const OfxMutexHandle mutex)
+{
+    pthread_mutex_t *m = (pthread_mutex_t*)mutex;
+    pthread_mutex_destroy(m);
+    delete m;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+mutexLock(const OfxMutexHandle mutex)
+{
+    return pthread_mutex_lock((pthread_mutex_t*)mutex) == 0 ? kOfxStatOK : kOfxStatFailed;
+}
+
+static OfxStatus
+mutexUnLock(const OfxMutexHandle mutex)
+{
+    return pthread_mutex_unlock((pthread_mutex_t*)mutex) == 0 ? kOfxStatOK : kOfxStatFailed;
+}
+
+static OfxStatus
+mutexTryLock(const OfxMutexHandle mutex)
+{
+    return pthread_mutex_trylock((pthread_mutex_t*)mutex) == 0 ? kOfxStatOK : kOfxStatFailed;
+}
+
+static OfxMultiThreadSuiteV1 gMultiThreadSuite = {
+    multiThread, multiThreadNumCPUs, multiThreadIndex, multiThreadIsSpawnedThread,
+    mutexCreate, mutexDestroy, mutexLock, mutexUnLock, mutexTryLock
+};
+
+// message suite, everything goes to stderr
+
+static OfxStatus
+message(void * /*handle*/, const char *messageType, const char *messageId, const char *format, ...)
+{
+    std::fprintf(stderr, "[%s] %s: ", messageType ? messageType : "", messageId ? messageId : "");
+    va_list ap;
+    va_start(ap, format);
+    std::vfprintf(stderr, format, ap);
+    va_end(ap);
+    std::fputc('\n', stderr);
+    return kOfxStatOK;
+}
+
+static OfxStatus
+setPersistentMessage(void *handle, const char *messageType, const char *messageId, const char *format, ...)
+{
+    std::fprintf(stderr, "[%s] %s: ", messageType ? messageType : "", messageId ? messageId : "");
+    va_list ap;
+    va_start(ap, format);
+    std::vfprintf(stderr, format, ap);
+    va_end(ap);
+    std::fputc('\n', stderr);
+    (void)handle;
+    return kOfxStatOK;
+}
+
+static OfxStatus
+clearPersistentMessage(void * /*handle*/)
+{
+    return kOfxStatOK;
+}
+
+static OfxMessageSuiteV2 gMessageSuite = { message, setPersistentMessage, clearPersistentMessage };
+
+// host
+
+static const void*
+fetchSuite(OfxPropertySetHandle /*host*/, const char *suiteName, int suiteVersion)
+{
+    std::string name(suiteName);
+    if (name == kOfxPropertySuite && suiteVersion == 1) return &gPropertySuite;
+    if (name == kOfxImageEffectSuite && suiteVersion == 1) return &gImageEffectSuite;
+    if (name == kOfxParameterSuite && suiteVersion == 1) return &gParameterSuite;
+    if (name == kOfxMemorySuite && suiteVersion == 1) return &gMemorySuite;
+    if (name == kOfxMultiThreadSuite && suiteVersion == 1) return &gMultiThreadSuite;
+    if (name == kOfxMessageSuite && (suiteVersion == 1 || suiteVersion == 2)) return &gMessageSuite; // V1 is a prefix of V2
+    return NULL;
+}
+
+static OfxHost gHost = { NULL, fetchSuite };
+
+static void
+setupHost()
+{
+    PropertySet &p = gHostProps;
+    p.setString(kOfxPropType, kOfxTypeImageEffectHost);
+    p.setString(kOfxPropName, kBenchHostName);
+    p.setString(kOfxPropLabel, kBenchHostLabel);
+    p.setInt(kOfxPropAPIVersion, 1, 0);
+    p.setInt(kOfxPropAPIVersion, 4, 1);
+    p.setInt(kOfxPropVersion, 1, 0);
+    p.setInt(kOfxPropVersion, 0, 1);
+    p.setString(kOfxPropVersionLabel, "1.0");
+    p.setInt(kOfxImageEffectHostPropIsBackground, 1);
+    p.setInt(kOfxImageEffectPropSupportsOverlays, 0);
+    p.setInt(kOfxImageEffectPropSupportsMultiResolution, 1);
+    p.setInt(kOfxImageEffectPropSupportsTiles, 1);
+    p.setInt(kOfxImageEffectPropTemporalClipAccess, 1);
+    p.setInt(kOfxImageEffectPropSupportsMultipleClipDepths, 0);
+    p.setInt(kOfxImageEffectPropSupportsMultipleClipPARs, 0);
+    p.setInt(kOfxImageEffectPropSetableFrameRate, 0);
+    p.setInt(kOfxImageEffectPropSetableFielding, 0);
+    p.setInt(kOfxImageEffectInstancePropSequentialRender, 0);
+    p.setInt(kOfxParamHostPropSupportsCustomInteract, 0);
+    p.setInt(kOfxParamHostPropSupportsStringAnimation, 0);
+    p.setInt(kOfxParamHostPropSupportsChoiceAnimation, 0);
+    p.setInt(kOfxParamHostPropSupportsBooleanAnimation, 0);
+    p.setInt(kOfxParamHostPropSupportsCustomAnimation, 0);
+    p.setInt(kOfxParamHostPropSupportsParametricAnimation, 0);
+    p.setInt(kOfxParamHostPropMaxParameters, -1);
+    p.setInt(kOfxParamHostPropMaxPages, 0);
+    p.setInt(kOfxParamHostPropPageRowColumnCount, 0, 0);
+    p.setInt(kOfxParamHostPropPageRowColumnCount, 0, 1);
+    p.setString(kOfxImageEffectPropSupportedComponents, kOfxImageComponentRGBA, 0);
+    p.setString(kOfxImageEffectPropSupportedComponents, kOfxImageComponentRGB, 1);
+    p.setString(kOfxImageEffectPropSupportedComponents, kOfxImageComponentAlpha, 2);
+    p.setString(kOfxImageEffectPropSupportedContexts, kOfxImageEffectContextFilter, 0);
+    p.setString(kOfxImageEffectPropSupportedContexts, kOfxImageEffectContextGeneral, 1);
+    p.setString(kOfxImageEffectPropSupportedContexts, kOfxImageEffectContextGenerator, 2);
+    p.setString(kOfxImageEffectPropSupportedContexts, kOfxImageEffectContextReader, 3);
+    p.setString(kOfxImageEffectPropSupportedPixelDepths, kOfxBitDepthFloat, 0);
+    p.setString(kOfxImageEffectHostPropNativeOrigin, kOfxHostNativeOriginBottomLeft);
+    gHost.host = toHandle(&gHostProps);
+}
+
+// benchmark
+
+struct BenchOptions
+{
+    BenchOptions() : iterations(kBenchDefaultIterations), timeout(kBenchDefaultTimeout), stress(true), defaults(true) {}
+    std::vector<std::string> binaries;
+    std::vector<std::string> filters;
+    std::vector<std::string> sizes;
+    std::string readFile;
+    std::string output;
+    int iterations;
+    int timeout;
+    bool stress;
+    bool defaults;
+};
+
+struct BenchCase
+{
+    std::string binary;
+    int plugin;
+    std::string identifier;
+    std::string size;
+    int width;
+    int height;
+    bool stress;
+};
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool
+frameSize(const std::string &size, int *width, int *height)
+{
+    if (size == "1080p" || size == "hd") {
+        *width = 1920;
+        *height = 1080;
+    } else if (size == "4k" || size == "uhd") {
+        *width = 3840;
+        *height = 2160;
+    } else if (size == "8k") {
+        *width = 7680;
+        *height = 4320;
+    } else {
+        return sscanf(size.c_str(), "%dx%d", width, height) == 2 && *width > 0 && *height > 0;
+    }
+    return true;
+}
+
+// the bundle root, plugins find their resources in <root>/Contents/Resources
+static std::string
+bundlePath(const std::string &binary)
+{
+    size_t pos = binary.find(".ofx.bundle");
+    if (pos == std::string::npos) {
+        return binary;
+    }
+    return binary.substr(0, pos + 11);
+}
+
+static std::string
+jsonEscape(const std::string &s)
+{
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// deterministic premultiplied RGBA test pattern: gradients, rings and some high frequency noise
+static void
+fillSource(Clip *clip, int width, int height)
+{
+    clip->bounds.x1 = 0;
+    clip->bounds.y1 = 0;
+    clip->bounds.x2 = width;
+    clip->bounds.y2 = height;
+    clip->pixels.resize((size_t)width * height * 4);
+    unsigned int seed = 0x9e3779b9u;
+    for (int y = 0; y < height; ++y) {
+        float *pix = &clip->pixels[(size_t)y * width * 4];
+        for (int x = 0; x < width; ++x, pix += 4) {
+            seed = seed * 1664525u + 1013904223u;
+            float noise = (seed >> 8) * (1.f / 16777216.f) * 0.1f;
+            float fx = (float)x / width;
+            float fy = (float)y / height;
+            float dx = fx - 0.5f;
+            float dy = fy - 0.5f;
+            float ring = 0.5f + 0.5f * std::sin(std::sqrt(dx * dx + dy * dy) * 80.f);
+            float alpha = std::min(1.f, 0.25f + 2.f * (0.5f - std::max(std::fabs(dx), std::fabs(dy))));
+            pix[0] = (0.8f * fx + 0.2f * ring + noise) * alpha;
+            pix[1] = (0.8f * fy + 0.2f * ring + noise) * alpha;
+            pix[2] = (0.5f * ring + noise) * alpha;
+            pix[3] = alpha;
+        }
+    }
+}
+
+static void
+copyProps(const PropertySet &from, PropertySet &to)
+{
+    for (std::map<std::string, Property>::const_iterator it = from.props.begin(); it != from.props.end(); ++it) {
+        to.props[it->first] = it->second;
+    }
+}
+
+// instance parameters start at their default value, stress values push numeric parameters to the display maximum
+static void
+setupParams(const ParamSet &desc, ParamSet &params, bool stress, const std::string &readFile)
+{
+    copyProps(desc.props, params.props);
+    for (size_t i = 0; i < desc.params.size(); ++i) {
+        const Param *d = desc.params[i];
+        Param *p = new Param;
+        p->name = d->name;
+        p->type = d->type;
+        copyProps(d->props, p->props);
+        p->props.setString(kOfxPropType, kOfxTypeParameterInstance);
+        int dim = paramDimension(p->type);
+        p->values.resize(dim);
+        for (int k = 0; k < dim; ++k) {
+            p->values[k] = p->props.getDouble(kOfxParamPropDefault, k, 0.);
+            if (stress && !paramIsInteger(p->type) && p->type != kOfxParamTypeRGB && p->type != kOfxParamTypeRGBA) {
+                p->values[k] = p->props.getDouble(kOfxParamPropDisplayMax, k, p->values[k]);
+            } else if (stress && p->type == kOfxParamTypeInteger) {
+                double max = p->props.getDouble(kOfxParamPropDisplayMax, k, p->values[k]);
+                if (max < 1e6) {
+                    p->values[k] = max;
+                }
+            }
+        }
+        if (paramIsString(p->type)) {
+            p->text = p->props.getString(kOfxParamPropDefault);
+        }
+        if (p->name == kOfxImageEffectFileParamName && !readFile.empty()) {
+            p->text = readFile;
+        }
+        params.params.push_back(p);
+    }
+}
+
+static std::string
+chooseContext(const PropertySet &desc, bool canRead)
+{
+    const Property *contexts = desc.find(kOfxImageEffectPropSupportedContexts);
+    if (!contexts) {
+        return std::string();
+    }
+    const char *preferred[] = { kOfxImageEffectContextFilter, kOfxImageEffectContextGeneral, kOfxImageEffectContextGenerator, kOfxImageEffectContextReader };
+    for (int i = 0; i < 4; ++i) {
+        for (size_t k = 0; k < contexts->s.size(); ++k) {
+            if (contexts->s[k] == preferred[i] && (canRead || std::string(preferred[i]) != kOfxImageEffectContextReader)) {
+                return preferred[i];
+            }
+        }
+    }
+    return std::string();
+}
+
+// run one case in the current process, returns a JSON object
+static std::string
+runCase(const BenchCase &bench, const BenchOptions &options)
+{
+    std::ostringstream json;
+    json << "{\"plugin\":\"" << jsonEscape(bench.identifier) << "\",\"binary\":\"" << jsonEscape(bench.binary)
+         << "\",\"size\":\"" << bench.size << "\",\"width\":" << bench.width << ",\"height\":" << bench.height
+         << ",\"params\":\"" << (bench.stress ? "stress" : "default") << "\"";
+
+    void *lib = dlopen(bench.binary.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!lib) {
+        json << ",\"status\":\"" << jsonEscape(dlerror()) << "\"}";
+        return json.str();
+    }
+    OfxGetPluginFunc getPlugin = (OfxGetPluginFunc)dlsym(lib, "OfxGetPlugin");
+    OfxPlugin *plugin = getPlugin ? getPlugin(bench.plugin) : NULL;
+    if (!plugin) {
+        json << ",\"status\":\"plugin not found\"}";
+        return json.str();
+    }
+
+    plugin->setHost(&gHost);
+    OfxStatus stat = plugin->mainEntry(kOfxActionLoad, NULL, NULL, NULL);
+    if (stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+        json << ",\"status\":\"load failed (" << stat << ")\"}";
+        return json.str();
+    }
+
+    std::string bundle = bundlePath(bench.binary);
+    Effect desc;
+    desc.props.setString(kOfxPropType, kOfxTypeImageEffect);
+    desc.props.setString(kOfxPluginPropFilePath, bundle);
+    stat = plugin->mainEntry(kOfxActionDescribe, &desc, NULL, NULL);
+    if (stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+        json << ",\"status\":\"describe failed (" << stat << ")\"}";
+        return json.str();
+    }
+
+    std::string context = chooseContext(desc.props, !options.readFile.empty());
+    json << ",\"context\":\"" << jsonEscape(context) << "\"";
+    if (context.empty()) {
+        json << ",\"status\":\"no usable context\"}";
+        return json.str();
+    }
+
+    Effect ctxDesc;
+    copyProps(desc.props, ctxDesc.props);
+    PropertySet ctxArgs;
+    ctxArgs.setString(kOfxImageEffectPropContext, context);
+    stat = plugin->mainEntry(kOfxImageEffectActionDescribeInContext, &ctxDesc, toHandle(&ctxArgs), NULL);
+    if (stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+        json << ",\"status\":\"describe in context failed (" << stat << ")\"}";
+        return json.str();
+    }
+
+    // instance
+    Effect instance;
+    copyProps(ctxDesc.props, instance.props);
+    instance.props.setString(kOfxPropType, kOfxTypeImageEffectInstance);
+    instance.props.setString(kOfxImageEffectPropContext, context);
+    instance.props.setPointer(kOfxPropInstanceData, NULL);
+    instance.props.setInt(kOfxPropIsInteractive, 0);
+    instance.props.setDouble(kOfxImageEffectPropProjectSize, bench.width, 0);
+    instance.props.setDouble(kOfxImageEffectPropProjectSize, bench.height, 1);
+    instance.props.setDouble(kOfxImageEffectPropProjectExtent, bench.width, 0);
+    instance.props.setDouble(kOfxImageEffectPropProjectExtent, bench.height, 1);
+    instance.props.setDouble(kOfxImageEffectPropProjectOffset, 0., 0);
+    instance.props.setDouble(kOfxImageEffectPropProjectOffset, 0., 1);
+    instance.props.setDouble(kOfxImageEffectPropProjectPixelAspectRatio, 1.);
+    instance.props.setDouble(kOfxImageEffectInstancePropEffectDuration, 1.);
+    instance.props.setInt(kOfxImageEffectInstancePropSequentialRender, 0);
+    instance.props.setDouble(kOfxImageEffectPropFrameRate, 24.);
+    instance.props.setString(kOfxPluginPropFilePath, bundle);
+    setupParams(ctxDesc.params, instance.params, bench.stress, options.readFile);
+    for (size_t i = 0; i < ctxDesc.clips.size(); ++i) {
+        const Clip *d = ctxDesc.clips[i];
+        Clip *c = new Clip;
+        c->name = d->name;
+        copyProps(d->props, c->props);
+        bool output = c->name == kOfxImageEffectOutputClipName;
+        bool source = !output && c->props.getDouble(kOfxImageClipPropIsMask, 0, 0.) == 0.;
+        c->props.setInt(kOfxImageClipPropConnected, (output || source) ? 1 : 0);
+        c->props.setString(kOfxImageEffectPropComponents, kOfxImageComponentRGBA);
+        c->props.setString(kOfxImageClipPropUnmappedComponents, kOfxImageComponentRGBA);
+        c->props.setString(kOfxImageEffectPropPixelDepth, kOfxBitDepthFloat);
+        c->props.setString(kOfxImageClipPropUnmappedPixelDepth, kOfxBitDepthFloat);
+        c->props.setString(kOfxImageEffectPropPreMultiplication, kOfxImagePreMultiplied);
+        c->props.setDouble(kOfxImagePropPixelAspectRatio, 1.);
+        c->props.setDouble(kOfxImageEffectPropFrameRate, 24.);
+        c->props.setDouble(kOfxImageEffectPropUnmappedFrameRate, 24.);
+        c->props.setDouble(kOfxImageEffectPropFrameRange, 0., 0);
+        c->props.setDouble(kOfxImageEffectPropFrameRange, 0., 1);
+        c->props.setDouble(kOfxImageEffectPropUnmappedFrameRange, 0., 0);
+        c->props.setDouble(kOfxImageEffectPropUnmappedFrameRange, 0., 1);
+        c->props.setString(kOfxImageClipPropFieldOrder, kOfxImageFieldNone);
+        c->props.setInt(kOfxImageClipPropContinuousSamples, 0);
+        if (output) {
+            c->bounds.x1 = c->bounds.y1 = 0;
+            c->bounds.x2 = bench.width;
+            c->bounds.y2 = bench.height;
+            c->pixels.assign((size_t)bench.width * bench.height * 4, 0.f);
+        } else if (source) {
+            fillSource(c, bench.width, bench.height);
+        }
+        instance.clips.push_back(c);
+    }
+
+    stat = plugin->mainEntry(kOfxActionCreateInstance, &instance, NULL, NULL);
+    if (stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+        json << ",\"status\":\"create instance failed (" << stat << ")\"}";
+        return json.str();
+    }
+
+    PropertySet prefs;
+    plugin->mainEntry(kOfxImageEffectActionGetClipPreferences, &instance, NULL, toHandle(&prefs));
+
+    PropertySet renderArgs;
+    renderArgs.setDouble(kOfxPropTime, 0.);
+    renderArgs.setString(kOfxImageEffectPropFieldToRender, kOfxImageFieldNone);
+    renderArgs.setInt(kOfxImageEffectPropRenderWindow, 0, 0);
+    renderArgs.setInt(kOfxImageEffectPropRenderWindow, 0, 1);
+    renderArgs.setInt(kOfxImageEffectPropRenderWindow, bench.width, 2);
+    renderArgs.setInt(kOfxImageEffectPropRenderWindow, bench.height, 3);
+    renderArgs.setDouble(kOfxImageEffectPropRenderScale, 1., 0);
+    renderArgs.setDouble(kOfxImageEffectPropRenderScale, 1., 1);
+    renderArgs.setInt(kOfxImageEffectPropSequentialRenderStatus, 0);
+    renderArgs.setInt(kOfxImageEffectPropInteractiveRenderStatus, 0);
+    renderArgs.setInt(kOfxImageEffectPropRenderQualityDraft, 0);
+
+    // one warm up render (caches, kernel builds, downloads), then the timed ones
+    std::vector<double> times;
+    for (int i = 0; i <= options.iterations; ++i) {
+        double start = now();
+        stat = plugin->mainEntry(kOfxImageEffectActionRender, &instance, toHandle(&renderArgs), NULL);
+        double elapsed = now() - start;
+        if (stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+            break;
+        }
+        if (i > 0) {
+            times.push_back(elapsed);
+        }
+    }
+
+    plugin->mainEntry(kOfxActionDestroyInstance, &instance, NULL, NULL);
+    plugin->mainEntry(kOfxActionUnload, NULL, NULL, NULL);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    if (times.empty()) {
+        json << ",\"status\":\"render failed (" << stat << ")\",\"peakRSSKB\":" << usage.ru_maxrss << "}";
+        return json.str();
+    }
+    double total = 0., best = times[0];
+    for (size_t i = 0; i < times.size(); ++i) {
+        total += times[i];
+        best = std::min(best, times[i]);
+    }
+    double mean = total / times.size();
+    double megapixels = (double)bench.width * bench.height / 1e6;
+    json << ",\"status\":\"ok\",\"iterations\":" << times.size()
+         << ",\"meanSeconds\":" << mean << ",\"minSeconds\":" << best
+         << ",\"megapixelsPerSecond\":" << megapixels / mean
+         << ",\"peakRSSKB\":" << usage.ru_maxrss << "}";
+    return json.str();
+}
+
+// run one case in a child process, so crashes are reported and the peak RSS is per case
+static std::string
+forkCase(const BenchCase &bench, const BenchOptions &options)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return "{\"status\":\"pipe failed\"}";
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        alarm(options.timeout);
+        std::string result = runCase(bench, options);
+        ssize_t written = write(fds[1], result.c_str(), result.size());
+        (void)written;
+        close(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string result;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, n);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (result.empty()) {
+        std::ostringstream json;
+        json << "{\"plugin\":\"" << jsonEscape(bench.identifier) << "\",\"size\":\"" << bench.size
+             << "\",\"params\":\"" << (bench.stress ? "stress" : "default") << "\",\"status\":\"";
+        if (WIFSIGNALED(status)) {
+            json << (WTERMSIG(status) == SIGALRM ? "timeout" : "crashed") << " (signal " << WTERMSIG(status) << ")";
+        } else {
+            json << "exited (" << WEXITSTATUS(status) << ")";
+        }
+        json << "\"}";
+        result = json.str();
+    }
+    return result;
+}
+
+static void
+usage()
+{
+    std::cout << "usage: ArenaBench [options] plugin.ofx...\n"
+              << "  -p <text>     only plugins whose identifier contains text (repeatable)\n"
+              << "  -s <size>     frame size: 1080p, 4k, 8k or WxH (repeatable, default 1080p)\n"
+              << "  -n <count>    timed renders per case (default " << kBenchDefaultIterations << ")\n"
+              << "  -m <mode>     parameters: default, stress or both (default both)\n"
+              << "  -r <file>     file used by reader plugins (readers are skipped without it)\n"
+              << "  -t <seconds>  timeout per case (default " << kBenchDefaultTimeout << ")\n"
+              << "  -o <file>     write the JSON report to file instead of stdout\n"
+              << "  -l            list plugins and exit" << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+    BenchOptions options;
+    bool list = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:n:m:r:t:o:lh")) != -1) {
+        switch (opt) {
+        case 'p': options.filters.push_back(optarg); break;
+        case 's': options.sizes.push_back(optarg); break;
+        case 'n': options.iterations = std::max(1, std::atoi(optarg)); break;
+        case 'm':
+            options.defaults = std::string(optarg) != "stress";
+            options.stress = std::string(optarg) != "default";
+            break;
+        case 'r': options.readFile = optarg; break;
+        case 't': options.timeout = std::max(1, std::atoi(optarg)); break;
+        case 'o': options.output = optarg; break;
+        case 'l': list = true; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    for (int i = optind; i < argc; ++i) {
+        options.binaries.push_back(argv[i]);
+    }
+    if (options.binaries.empty()) {
+        usage();
+        return 1;
+    }
+    if (options.sizes.empty()) {
+        options.sizes.push_back("1080p");
+    }
+
+    pthread_key_create(&gThreadIndexKey, NULL);
+    setupHost();
+
+    // enumerate cases, only the static plugin table is read here
+    std::vector<BenchCase> cases;
+    for (size_t b = 0; b < options.binaries.size(); ++b) {
+        void *lib = dlopen(options.binaries[b].c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!lib) {
+            std::cerr << "Unable to load " << options.binaries[b] << ": " << dlerror() << std::endl;
+            continue;
+        }
+        OfxGetNumberOfPluginsFunc getCount = (OfxGetNumberOfPluginsFunc)dlsym(lib, "OfxGetNumberOfPlugins");
+        OfxGetPluginFunc getPlugin = (OfxGetPluginFunc)dlsym(lib, "OfxGetPlugin");
+        if (!getCount || !getPlugin) {
+            std::cerr << options.binaries[b] << " is not an OFX plugin" << std::endl;
+            continue;
+        }
+        int count = getCount();
+        for (int i = 0; i < count; ++i) {
+            OfxPlugin *plugin = getPlugin(i);
+            if (!plugin || std::strcmp(plugin->pluginApi, kOfxImageEffectPluginApi) != 0) {
+                continue;
+            }
+            std::string id = plugin->pluginIdentifier;
+            bool wanted = options.filters.empty();
+            for (size_t f = 0; f < options.filters.size(); ++f) {
+                wanted |= id.find(options.filters[f]) != std::string::npos;
+            }
+            if (!wanted) {
+                continue;
+            }
+            if (list) {
+                std::cout << id << " " << plugin->pluginVersionMajor << "." << plugin->pluginVersionMinor << std::endl;
+                continue;
+            }
+            for (size_t s = 0; s < options.sizes.size(); ++s) {
+                BenchCase bench;
+                bench.binary = options.binaries[b];
+                bench.plugin = i;
+                bench.identifier = id;
+                bench.size = options.sizes[s];
+                if (!frameSize(bench.size, &bench.width, &bench.height)) {
+                    std::cerr << "Unknown frame size " << bench.size << std::endl;
+                    return 1;
+                }
+                if (options.defaults) {
+                    bench.stress = false;
+                    cases.push_back(bench);
+                }
+                if (options.stress) {
+                    bench.stress = true;
+                    cases.push_back(bench);
+                }
+            }
+        }
+        // keep the library loaded, the children are forked from this process
+    }
+    if (list) {
+        return 0;
+    }
+
+    std::ostringstream report;
+    report << "{\"host\":\"" << kBenchHostLabel << "\",\"iterations\":" << options.iterations << ",\"results\":[\n";
+    for (size_t i = 0; i < cases.size(); ++i) {
+        std::cerr << "[" << i + 1 << "/" << cases.size() << "] " << cases[i].identifier << " " << cases[i].size
+                  << " " << (cases[i].stress ? "stress" : "default") << std::endl;
+        report << forkCase(cases[i], options) << (i + 1 < cases.size() ? ",\n" : "\n");
+    }
+    report << "]}\n";
+
+    if (options.output.empty()) {
+        std::cout << report.str();
+    } else {
+        std::FILE *file = std::fopen(options.output.c_str(), "w");
+        if (!file) {
+            std::cerr << "Unable to write " << options.output << std::endl;
+            return 1;
+        }
+        std::fputs(report.str().c_str(), file);
+        std::fclose(file);
+    }
+    return 0;
+}
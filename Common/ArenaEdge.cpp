@@ -0,0 +1,247 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "ArenaEdge.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// ImageMagick's MagickEpsilon and QuantumScale (Q16)
+#define kArenaEdgeEpsilon 1.0e-12
+#define kArenaEdgeQuantumScale (1. / 65535.)
+
+int
+arenaKernelWidth(double radius, double sigma)
+{
+    if (radius > kArenaEdgeEpsilon) {
+        return 2 * (int)std::ceil(radius) + 1;
+    }
+    double gamma = std::fabs(sigma);
+    if (gamma <= kArenaEdgeEpsilon) {
+        return 3;
+    }
+    // grow the kernel until its last tap no longer counts
+    double alpha = 1. / (2. * gamma * gamma);
+    int width = 5;
+    for (;;) {
+        int j = (width - 1) / 2;
+        double normalize = 0.;
+        for (int i = -j; i <= j; ++i) {
+            normalize += std::exp(-(double)(i * i) * alpha);
+        }
+        double value = std::exp(-(double)(j * j) * alpha) / normalize;
+        if (value < kArenaEdgeQuantumScale || value < kArenaEdgeEpsilon) {
+            break;
+        }
+        width += 2;
+    }
+    return width - 2;
+}
+
+void
+arenaGaussianKernel(int width, double sigma, bool centred, std::vector<float> &kernel)
+{
+    // the 1/(sqrt(2pi)sigma) factor goes away with the normalization
+    double gamma = std::max(std::fabs(sigma), kArenaEdgeEpsilon);
+    int origin = centred ? (width - 1) / 2 : 0;
+    std::vector<double> weights(width);
+    double normalize = 0.;
+    for (int i = 0; i < width; ++i) {
+        double k = i - origin;
+        weights[i] = std::exp(-(k * k) / (2. * gamma * gamma));
+        normalize += weights[i];
+    }
+    kernel.resize(width);
+    for (int i = 0; i < width; ++i) {
+        kernel[i] = (float)(weights[i] / normalize);
+    }
+}
+
+// taps of kernel that are not zero, a small sigma leaves most of them out
+static void
+kernelSupport(const std::vector<float> &kernel, int &first, int &last)
+{
+    first = 0;
+    last = (int)kernel.size() - 1;
+    while (first < last && kernel[first] == 0.f) {
+        ++first;
+    }
+    while (last > first && kernel[last] == 0.f) {
+        --last;
+    }
+}
+
+void
+arenaConvolveRow(const float *src, int width, const std::vector<float> &kernel, float *dst)
+{
+    int first, last;
+    kernelSupport(kernel, first, last);
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= width; x += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int i = first; i <= last; ++i) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel[i]), _mm_loadu_ps(src + x + i)));
+        }
+        _mm_storeu_ps(dst + x, sum);
+    }
+#endif
+    for (; x < width; ++x) {
+        float sum = 0.f;
+        for (int i = first; i <= last; ++i) {
+            sum += kernel[i] * src[x + i];
+        }
+        dst[x] = sum;
+    }
+}
+
+ArenaRowWindow::ArenaRowWindow(int size, int width)
+: _rows((size_t)size * width)
+, _size(size)
+, _width(width)
+, _first(0)
+, _count(0)
+{
+}
+
+float *
+ArenaRowWindow::push()
+{
+    if (_count < _size) {
+        return &_rows[(size_t)(_count++) * _width];
+    }
+    float *row = &_rows[(size_t)_first * _width];
+    _first = (_first + 1) % _size;
+    return row;
+}
+
+void
+arenaConvolveRows(const ArenaRowWindow &rows, int width, const std::vector<float> &kernel, float *dst)
+{
+    int first, last;
+    kernelSupport(kernel, first, last);
+    const float *row = rows.row(first);
+    for (int x = 0; x < width; ++x) {
+        dst[x] = kernel[first] * row[x];
+    }
+    for (int i = first + 1; i <= last; ++i) {
+        row = rows.row(i);
+        float k = kernel[i];
+        int x = 0;
+#ifdef __SSE2__
+        __m128 k4 = _mm_set1_ps(k);
+        for (; x + 4 <= width; x += 4) {
+            _mm_storeu_ps(dst + x, _mm_add_ps(_mm_loadu_ps(dst + x), _mm_mul_ps(k4, _mm_loadu_ps(row + x))));
+        }
+#endif
+        for (; x < width; ++x) {
+            dst[x] += k * row[x];
+        }
+    }
+}
+
+ArenaEdgeFilter::ArenaEdgeFilter(int size, int width)
+: _rows(size, width + size - 1)
+, _sums(width + size - 1, 0.)
+, _size(size)
+, _width(width)
+{
+}
+
+float *
+ArenaEdgeFilter::input()
+{
+    // the oldest row is about to be overwritten, take it out of the sums first
+    if (_rows.count() == _size) {
+        const float *oldest = _rows.row(0);
+        for (size_t c = 0; c < _sums.size(); ++c) {
+            _sums[c] -= oldest[c];
+        }
+    }
+    return _rows.push();
+}
+
+bool
+ArenaEdgeFilter::push()
+{
+    const float *newest = _rows.row(_rows.count() - 1);
+    for (size_t c = 0; c < _sums.size(); ++c) {
+        _sums[c] += newest[c];
+    }
+    return _rows.count() == _size;
+}
+
+void
+ArenaEdgeFilter::apply(float *dst) const
+{
+    const float *centre = _rows.row(_size / 2) + _size / 2;
+    double area = (double)_size * _size;
+    double box = 0.;
+    for (int i = 0; i < _size - 1; ++i) {
+        box += _sums[i];
+    }
+    for (int x = 0; x < _width; ++x) {
+        box += _sums[x + _size - 1];
+        double edge = area * centre[x] - box;
+        dst[x] = (float)std::max(0., std::min(edge, 1.));
+        box -= _sums[x];
+    }
+}
+
+void
+arenaAddLevels(const float *row, int width, unsigned int *histogram)
+{
+    for (int x = 0; x < width; ++x) {
+        float v = std::max(0.f, std::min(row[x], 1.f));
+        ++histogram[(int)(v * (kArenaLevelBins - 1) + 0.5f)];
+    }
+}
+
+void
+arenaNormalizeLevels(const unsigned int *histogram, float &black, float &white)
+{
+    double total = 0.;
+    for (int i = 0; i < kArenaLevelBins; ++i) {
+        total += histogram[i];
+    }
+    double blackPoint = total * 0.0015;
+    double whitePoint = total * 0.9995;
+
+    int low = 0;
+    double intensity = 0.;
+    for (; low < kArenaLevelBins - 1; ++low) {
+        intensity += histogram[low];
+        if (intensity > blackPoint) {
+            break;
+        }
+    }
+    int high = kArenaLevelBins - 1;
+    intensity = 0.;
+    for (; high > 0; --high) {
+        intensity += histogram[high];
+        if (intensity > total - whitePoint) {
+            break;
+        }
+    }
+    black = (float)low / (kArenaLevelBins - 1);
+    white = (float)high / (kArenaLevelBins - 1);
+}
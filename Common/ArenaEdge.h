@@ -0,0 +1,108 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef ArenaEdge_h
+#define ArenaEdge_h
+
+#include <cstddef>
+#include <vector>
+
+/* Native versions of the ImageMagick stages the Charcoal and Sketch plugins are made of
+ * (EdgeImage, BlurImage, MotionBlurImage and NormalizeImage), working on one channel float rows.
+ *
+ * The filters are fed rows top to bottom and only keep the last few of them, so a plugin can chain
+ * them in a single pass over a strip of rows that stays in the cache instead of filtering whole frames.
+ * Nothing here depends on the OFX runtime.
+ */
+
+#define kArenaLevelBins 16384
+
+// width of the kernel ImageMagick uses for radius and sigma (GetOptimalKernelWidth1D)
+int arenaKernelWidth(double radius, double sigma);
+
+/* Normalized gaussian weights of sigma for width taps, centred on the middle tap (BlurImage)
+ * or on the first one (MotionBlurImage). A zero sigma keeps the centre only. */
+void arenaGaussianKernel(int width, double sigma, bool centred, std::vector<float> &kernel);
+
+// dst[x] = sum of kernel[i] * src[x + i] for the width columns of dst, src has width + kernel size - 1 columns
+void arenaConvolveRow(const float *src, int width, const std::vector<float> &kernel, float *dst);
+
+/* The last size rows pushed, oldest first. */
+class ArenaRowWindow
+{
+public:
+    ArenaRowWindow(int size, int width);
+
+    // row to fill, it becomes the newest row and replaces the oldest one once the window is full
+    float *push();
+    // i-th row of the window, 0 is the oldest
+    const float *row(int i) const { return &_rows[(size_t)((_first + i) % _size) * _width]; }
+    int size() const { return _size; }
+    // rows pushed so far, up to size
+    int count() const { return _count; }
+
+private:
+    std::vector<float> _rows;
+    int _size;
+    int _width;
+    int _first;
+    int _count;
+};
+
+/* Column sum of a window of rows: dst[x] = sum of kernel[i] * row(i)[x] for width columns. */
+void arenaConvolveRows(const ArenaRowWindow &rows, int width, const std::vector<float> &kernel, float *dst);
+
+/* EdgeImage: size x size kernel of -1 with size * size - 1 in the centre, clamped to [0,1].
+ * Rows of width + size - 1 columns go in, once size rows were pushed each push gives the edge row
+ * of the row pushed size / 2 rows earlier. */
+class ArenaEdgeFilter
+{
+public:
+    ArenaEdgeFilter(int size, int width);
+
+    // row to fill with the next input row
+    float *input();
+    // add the row filled, false until an edge row is ready
+    bool push();
+    // edge row of the centre of the window, width columns
+    void apply(float *dst) const;
+
+private:
+    ArenaRowWindow _rows;
+    std::vector<double> _sums; // column sums of the window
+    int _size;
+    int _width;
+};
+
+/* NormalizeImage clips the darkest 0.15% and the brightest 0.05% of the pixels and stretches the rest to [0,1].
+ * Levels are found from a histogram of kArenaLevelBins bins over [0,1]. */
+void arenaAddLevels(const float *row, int width, unsigned int *histogram);
+void arenaNormalizeLevels(const unsigned int *histogram, float &black, float &white);
+
+inline float
+arenaNormalize(float value, float black, float white)
+{
+    if (value < black) {
+        return 0.f;
+    }
+    if (value > white) {
+        return 1.f;
+    }
+    return white > black ? (value - black) / (white - black) : 0.f;
+}
+
+#endif // ArenaEdge_h
@@ -0,0 +1,715 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "ArenaLut.h"
+#include "ofxsMacros.h"
+#include "ofxsMultiThread.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// intervals of the input shaper
+#define kArenaLutShaperSize 4096
+
+// lattice
+
+ArenaLut3D::ArenaLut3D()
+    : _size(0)
+    , _gamma(1.)
+{
+}
+
+bool
+ArenaLut3D::setLattice(const float *rgb, int n, double gamma)
+{
+    if ( !rgb || (n < 2) || (gamma <= 0.) ) {
+        return false;
+    }
+
+    // resample big lattices down to kArenaLutMaxSize nodes per axis
+    int size = std::min(n, kArenaLutMaxSize);
+    _table.resize((size_t)size * size * size * 4);
+    float *node = &_table[0];
+    for (int b = 0; b < size; ++b) {
+        for (int g = 0; g < size; ++g) {
+            for (int r = 0; r < size; ++r, node += 4) {
+                if (size == n) {
+                    const float *src = rgb + ((size_t)r + (size_t)n * g + (size_t)n * n * b) * 3;
+                    node[0] = src[0];
+                    node[1] = src[1];
+                    node[2] = src[2];
+                } else {
+                    // trilinear
+                    double scale = (n - 1.) / (size - 1.);
+                    double pos[3] = { r * scale, g * scale, b * scale };
+                    int i[3];
+                    double t[3];
+                    for (int k = 0; k < 3; ++k) {
+                        i[k] = std::min((int)pos[k], n - 2);
+                        t[k] = pos[k] - i[k];
+                    }
+                    double sum[3] = { 0., 0., 0. };
+                    for (int corner = 0; corner < 8; ++corner) {
+                        double w = 1.;
+                        size_t offset = 0;
+                        size_t stride = 1;
+                        for (int k = 0; k < 3; ++k, stride *= n) {
+                            int d = (corner >> k) & 1;
+                            w *= d ? t[k] : 1. - t[k];
+                            offset += (i[k] + d) * stride;
+                        }
+                        for (int c = 0; c < 3; ++c) {
+                            sum[c] += w * rgb[offset * 3 + c];
+                        }
+                    }
+                    node[0] = (float)sum[0];
+                    node[1] = (float)sum[1];
+                    node[2] = (float)sum[2];
+                }
+                node[3] = 0.f;
+            }
+        }
+    }
+
+    // input shaper, x^(1/gamma) = sqrt(x)^(2/gamma) is smooth enough near 0 for a linear table over sqrt(x)
+    _shaper.resize(kArenaLutShaperSize + 1);
+    for (int k = 0; k <= kArenaLutShaperSize; ++k) {
+        _shaper[k] = (float)(std::pow((double)k / kArenaLutShaperSize, 2. / gamma) * (size - 1));
+    }
+    _size = size;
+    _gamma = gamma;
+
+    return true;
+}
+
+bool
+ArenaLut3D::setHald(const float *pixels, int columns, int rows, double gamma)
+{
+    // the pixels of a Hald image are its lattice nodes in order
+    int size = arenaLutHaldSize(columns, rows);
+    if (size == 0) {
+        return false;
+    }
+    return setLattice(pixels, size, gamma);
+}
+
+void
+ArenaLut3D::getHald(std::vector<float> &pixels, int &width) const
+{
+    int level = (int)(std::sqrt((double)_size) + 0.5);
+    width = level * level * level;
+    pixels.assign((size_t)width * width * 3, 0.f);
+    if (level * level != _size) {
+        return;
+    }
+    size_t count = (size_t)_size * _size * _size;
+    for (size_t i = 0; i < count; ++i) {
+        std::memcpy(&pixels[i * 3], &_table[i * 4], 3 * sizeof(float));
+    }
+}
+
+float
+ArenaLut3D::coordinate(float v) const
+{
+    if ( !(v > 0.f) ) {
+        return 0.f;
+    }
+    if (v >= 1.f) {
+        return _shaper[kArenaLutShaperSize];
+    }
+    float s = std::sqrt(v) * kArenaLutShaperSize;
+    int k = std::min((int)s, kArenaLutShaperSize - 1);
+    float t = s - k;
+
+    return _shaper[k] + (_shaper[k + 1] - _shaper[k]) * t;
+}
+
+void
+ArenaLut3D::apply(const float rgb[3], float out[3]) const
+{
+    float pos[3];
+    int i[3];
+    float f[3];
+    for (int c = 0; c < 3; ++c) {
+        pos[c] = coordinate(rgb[c]);
+        i[c] = std::min((int)pos[c], _size - 2);
+        f[c] = pos[c] - i[c];
+    }
+
+    // the cube is split in six tetrahedra along its diagonal, pick the one holding (fr,fg,fb)
+    const size_t stepR = 4;
+    const size_t stepG = (size_t)_size * 4;
+    const size_t stepB = (size_t)_size * _size * 4;
+    const float *c000 = &_table[i[0] * stepR + i[1] * stepG + i[2] * stepB];
+    const float *c111 = c000 + stepR + stepG + stepB;
+    const float *v1, *v2;
+    float w0, w1, w2, w3;
+    float fr = f[0], fg = f[1], fb = f[2];
+    if (fr > fg) {
+        if (fg > fb) {
+            v1 = c000 + stepR;
+            v2 = c000 + stepR + stepG;
+            w0 = 1.f - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+        } else if (fr > fb) {
+            v1 = c000 + stepR;
+            v2 = c000 + stepR + stepB;
+            w0 = 1.f - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+        } else {
+            v1 = c000 + stepB;
+            v2 = c000 + stepR + stepB;
+            w0 = 1.f - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+        }
+    } else {
+        if (fb > fg) {
+            v1 = c000 + stepB;
+            v2 = c000 + stepG + stepB;
+            w0 = 1.f - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+        } else if (fb > fr) {
+            v1 = c000 + stepG;
+            v2 = c000 + stepG + stepB;
+            w0 = 1.f - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+        } else {
+            v1 = c000 + stepG;
+            v2 = c000 + stepR + stepG;
+            w0 = 1.f - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+        }
+    }
+
+#ifdef __SSE2__
+    __m128 sum = _mm_mul_ps(_mm_set1_ps(w0), _mm_loadu_ps(c000));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w1), _mm_loadu_ps(v1)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w2), _mm_loadu_ps(v2)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w3), _mm_loadu_ps(c111)));
+    float result[4];
+    _mm_storeu_ps(result, sum);
+    out[0] = result[0];
+    out[1] = result[1];
+    out[2] = result[2];
+#else
+    for (int c = 0; c < 3; ++c) {
+        out[c] = w0 * c000[c] + w1 * v1[c] + w2 * v2[c] + w3 * c111[c];
+    }
+#endif
+}
+
+#ifdef __SSE2__
+static inline __m128
+lutSelect(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// pick one of the six tetrahedron values a1..a6 per lane, in the order of the branches of apply
+static inline __m128
+lutTetrahedron(__m128 rg, __m128 gb, __m128 rb, __m128 bg, __m128 br,
+               __m128 a1, __m128 a2, __m128 a3, __m128 a4, __m128 a5, __m128 a6)
+{
+    return lutSelect(rg, lutSelect(gb, a1, lutSelect(rb, a2, a3)),
+                     lutSelect(bg, a4, lutSelect(br, a5, a6)));
+}
+
+// coordinate on four values, the shaper is gathered per lane
+static inline __m128
+lutCoordinates(__m128 v, const float *shaper)
+{
+    // max returns its second operand for NaN, as coordinate does
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    __m128 s = _mm_mul_ps(_mm_sqrt_ps(v), _mm_set1_ps((float)kArenaLutShaperSize));
+    __m128 k = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(s)), _mm_set1_ps((float)(kArenaLutShaperSize - 1)));
+    __m128 t = _mm_sub_ps(s, k);
+    int i[4];
+    _mm_storeu_si128((__m128i*)i, _mm_cvttps_epi32(k));
+    __m128 a = _mm_setr_ps(shaper[i[0]], shaper[i[1]], shaper[i[2]], shaper[i[3]]);
+    __m128 b = _mm_setr_ps(shaper[i[0] + 1], shaper[i[1] + 1], shaper[i[2] + 1], shaper[i[3] + 1]);
+
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+#endif
+
+void
+ArenaLut3D::applyRow(float *rgba, int count) const
+{
+    int x = 0;
+#ifdef __SSE2__
+    const float *shaper = &_shaper[0];
+    const float *table = &_table[0];
+    const float stepR = 4.f;
+    const float stepG = (float)_size * 4.f;
+    const float stepB = (float)_size * _size * 4.f;
+    const __m128 last = _mm_set1_ps((float)(_size - 2));
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 vR = _mm_set1_ps(stepR);
+    const __m128 vG = _mm_set1_ps(stepG);
+    const __m128 vB = _mm_set1_ps(stepB);
+    const __m128 vRG = _mm_set1_ps(stepR + stepG);
+    const __m128 vRB = _mm_set1_ps(stepR + stepB);
+    const __m128 vGB = _mm_set1_ps(stepG + stepB);
+    const int step111 = (int)(stepR + stepG + stepB);
+    for (; x + 4 <= count; x += 4, rgba += 16) {
+        __m128 r = _mm_loadu_ps(rgba);
+        __m128 g = _mm_loadu_ps(rgba + 4);
+        __m128 b = _mm_loadu_ps(rgba + 8);
+        __m128 a = _mm_loadu_ps(rgba + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        // lattice cell and position in it, the offsets are exact in floats up to kArenaLutMaxSize
+        __m128 pr = lutCoordinates(r, shaper);
+        __m128 pg = lutCoordinates(g, shaper);
+        __m128 pb = lutCoordinates(b, shaper);
+        __m128 ir = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(pr)), last);
+        __m128 ig = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(pg)), last);
+        __m128 ib = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(pb)), last);
+        __m128 fr = _mm_sub_ps(pr, ir);
+        __m128 fg = _mm_sub_ps(pg, ig);
+        __m128 fb = _mm_sub_ps(pb, ib);
+        __m128 base = _mm_add_ps(_mm_mul_ps(ir, vR), _mm_add_ps(_mm_mul_ps(ig, vG), _mm_mul_ps(ib, vB)));
+
+        // tetrahedron of each lane: its largest, middle and smallest fraction and the offsets of its two inner corners
+        __m128 rg = _mm_cmpgt_ps(fr, fg);
+        __m128 gb = _mm_cmpgt_ps(fg, fb);
+        __m128 rb = _mm_cmpgt_ps(fr, fb);
+        __m128 bg = _mm_cmpgt_ps(fb, fg);
+        __m128 br = _mm_cmpgt_ps(fb, fr);
+        __m128 fmax = lutTetrahedron(rg, gb, rb, bg, br, fr, fr, fb, fb, fg, fg);
+        __m128 fmid = lutTetrahedron(rg, gb, rb, bg, br, fg, fb, fr, fg, fb, fr);
+        __m128 fmin = lutTetrahedron(rg, gb, rb, bg, br, fb, fg, fg, fr, fr, fb);
+        __m128 off1 = lutTetrahedron(rg, gb, rb, bg, br, vR, vR, vB, vB, vG, vG);
+        __m128 off2 = lutTetrahedron(rg, gb, rb, bg, br, vRG, vRB, vRB, vGB, vGB, vRG);
+        __m128 w0 = _mm_sub_ps(one, fmax);
+        __m128 w1 = _mm_sub_ps(fmax, fmid);
+        __m128 w2 = _mm_sub_ps(fmid, fmin);
+        __m128 w3 = fmin;
+
+        int i0[4], i1[4], i2[4];
+        _mm_storeu_si128((__m128i*)i0, _mm_cvttps_epi32(base));
+        _mm_storeu_si128((__m128i*)i1, _mm_cvttps_epi32(_mm_add_ps(base, off1)));
+        _mm_storeu_si128((__m128i*)i2, _mm_cvttps_epi32(_mm_add_ps(base, off2)));
+
+        // gather the four corners of every lane, transposed to one register per channel
+        __m128 c0r = _mm_loadu_ps(table + i0[0]), c0g = _mm_loadu_ps(table + i0[1]);
+        __m128 c0b = _mm_loadu_ps(table + i0[2]), c0a = _mm_loadu_ps(table + i0[3]);
+        _MM_TRANSPOSE4_PS(c0r, c0g, c0b, c0a);
+        __m128 c1r = _mm_loadu_ps(table + i1[0]), c1g = _mm_loadu_ps(table + i1[1]);
+        __m128 c1b = _mm_loadu_ps(table + i1[2]), c1a = _mm_loadu_ps(table + i1[3]);
+        _MM_TRANSPOSE4_PS(c1r, c1g, c1b, c1a);
+        __m128 c2r = _mm_loadu_ps(table + i2[0]), c2g = _mm_loadu_ps(table + i2[1]);
+        __m128 c2b = _mm_loadu_ps(table + i2[2]), c2a = _mm_loadu_ps(table + i2[3]);
+        _MM_TRANSPOSE4_PS(c2r, c2g, c2b, c2a);
+        __m128 c3r = _mm_loadu_ps(table + i0[0] + step111), c3g = _mm_loadu_ps(table + i0[1] + step111);
+        __m128 c3b = _mm_loadu_ps(table + i0[2] + step111), c3a = _mm_loadu_ps(table + i0[3] + step111);
+        _MM_TRANSPOSE4_PS(c3r, c3g, c3b, c3a);
+
+        r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, c0r), _mm_mul_ps(w1, c1r)), _mm_add_ps(_mm_mul_ps(w2, c2r), _mm_mul_ps(w3, c3r)));
+        g = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, c0g), _mm_mul_ps(w1, c1g)), _mm_add_ps(_mm_mul_ps(w2, c2g), _mm_mul_ps(w3, c3g)));
+        b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, c0b), _mm_mul_ps(w1, c1b)), _mm_add_ps(_mm_mul_ps(w2, c2b), _mm_mul_ps(w3, c3b)));
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(rgba, r);
+        _mm_storeu_ps(rgba + 4, g);
+        _mm_storeu_ps(rgba + 8, b);
+        _mm_storeu_ps(rgba + 12, a);
+    }
+#endif
+    for (; x < count; ++x, rgba += 4) {
+        float out[3];
+        apply(rgba, out);
+        rgba[0] = out[0];
+        rgba[1] = out[1];
+        rgba[2] = out[2];
+    }
+}
+
+// processing
+
+template <class PIX, int nComponents, int maxValue>
+class ArenaLutProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    ArenaLutProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg,
+                      const OfxRectI &window, const ArenaLut3D &lut)
+        : _effect(effect)
+        , _srcData((const char*)srcImg->getPixelData())
+        , _srcBounds(srcImg->getBounds())
+        , _srcRowBytes(srcImg->getRowBytes())
+        , _dstData((char*)dstImg->getPixelData())
+        , _dstBounds(dstImg->getBounds())
+        , _dstRowBytes(dstImg->getRowBytes())
+        , _window(window)
+        , _lut(lut)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        // the part of the window covered by the source, the rest is transparent
+        int xa = std::max(_window.x1, _srcBounds.x1);
+        int xb = std::min(_window.x2, _srcBounds.x2);
+        std::vector<float> row((size_t)std::max(xb - xa, 1) * 4);
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            PIX *dst = (PIX*)(_dstData + (ptrdiff_t)(y - _dstBounds.y1) * _dstRowBytes) + (_window.x1 - _dstBounds.x1) * nComponents;
+            if (y < _srcBounds.y1 || y >= _srcBounds.y2 || xa >= xb) {
+                std::memset(dst, 0, (size_t)(_window.x2 - _window.x1) * nComponents * sizeof(PIX));
+                continue;
+            }
+            const PIX *src = (const PIX*)(_srcData + (ptrdiff_t)(y - _srcBounds.y1) * _srcRowBytes) + (xa - _srcBounds.x1) * nComponents;
+            std::memset(dst, 0, (size_t)(xa - _window.x1) * nComponents * sizeof(PIX));
+            dst += (xa - _window.x1) * nComponents;
+            if (nComponents == 1) {
+                // the lookup leaves alpha alone
+                std::memcpy(dst, src, (size_t)(xb - xa) * sizeof(PIX));
+            } else {
+                lookup(src, dst, xb - xa, &row[0]);
+            }
+            dst += (xb - xa) * nComponents;
+            std::memset(dst, 0, (size_t)(_window.x2 - xb) * nComponents * sizeof(PIX));
+        }
+    }
+
+private:
+    // the row is unpremultiplied into 4 floats per pixel and looked up in one go
+    void lookup(const PIX *src, PIX *dst, int count, float *row) const
+    {
+        float *pixel = row;
+        for (int x = 0; x < count; ++x, pixel += 4) {
+            const PIX *p = src + x * nComponents;
+            float alpha = nComponents == 4 ? (float)p[3] / maxValue : 1.f;
+            float scale = alpha > 0.f ? 1.f / (maxValue * alpha) : 0.f;
+            for (int c = 0; c < 3; ++c) {
+                pixel[c] = (float)p[c] * scale;
+            }
+            pixel[3] = alpha;
+        }
+        _lut.applyRow(row, count);
+        pixel = row;
+        for (int x = 0; x < count; ++x, src += nComponents, dst += nComponents, pixel += 4) {
+            float alpha = pixel[3];
+            if (alpha <= 0.f) {
+                for (int c = 0; c < nComponents; ++c) {
+                    dst[c] = src[c];
+                }
+                continue;
+            }
+            for (int c = 0; c < 3; ++c) {
+                dst[c] = convert(pixel[c] * alpha);
+            }
+            if (nComponents == 4) {
+                dst[3] = src[3];
+            }
+        }
+    }
+
+    static PIX convert(float v)
+    {
+        if (maxValue == 1) {
+            return (PIX)v;
+        }
+        return (PIX)(std::max(0.f, std::min(1.f, v)) * maxValue + 0.5f);
+    }
+
+    OFX::ImageEffect &_effect;
+    const char *_srcData;
+    OfxRectI _srcBounds;
+    int _srcRowBytes;
+    char *_dstData;
+    OfxRectI _dstBounds;
+    int _dstRowBytes;
+    OfxRectI _window;
+    const ArenaLut3D &_lut;
+};
+
+template <class PIX, int nComponents, int maxValue>
+static void
+lutImage(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, const ArenaLut3D &lut)
+{
+    ArenaLutProcessor<PIX, nComponents, maxValue> processor(effect, srcImg, dstImg, window, lut);
+    unsigned int nThreads = std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1));
+    processor.multiThread(std::max(1u, nThreads));
+}
+
+template <class PIX, int maxValue>
+static bool
+lutComponents(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, const ArenaLut3D &lut)
+{
+    switch (dstImg->getPixelComponentCount()) {
+    case 4:
+        lutImage<PIX, 4, maxValue>(effect, srcImg, dstImg, window, lut);
+        return true;
+    case 3:
+        lutImage<PIX, 3, maxValue>(effect, srcImg, dstImg, window, lut);
+        return true;
+    case 1:
+        lutImage<PIX, 1, maxValue>(effect, srcImg, dstImg, window, lut);
+        return true;
+    }
+    return false;
+}
+
+bool
+arenaLutApply(OFX::ImageEffect &effect,
+              const OFX::Image *srcImg,
+              OFX::Image *dstImg,
+              const OfxRectI &window,
+              const ArenaLut3D &lut)
+{
+    if (!srcImg || !dstImg || lut.empty() ||
+        srcImg->getPixelDepth() != dstImg->getPixelDepth() ||
+        srcImg->getPixelComponentCount() != dstImg->getPixelComponentCount() ||
+        window.x1 >= window.x2 || window.y1 >= window.y2) {
+        return false;
+    }
+
+    switch (dstImg->getPixelDepth()) {
+    case OFX::eBitDepthFloat:
+        return lutComponents<float, 1>(effect, srcImg, dstImg, window, lut);
+    case OFX::eBitDepthUShort:
+        return lutComponents<unsigned short, 65535>(effect, srcImg, dstImg, window, lut);
+    case OFX::eBitDepthUByte:
+        return lutComponents<unsigned char, 255>(effect, srcImg, dstImg, window, lut);
+    default:
+        return false;
+    }
+}
+
+// store
+
+struct ArenaLutEntry
+{
+    ArenaLutEntry()
+        : refs(0)
+        , ready(false)
+        , failed(false)
+        , size(0)
+    {
+    }
+
+    std::string key;
+    ArenaLut3D lut;
+    int refs;      // handles, the entry can not be evicted while there are some
+    bool ready;    // the load is done, successful or not
+    bool failed;
+    size_t size;   // memory counted in _lutsUsed
+    OFX::MultiThread::Mutex loading; // held by the thread decoding the file
+};
+
+typedef std::list<ArenaLutEntry*> ArenaLutList;
+
+static ArenaLutList _luts; // most recently used first
+static std::map<std::string, ArenaLutList::iterator> _lutIndex;
+static size_t _lutsUsed = 0;
+
+static OFX::MultiThread::Mutex&
+storeMutex()
+{
+    static OFX::MultiThread::Mutex mutex;
+    return mutex;
+}
+
+// remove entry from the store, call with the store mutex held
+static void
+eraseLut(ArenaLutList::iterator it)
+{
+    ArenaLutEntry *entry = *it;
+    _lutsUsed -= entry->size;
+    _lutIndex.erase(entry->key);
+    _luts.erase(it);
+    delete entry;
+}
+
+// drop unreferenced LUTs until the store fits its budget, call with the store mutex held
+static void
+evictLuts()
+{
+    size_t budget = ArenaLutStore::memoryBudget();
+    ArenaLutList::iterator it = _luts.end();
+    while (_lutsUsed > budget && it != _luts.begin()) {
+        --it;
+        if ( ( (*it)->refs == 0 ) && (*it)->ready ) {
+            eraseLut(it++);
+        }
+    }
+}
+
+static std::string
+canonicalPath(const std::string &path)
+{
+    std::string canonical;
+#ifdef _WIN32
+    char *resolved = _fullpath(NULL, path.c_str(), 0);
+#else
+    char *resolved = realpath(path.c_str(), NULL);
+#endif
+    if (resolved) {
+        canonical = resolved;
+        std::free(resolved);
+    }
+    return canonical;
+}
+
+ArenaLutHandle::ArenaLutHandle()
+    : _entry(NULL)
+{
+}
+
+// adopts a reference already counted in entry
+ArenaLutHandle::ArenaLutHandle(ArenaLutEntry *entry)
+    : _entry(entry)
+{
+}
+
+ArenaLutHandle::ArenaLutHandle(const ArenaLutHandle &other)
+    : _entry(other._entry)
+{
+    if (_entry) {
+        OFX::MultiThread::AutoMutex lock(storeMutex());
+        ++_entry->refs;
+    }
+}
+
+ArenaLutHandle&
+ArenaLutHandle::operator=(const ArenaLutHandle &other)
+{
+    if (_entry != other._entry) {
+        ArenaLutHandle copy(other);
+        std::swap(_entry, copy._entry);
+    }
+    return *this;
+}
+
+ArenaLutHandle::~ArenaLutHandle()
+{
+    if (!_entry) {
+        return;
+    }
+    OFX::MultiThread::AutoMutex lock(storeMutex());
+    if (--_entry->refs == 0) {
+        if (_entry->failed) {
+            // forget failed loads so the next fetch tries again
+            eraseLut(_lutIndex[_entry->key]);
+        } else {
+            evictLuts();
+        }
+    }
+}
+
+const ArenaLut3D*
+ArenaLutHandle::get() const
+{
+    return _entry ? &_entry->lut : NULL;
+}
+
+ArenaLutKey
+ArenaLutStore::resolve(const std::string &path, const std::string &entry)
+{
+    ArenaLutKey key;
+    std::string canonical = canonicalPath(path);
+    struct stat st;
+    if ( canonical.empty() || (stat(canonical.c_str(), &st) != 0) ) {
+        return key;
+    }
+    key.path = canonical;
+    key.mtime = (long long)st.st_mtime;
+    key.size = (long long)st.st_size;
+    key.entry = entry;
+
+    return key;
+}
+
+ArenaLutHandle
+ArenaLutStore::fetch(const ArenaLutKey &lutKey, ArenaLutLoader &loader)
+{
+    if ( lutKey.empty() ) {
+        return ArenaLutHandle();
+    }
+    std::ostringstream key;
+    key << lutKey.path << '\n' << lutKey.mtime << '\n' << lutKey.size << '\n' << lutKey.entry;
+
+    ArenaLutEntry *entry = NULL;
+    {
+        OFX::MultiThread::AutoMutex lock(storeMutex());
+        std::map<std::string, ArenaLutList::iterator>::iterator found = _lutIndex.find(key.str());
+        if (found != _lutIndex.end()) {
+            entry = *found->second;
+            _luts.splice(_luts.begin(), _luts, found->second);
+        } else {
+            entry = new ArenaLutEntry;
+            entry->key = key.str();
+            _luts.push_front(entry);
+            _lutIndex[entry->key] = _luts.begin();
+        }
+        ++entry->refs;
+    }
+    ArenaLutHandle handle(entry);
+
+    // the first thread to get here decodes the file, the others wait for it
+    bool failed;
+    {
+        OFX::MultiThread::AutoMutex loading(entry->loading);
+        bool loaded = entry->ready || ( loader.load(lutKey.path, entry->lut) && !entry->lut.empty() );
+        OFX::MultiThread::AutoMutex lock(storeMutex());
+        if (!entry->ready) {
+            entry->ready = true;
+            entry->failed = !loaded;
+            if (loaded) {
+                entry->size = entry->lut.memorySize();
+                _lutsUsed += entry->size;
+                evictLuts();
+            }
+        }
+        failed = entry->failed;
+    }
+
+    // the handle is released outside the locks, it takes the store lock itself
+    return failed ? ArenaLutHandle() : handle;
+}
+
+size_t
+ArenaLutStore::memoryUsed()
+{
+    OFX::MultiThread::AutoMutex lock(storeMutex());
+    return _lutsUsed;
+}
+
+size_t
+ArenaLutStore::memoryBudget()
+{
+    static size_t budget = 0;
+    if (budget == 0) {
+        const char *env = std::getenv(kArenaLutStoreEnv);
+        int value = env ? std::atoi(env) : 0;
+        budget = (size_t)(value > 0 ? value : kArenaLutStoreDefaultMB) * 1048576;
+    }
+    return budget;
+}
@@ -0,0 +1,171 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef ArenaLut_h
+#define ArenaLut_h
+
+#include "ofxsImageEffect.h"
+#include <string>
+#include <algorithm>
+#include <vector>
+
+// largest lattice kept per axis, bigger Hald images are resampled down to it
+#define kArenaLutMaxSize 64
+
+// Override the memory budget (in MB) of the LUT store
+#define kArenaLutStoreEnv "ARENA_LUT_CACHE_MB"
+#define kArenaLutStoreDefaultMB 256
+
+/* Nodes per axis of the lattice of a Hald CLUT image, as in ImageMagick (HaldClutImage): the cube of the level
+ * is the image width and the lattice has level^2 nodes per axis. 0 if the image is not a Hald CLUT. */
+inline int
+arenaLutHaldSize(int columns, int rows)
+{
+    int level = 2;
+    while (level * level * level < std::min(columns, rows)) {
+        ++level;
+    }
+    int size = level * level;
+    if ( (columns != rows) || ( (size_t)columns * rows < (size_t)size * size * size ) ) {
+        return 0;
+    }
+    return size;
+}
+
+/* Float 3D colour lookup table, as used by HaldCLUT.
+ *
+ * The lattice has size^3 RGB nodes with red varying fastest, the same order as a Hald CLUT image.
+ * Each node is stored as 4 floats so it can be loaded as one SSE2 vector.
+ * The input gamma is part of an input shaper: a table over sqrt(x) that gives the lattice coordinate of x.
+ * Colours are interpolated tetrahedrally, inputs are clamped to [0,1].
+ */
+class ArenaLut3D
+{
+public:
+    ArenaLut3D();
+
+    /* Set the lattice from size^3 RGB float nodes (red fastest), bigger lattices are resampled down to kArenaLutMaxSize.
+     * Input is raised to 1/gamma before the lookup. */
+    bool setLattice(const float *rgb, int size, double gamma);
+
+    /* Decode a Hald CLUT image of columns x rows RGB float pixels (first row first).
+     * Returns false if the image is not a Hald CLUT. */
+    bool setHald(const float *pixels, int columns, int rows, double gamma);
+
+    /* The lattice as a Hald CLUT image of width x width RGB float pixels, without the gamma. */
+    void getHald(std::vector<float> &pixels, int &width) const;
+
+    bool empty() const { return _size == 0; }
+    int size() const { return _size; }
+    double gamma() const { return _gamma; }
+    size_t memorySize() const { return (_table.size() + _shaper.size()) * sizeof(float); }
+
+    // RGB of the unpremultiplied colour rgb
+    void apply(const float rgb[3], float out[3]) const;
+
+    /* apply on count unpremultiplied pixels of 4 floats in place, the fourth float is left alone.
+     * Four pixels at a time with SSE2 when available. */
+    void applyRow(float *rgba, int count) const;
+
+private:
+    float coordinate(float v) const;
+
+    int _size;
+    double _gamma;
+    std::vector<float> _table;  // size^3 nodes of 4 floats
+    std::vector<float> _shaper; // lattice coordinate by sqrt(input)
+};
+
+/* Look up window of dstImg from srcImg through lut, RGBA pixels are unpremultiplied around the lookup.
+ * Float, UShort and UByte images with 1, 3 or 4 components are supported, false is returned for anything else. */
+bool arenaLutApply(OFX::ImageEffect &effect,
+                   const OFX::Image *srcImg,
+                   OFX::Image *dstImg,
+                   const OfxRectI &window,
+                   const ArenaLut3D &lut);
+
+struct ArenaLutEntry;
+
+/* Reference to a LUT of the store, the LUT stays loaded as long as a handle refers to it. */
+class ArenaLutHandle
+{
+public:
+    ArenaLutHandle();
+    ArenaLutHandle(const ArenaLutHandle &other);
+    ArenaLutHandle& operator=(const ArenaLutHandle &other);
+    ~ArenaLutHandle();
+
+    // NULL if the handle is empty
+    const ArenaLut3D* get() const;
+
+private:
+    friend class ArenaLutStore;
+    explicit ArenaLutHandle(ArenaLutEntry *entry);
+
+    ArenaLutEntry *_entry;
+};
+
+/* Decodes the LUT file at path, called by the store with no store lock held. */
+class ArenaLutLoader
+{
+public:
+    virtual ~ArenaLutLoader() {}
+    virtual bool load(const std::string &path, ArenaLut3D &lut) = 0;
+};
+
+/* Where a LUT comes from: the canonical path, modification time and size of its file,
+ * and for files holding several LUTs (preset archives) the entry telling them apart. */
+struct ArenaLutKey
+{
+    ArenaLutKey() : mtime(0), size(0) {}
+
+    // the file did not exist when resolved
+    bool empty() const { return path.empty(); }
+    bool operator==(const ArenaLutKey &other) const
+    {
+        return path == other.path && mtime == other.mtime && size == other.size && entry == other.entry;
+    }
+    bool operator!=(const ArenaLutKey &other) const { return !(*this == other); }
+
+    std::string path;
+    long long mtime;
+    long long size;
+    std::string entry;
+};
+
+/* Process-wide store of decoded LUTs, shared by all instances in the bundle.
+ * LUTs are keyed by canonical file path and modification time, so editing a file gives a new LUT.
+ * Keys are resolved from the file system apart from fetching, plugins resolve them outside of render
+ * (instance creation, param changes, sequence begin) and render only ever fetches.
+ * A file is decoded by one thread only, others asking for it meanwhile wait for the result.
+ * Unreferenced LUTs are evicted least recently used first when the store gets over its budget.
+ */
+class ArenaLutStore
+{
+public:
+    // key of the file at path as it is now on disk, an empty key if there is no such file
+    static ArenaLutKey resolve(const std::string &path, const std::string &entry = std::string());
+
+    /* LUT of key, decoded by loader if not in the store, an empty handle if it could not be loaded.
+     * The file system is only read by the loader, when the LUT has to be decoded. */
+    static ArenaLutHandle fetch(const ArenaLutKey &key, ArenaLutLoader &loader);
+
+    static size_t memoryUsed();
+    static size_t memoryBudget();
+};
+
+#endif // ArenaLut_h
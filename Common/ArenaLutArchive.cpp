@@ -0,0 +1,175 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "ArenaLutArchive.h"
+#include "ArenaLut.h"
+
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ArenaLutArchive::ArenaLutArchive()
+    : _data(NULL)
+    , _size(0)
+    , _mapping(NULL)
+{
+}
+
+ArenaLutArchive::~ArenaLutArchive()
+{
+    close();
+}
+
+bool
+ArenaLutArchive::open(const std::string &path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        return false;
+    }
+    _mapping = mapping;
+    _size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    _size = (size_t)st.st_size;
+#endif
+    _data = (const char*)data;
+    _path = path;
+
+    // check the header and that the index and every entry are inside the file
+    const ArenaLutArchiveHeader *header = (const ArenaLutArchiveHeader*)_data;
+    bool valid = _size >= sizeof(ArenaLutArchiveHeader) &&
+                 std::memcmp(header->magic, kArenaLutArchiveMagic, sizeof(header->magic)) == 0 &&
+                 header->version == kArenaLutArchiveVersion &&
+                 (_size - sizeof(ArenaLutArchiveHeader)) / sizeof(ArenaLutArchiveEntry) >= header->count;
+    if (valid) {
+        const ArenaLutArchiveEntry *entries = (const ArenaLutArchiveEntry*)(_data + sizeof(ArenaLutArchiveHeader));
+        for (unsigned int i = 0; i < header->count && valid; ++i) {
+            unsigned long long bytes = (unsigned long long)entries[i].size * entries[i].size * entries[i].size * 3 * sizeof(unsigned short);
+            valid = entries[i].size >= 2 && entries[i].size <= 256 &&
+                    entries[i].name[kArenaLutArchiveNameSize - 1] == '\0' &&
+                    entries[i].offset <= _size && bytes <= _size - entries[i].offset &&
+                    (i == 0 || std::strcmp(entries[i - 1].name, entries[i].name) < 0);
+        }
+    }
+    if (!valid) {
+        close();
+    }
+
+    return valid;
+}
+
+void
+ArenaLutArchive::close()
+{
+    if (!_data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle((HANDLE)_mapping);
+#else
+    munmap((void*)_data, _size);
+#endif
+    _data = NULL;
+    _size = 0;
+    _mapping = NULL;
+    _path.clear();
+}
+
+const ArenaLutArchiveEntry*
+ArenaLutArchive::find(const std::string &name) const
+{
+    if (!_data) {
+        return NULL;
+    }
+    const ArenaLutArchiveHeader *header = (const ArenaLutArchiveHeader*)_data;
+    const ArenaLutArchiveEntry *entries = (const ArenaLutArchiveEntry*)(_data + sizeof(ArenaLutArchiveHeader));
+    // binary search of the sorted index
+    int lo = 0;
+    int hi = (int)header->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int order = std::strcmp(entries[mid].name, name.c_str());
+        if (order == 0) {
+            return &entries[mid];
+        } else if (order < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+bool
+ArenaLutArchive::load(const std::string &name, ArenaLut3D &lut, double gamma) const
+{
+    const ArenaLutArchiveEntry *entry = find(name);
+    if (!entry) {
+        return false;
+    }
+    size_t count = (size_t)entry->size * entry->size * entry->size * 3;
+    const unsigned short *nodes = (const unsigned short*)(_data + entry->offset);
+    if (arenaLutArchiveChecksum(nodes, count * sizeof(unsigned short)) != entry->checksum) {
+        return false;
+    }
+    std::vector<float> rgb(count);
+    for (size_t i = 0; i < count; ++i) {
+        rgb[i] = nodes[i] * (1.f / 65535.f);
+    }
+    return lut.setLattice(&rgb[0], (int)entry->size, gamma);
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef ArenaLutArchive_h
+#define ArenaLutArchive_h
+
+#include <cstddef>
+#include <string>
+
+class ArenaLut3D;
+
+/* Preset archive: the decoded lattices of a set of LUT files packed into one file, looked up by name.
+ *
+ * Layout (native byte order, written by the HaldPack tool at build time):
+ *   ArenaLutArchiveHeader
+ *   count ArenaLutArchiveEntry, sorted by name
+ *   for each entry size^3 RGB nodes (red fastest) as unsigned short, 65535 is 1
+ * Every entry carries a checksum of its nodes, checked before they are decoded.
+ */
+
+#define kArenaLutArchiveMagic "ARENALUT"
+#define kArenaLutArchiveVersion 1
+#define kArenaLutArchiveNameSize 64
+
+struct ArenaLutArchiveHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int count;
+};
+
+struct ArenaLutArchiveEntry
+{
+    char name[kArenaLutArchiveNameSize]; // file name of the preset, nul terminated
+    unsigned int size;                   // nodes per axis
+    unsigned int reserved;
+    unsigned long long offset;           // of the nodes from the start of the archive
+    unsigned long long checksum;         // FNV-1a of the nodes
+};
+
+inline unsigned long long
+arenaLutArchiveChecksum(const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Read only view of an archive, the file is mapped in memory so lookups do not touch the disk. */
+class ArenaLutArchive
+{
+public:
+    ArenaLutArchive();
+    ~ArenaLutArchive();
+
+    // map the archive at path, false if it is missing or not a valid archive
+    bool open(const std::string &path);
+    void close();
+
+    bool isOpen() const { return _data != NULL; }
+    const std::string& path() const { return _path; }
+    bool contains(const std::string &name) const { return find(name) != NULL; }
+
+    // decode entry name into lut, false if there is none or its checksum does not match
+    bool load(const std::string &name, ArenaLut3D &lut, double gamma) const;
+
+private:
+    ArenaLutArchive(const ArenaLutArchive&);
+    ArenaLutArchive& operator=(const ArenaLutArchive&);
+
+    const ArenaLutArchiveEntry* find(const std::string &name) const;
+
+    const char *_data;
+    size_t _size;
+    std::string _path;
+    void *_mapping; // the file mapping handle on Windows
+};
+
+#endif // ArenaLutArchive_h
@@ -0,0 +1,158 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "ArenaTimer.h"
+#include "ofxsMultiThread.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+static OFX::MultiThread::Mutex&
+traceMutex()
+{
+    static OFX::MultiThread::Mutex mutex;
+    return mutex;
+}
+
+static bool
+timingEnabled()
+{
+    static int timing = -1;
+    if (timing < 0) {
+        const char *env = std::getenv(kArenaTimingEnv);
+        timing = (env && *env && *env != '0') ? 1 : 0;
+    }
+    return timing == 1;
+}
+
+static const char*
+tracePath()
+{
+    static const char *path = NULL;
+    static bool init = false;
+    if (!init) {
+        const char *env = std::getenv(kArenaTraceEnv);
+        path = (env && *env) ? env : NULL;
+        init = true;
+    }
+    return path;
+}
+
+// must be called with the mutex held
+static std::FILE*
+traceFile()
+{
+    static std::FILE *file = NULL;
+    static bool init = false;
+    if (!init) {
+        init = true;
+        if (tracePath()) {
+            file = std::fopen(tracePath(), "w");
+            if (file) {
+                // the trace viewer accepts an unterminated array, so events can be appended until exit
+                std::fputs("[\n", file);
+            } else {
+                std::cout << "Unable to open trace file " << tracePath() << std::endl;
+            }
+        }
+    }
+    return file;
+}
+
+static unsigned long
+processID()
+{
+#ifdef _WIN32
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+static unsigned long
+threadID()
+{
+#ifdef _WIN32
+    return (unsigned long)GetCurrentThreadId();
+#else
+    return (unsigned long)(size_t)pthread_self();
+#endif
+}
+
+bool
+ArenaTimer::enabled()
+{
+    static int enabled = -1;
+    if (enabled < 0) {
+        enabled = (timingEnabled() || tracePath()) ? 1 : 0;
+    }
+    return enabled == 1;
+}
+
+double
+ArenaTimer::now()
+{
+#ifdef _WIN32
+    static double frequency = 0.;
+    LARGE_INTEGER counter;
+    if (frequency == 0.) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        frequency = (double)f.QuadPart / 1e6;
+    }
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency;
+#else
+    // not affected by clock adjustments
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+#endif
+}
+
+void
+ArenaTimer::report()
+{
+    double end = now();
+    double duration = end - _start;
+    double megapixels = _pixels / 1e6;
+    double throughput = duration > 0. ? megapixels / (duration / 1e6) : 0.;
+
+    OFX::MultiThread::AutoMutex lock(traceMutex());
+    if (timingEnabled()) {
+        std::cout << _plugin << " " << _stage << ": " << duration / 1000. << " ms";
+        if (megapixels > 0.) {
+            std::cout << ", " << throughput << " MP/s";
+        }
+        std::cout << std::endl;
+    }
+    std::FILE *file = traceFile();
+    if (file) {
+        std::fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":%lu,\"tid\":%lu,"
+                     "\"args\":{\"megapixels\":%g,\"megapixelsPerSecond\":%g}},\n",
+                     _stage, _plugin, _start, duration, processID(), threadID(), megapixels, throughput);
+        std::fflush(file);
+    }
+}
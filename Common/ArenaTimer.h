@@ -0,0 +1,90 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef ArenaTimer_h
+#define ArenaTimer_h
+
+#include <cstddef>
+
+// Print the duration and throughput of every render stage to stdout
+#define kArenaTimingEnv "ARENA_TIMING"
+
+// Append every render stage as a Chrome trace event (chrome://tracing) to this file
+#define kArenaTraceEnv "ARENA_TRACE"
+
+/* Scoped render stage timer.
+ *
+ * Measures from construction (or the last next()) until the next next() or destruction,
+ * and reports the stage with its megapixel throughput. Timing is off unless one of the
+ * environment variables above is set, a disabled timer only tests a cached flag.
+ *
+ *     ArenaTimer timer(pluginID, "import", width * height);
+ *     ...
+ *     timer.next("effect");
+ */
+class ArenaTimer
+{
+public:
+    // plugin and stage are not copied, they must outlive the timer (identifier literals do)
+    ArenaTimer(const char *plugin, const char *stage, double pixels = 0.)
+        : _plugin(NULL)
+        , _stage(NULL)
+        , _pixels(0.)
+        , _start(0.)
+    {
+        if (enabled()) {
+            _plugin = plugin;
+            _pixels = pixels;
+            _stage = stage;
+            _start = now();
+        }
+    }
+
+    ~ArenaTimer()
+    {
+        if (_stage) {
+            report();
+        }
+    }
+
+    // end the current stage and start another one
+    void next(const char *stage)
+    {
+        if (_stage) {
+            report();
+            _stage = stage;
+            _start = now();
+        }
+    }
+
+    static bool enabled();
+
+private:
+    ArenaTimer(const ArenaTimer&);
+    ArenaTimer& operator=(const ArenaTimer&);
+
+    // microseconds from an arbitrary origin
+    static double now();
+    void report();
+
+    const char *_plugin;
+    const char *_stage;
+    double _pixels;
+    double _start;
+};
+
+#endif // ArenaTimer_h
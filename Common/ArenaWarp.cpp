@@ -0,0 +1,876 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "ArenaWarp.h"
+#include "ofxsMacros.h"
+#include "ofxsMultiThread.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <list>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_SQRT2
+#define M_SQRT2 1.41421356237309504880
+#endif
+
+// maps
+
+static void
+rectCentreAndScale(const OfxRectI &rect, double &cx, double &cy, double &sx, double &sy, double &radius)
+{
+    double width = rect.x2 - rect.x1;
+    double height = rect.y2 - rect.y1;
+    cx = rect.x1 + width / 2.;
+    cy = rect.y1 + height / 2.;
+    sx = sy = 1.;
+    if (width > height && height > 0.) {
+        sy = width / height;
+    } else if (width < height && width > 0.) {
+        sx = height / width;
+    }
+    radius = std::max(width, height) / 2.;
+}
+
+ArenaSwirlMap::ArenaSwirlMap(const OfxRectI &rect, double degrees)
+    : _radians(degrees * M_PI / 180.)
+{
+    rectCentreAndScale(rect, _cx, _cy, _sx, _sy, _radius);
+}
+
+void
+ArenaSwirlMap::map(double x, double y, double &u, double &v) const
+{
+    double dx = _sx * (x - _cx);
+    double dy = _sy * (y - _cy);
+    double distance = dx * dx + dy * dy;
+    if (distance >= _radius * _radius) {
+        u = x;
+        v = y;
+        return;
+    }
+    double factor = 1. - std::sqrt(distance) / _radius;
+    double angle = _radians * factor * factor;
+    double sine = std::sin(angle);
+    double cosine = std::cos(angle);
+    // ImageMagick is top-down, the sine changes sign in the bottom-up OFX frame
+    u = (cosine * dx + sine * dy) / _sx + _cx;
+    v = (cosine * dy - sine * dx) / _sy + _cy;
+}
+
+bool
+ArenaSwirlMap::getBounds(OfxPointD &centre, OfxPointD &radius) const
+{
+    centre.x = _cx;
+    centre.y = _cy;
+    radius.x = _radius / _sx;
+    radius.y = _radius / _sy;
+    return true;
+}
+
+ArenaImplodeMap::ArenaImplodeMap(const OfxRectI &rect, double amount)
+    : _amount(amount)
+{
+    rectCentreAndScale(rect, _cx, _cy, _sx, _sy, _radius);
+}
+
+void
+ArenaImplodeMap::map(double x, double y, double &u, double &v) const
+{
+    double dx = _sx * (x - _cx);
+    double dy = _sy * (y - _cy);
+    double distance = dx * dx + dy * dy;
+    if (distance >= _radius * _radius || distance <= 0.) {
+        u = x;
+        v = y;
+        return;
+    }
+    double factor = std::pow(std::sin(M_PI * std::sqrt(distance) / _radius / 2.), -_amount);
+    u = factor * dx / _sx + _cx;
+    v = factor * dy / _sy + _cy;
+}
+
+bool
+ArenaImplodeMap::getBounds(OfxPointD &centre, OfxPointD &radius) const
+{
+    centre.x = _cx;
+    centre.y = _cy;
+    radius.x = _radius / _sx;
+    radius.y = _radius / _sy;
+    return true;
+}
+
+ArenaWaveMap::ArenaWaveMap(const OfxRectI &rect, double amplitude, double length)
+    : _x1(rect.x1)
+    , _amplitude(amplitude)
+    , _length(length)
+{
+}
+
+void
+ArenaWaveMap::map(double x, double y, double &u, double &v) const
+{
+    double offset = std::fabs(_amplitude);
+    if (_length > 0.) {
+        offset += _amplitude * std::sin(2. * M_PI * (x - 0.5 - _x1) / _length);
+    }
+    u = x;
+    v = y + offset;
+}
+
+ArenaTwirlMap::ArenaTwirlMap(const OfxPointD &centre, double amount, double radius)
+    : _centre(centre)
+    , _amount(amount)
+    , _radius(radius)
+    , _cutoff(0.)
+{
+    // the displacement at distance d is about |amount| d exp(-d^2/r^2), solve for a thousandth of a pixel
+    double k = std::fabs(amount) / 1e-3;
+    if (radius > 0. && k > 0.) {
+        double d = 4. * radius + 1.;
+        for (int i = 0; i < 16; ++i) {
+            d = radius * std::sqrt(std::max(0., std::log(k * d)));
+        }
+        _cutoff = d > 0. ? d + 1. : 0.;
+    }
+}
+
+void
+ArenaTwirlMap::map(double x, double y, double &u, double &v) const
+{
+    double dx = x - _centre.x;
+    double dy = y - _centre.y;
+    double angle = _radius > 0. ? _amount * std::exp(-(dx * dx + dy * dy) / (_radius * _radius)) : 0.;
+    double sine = std::sin(angle);
+    double cosine = std::cos(angle);
+    u = cosine * dx + sine * dy + _centre.x;
+    v = cosine * dy - sine * dx + _centre.y;
+}
+
+bool
+ArenaTwirlMap::getBounds(OfxPointD &centre, OfxPointD &radius) const
+{
+    centre = _centre;
+    radius.x = radius.y = _cutoff;
+    return true;
+}
+
+ArenaBulgeMap::ArenaBulgeMap(const OfxPointD &centre, double size, double strength)
+    : _centre(centre)
+    , _radius(size / 2.)
+    , _strength(strength)
+{
+}
+
+void
+ArenaBulgeMap::map(double x, double y, double &u, double &v) const
+{
+    double dx = x - _centre.x;
+    double dy = y - _centre.y;
+    double distance = std::sqrt(dx * dx + dy * dy);
+    if (distance < _radius && distance > 0.) {
+        double percent = distance / _radius;
+        double k;
+        if (_strength > 0.) {
+            double t = percent * percent;
+            double smooth = t * t * (3. - 2. * t);
+            k = 1. + (smooth - 1.) * _strength * 0.75;
+        } else {
+            double shrink = std::pow(percent, 1. + _strength * 0.75) * _radius / distance;
+            k = 1. + (shrink - 1.) * (1. - percent);
+        }
+        dx *= k;
+        dy *= k;
+    }
+    u = dx + _centre.x;
+    v = dy + _centre.y;
+}
+
+bool
+ArenaBulgeMap::getBounds(OfxPointD &centre, OfxPointD &radius) const
+{
+    centre = _centre;
+    radius.x = radius.y = std::max(0., _radius);
+    return true;
+}
+
+ArenaRippleMap::ArenaRippleMap(const OfxRectI &rect, double amplitude, double length)
+    : _x1(rect.x1)
+    , _y1(rect.y1)
+    , _width(std::max(1, rect.x2 - rect.x1))
+    , _height(std::max(1, rect.y2 - rect.y1))
+    , _amplitude(amplitude)
+    , _length(length)
+{
+}
+
+static void
+rippleWave(double x, double y, double amplitude, double length, double &dx, double &dy)
+{
+    double m = std::sqrt(x * x + y * y);
+    double s = std::sin(length * m);
+    dx += amplitude * y * m * s;
+    dy -= amplitude * x * m * s;
+}
+
+void
+ArenaRippleMap::map(double x, double y, double &u, double &v) const
+{
+    double aspect = _height / _width;
+    double nx = (x - _x1) / _width - 0.5;
+    double ny = (y - _y1) / _height;
+    double dx = 0., dy = 0.;
+    rippleWave(nx, aspect * (ny - 0.5 + 0.35), _amplitude, _length, dx, dy);
+    double ax = 0., ay = 0.;
+    rippleWave(nx, aspect * (ny - 0.5 - 0.35), _amplitude, _length, ax, ay);
+    dx -= ax;
+    dy -= ay;
+    rippleWave(nx, aspect * ny, 2., 5000., dx, dy);
+    u = x + dx;
+    v = y + dy;
+}
+
+bool
+ArenaChainMap::getBounds(OfxPointD &centre, OfxPointD &radius) const
+{
+    OfxPointD c1, r1, c2, r2;
+    if (!_outer.getBounds(c1, r1) || !_inner.getBounds(c2, r2)) {
+        return false;
+    }
+    if (c1.x == c2.x && c1.y == c2.y) {
+        centre = c1;
+        radius.x = std::max(r1.x, r2.x);
+        radius.y = std::max(r1.y, r2.y);
+        return true;
+    }
+    // ellipse around the box holding both
+    double x1 = std::min(c1.x - r1.x, c2.x - r2.x);
+    double x2 = std::max(c1.x + r1.x, c2.x + r2.x);
+    double y1 = std::min(c1.y - r1.y, c2.y - r2.y);
+    double y2 = std::max(c1.y + r1.y, c2.y + r2.y);
+    centre.x = (x1 + x2) / 2.;
+    centre.y = (y1 + y2) / 2.;
+    radius.x = (x2 - x1) / 2. * M_SQRT2;
+    radius.y = (y2 - y1) / 2. * M_SQRT2;
+    return true;
+}
+
+bool
+arenaWarpBounds(const ArenaWarpMap &map, OfxRectI &rect)
+{
+    OfxPointD centre, radius;
+    if (!map.getBounds(centre, radius)) {
+        return false;
+    }
+    if (radius.x <= 0. || radius.y <= 0.) {
+        rect.x1 = rect.x2 = (int)std::floor(centre.x);
+        rect.y1 = rect.y2 = (int)std::floor(centre.y);
+        return true;
+    }
+    rect.x1 = (int)std::floor(centre.x - radius.x - 0.5);
+    rect.x2 = (int)std::ceil(centre.x + radius.x - 0.5) + 1;
+    rect.y1 = (int)std::floor(centre.y - radius.y - 0.5);
+    rect.y2 = (int)std::ceil(centre.y + radius.y - 0.5) + 1;
+    return true;
+}
+
+bool
+arenaWarpEdge(int vpixel, ArenaWarpEdgeEnum &edge)
+{
+    // Virtual Pixel options: 0 Undefined (ImageMagick handles it as Edge), 2 Black, 5 Edge, 9 Mirror, 11 Tile, 12 Transparent
+    switch (vpixel) {
+    case 0:
+    case 5:
+        edge = eArenaWarpEdgeClamp;
+        return true;
+    case 2:
+        edge = eArenaWarpEdgeBlack;
+        return true;
+    case 9:
+        edge = eArenaWarpEdgeMirror;
+        return true;
+    case 11:
+        edge = eArenaWarpEdgeTile;
+        return true;
+    case 12:
+        edge = eArenaWarpEdgeTransparent;
+        return true;
+    }
+    return false;
+}
+
+// tables
+
+class ArenaWarpTableProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    ArenaWarpTableProcessor(ArenaWarpTable &table, const ArenaWarpMap &map)
+        : _table(table)
+        , _map(map)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _table.getHeight();
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, height);
+        for (int y = y1; y < y2; ++y) {
+            float *row = _table.getRow(y);
+            for (int x = 0; x < _table.getWidth(); ++x, row += 2) {
+                double u, v;
+                _map.map(x + 0.5, y + 0.5, u, v);
+                row[0] = (float)u;
+                row[1] = (float)v;
+            }
+        }
+    }
+
+private:
+    ArenaWarpTable &_table;
+    const ArenaWarpMap &_map;
+};
+
+ArenaWarpTable::ArenaWarpTable(int width, int height)
+    : _width(std::max(0, width))
+    , _height(std::max(0, height))
+    , _table((size_t)_width * _height * 2)
+{
+}
+
+void
+ArenaWarpTable::fill(const ArenaWarpMap &map)
+{
+    if (_width == 0 || _height == 0) {
+        return;
+    }
+    ArenaWarpTableProcessor processor(*this, map);
+    unsigned int nThreads = std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)_height);
+    processor.multiThread(std::max(1u, nThreads));
+}
+
+void
+ArenaTableMap::map(double x, double y, double &u, double &v) const
+{
+    int i = (int)std::floor(x) - _origin.x;
+    int j = (int)std::floor(y) - _origin.y;
+    if (i < 0 || i >= _table.getWidth() || j < 0 || j >= _table.getHeight()) {
+        u = v = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    const float *p = _table.getRow(j) + 2 * i;
+    u = p[0] + _origin.x;
+    v = p[1] + _origin.y;
+}
+
+struct ArenaWarpTableEntry
+{
+    unsigned long long key;
+    ArenaWarpTable *table;
+    int users;
+};
+
+typedef std::list<ArenaWarpTableEntry> ArenaWarpTableList;
+
+static ArenaWarpTableList _tables; // most recently used first
+static size_t _tablesUsed = 0;
+
+static OFX::MultiThread::Mutex&
+tableMutex()
+{
+    static OFX::MultiThread::Mutex mutex;
+    return mutex;
+}
+
+// drop unused tables, oldest first, until the cache fits its budget
+static void
+trimTables()
+{
+    ArenaWarpTableList::iterator it = _tables.end();
+    while (_tablesUsed > (size_t)kArenaWarpTableCacheMB * 1048576 && it != _tables.begin()) {
+        --it;
+        if (it->users == 0) {
+            _tablesUsed -= it->table->getMemorySize();
+            delete it->table;
+            it = _tables.erase(it);
+        }
+    }
+}
+
+const ArenaWarpTable*
+ArenaWarpTableCache::acquire(unsigned long long key)
+{
+    OFX::MultiThread::AutoMutex lock(tableMutex());
+    for (ArenaWarpTableList::iterator it = _tables.begin(); it != _tables.end(); ++it) {
+        if (it->key == key) {
+            ++it->users;
+            _tables.splice(_tables.begin(), _tables, it);
+            return _tables.front().table;
+        }
+    }
+    return NULL;
+}
+
+const ArenaWarpTable*
+ArenaWarpTableCache::store(unsigned long long key, ArenaWarpTable *table)
+{
+    OFX::MultiThread::AutoMutex lock(tableMutex());
+    for (ArenaWarpTableList::iterator it = _tables.begin(); it != _tables.end(); ++it) {
+        if (it->key == key) {
+            delete table;
+            ++it->users;
+            return it->table;
+        }
+    }
+    ArenaWarpTableEntry entry;
+    entry.key = key;
+    entry.table = table;
+    entry.users = 1;
+    _tables.push_front(entry);
+    _tablesUsed += table->getMemorySize();
+    trimTables();
+    return table;
+}
+
+void
+ArenaWarpTableCache::release(const ArenaWarpTable *table)
+{
+    OFX::MultiThread::AutoMutex lock(tableMutex());
+    for (ArenaWarpTableList::iterator it = _tables.begin(); it != _tables.end(); ++it) {
+        if (it->table == table) {
+            --it->users;
+            break;
+        }
+    }
+    trimTables();
+}
+
+// sampling
+
+static inline int
+wrapIndex(int i, int n)
+{
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+static inline void
+catmullRom(double t, float w[4])
+{
+    w[0] = (float)(((-0.5 * t + 1.) * t - 0.5) * t);
+    w[1] = (float)((1.5 * t - 2.5) * t * t + 1.);
+    w[2] = (float)(((-1.5 * t + 2.) * t + 0.5) * t);
+    w[3] = (float)((0.5 * t - 0.5) * t * t);
+}
+
+template <class PIX, int nComponents, int maxValue>
+class ArenaWarpProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    ArenaWarpProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg,
+                       const OfxRectI &window, const OfxRectI &rect, const ArenaWarpMap &map,
+                       ArenaWarpFilterEnum filter, ArenaWarpEdgeEnum edge, bool clamp)
+        : _effect(effect)
+        , _srcData((const char*)srcImg->getPixelData())
+        , _srcBounds(srcImg->getBounds())
+        , _srcRowBytes(srcImg->getRowBytes())
+        , _dstData((char*)dstImg->getPixelData())
+        , _dstBounds(dstImg->getBounds())
+        , _dstRowBytes(dstImg->getRowBytes())
+        , _window(window)
+        , _rect(rect)
+        , _map(map)
+        , _filter(filter)
+        , _edge(edge)
+        , _clamp(clamp)
+    {
+        _bounded = map.getBounds(_centre, _radius);
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        float pixel[4];
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            PIX *dst = (PIX*)(_dstData + (ptrdiff_t)(y - _dstBounds.y1) * _dstRowBytes) + (_window.x1 - _dstBounds.x1) * nComponents;
+            // only warp the span of the row crossing the bounds, copy the rest
+            int xa = _window.x1;
+            int xb = _window.x2;
+            if (_bounded) {
+                xa = xb = _window.x2;
+                double dy = _radius.y > 0. ? (y + 0.5 - _centre.y) / _radius.y : 1.;
+                if (dy * dy < 1.) {
+                    double half = _radius.x * std::sqrt(1. - dy * dy);
+                    xa = (int)std::max((double)_window.x1, std::min((double)_window.x2, std::floor(_centre.x - half - 0.5)));
+                    xb = (int)std::max((double)xa, std::min((double)_window.x2, std::ceil(_centre.x + half - 0.5) + 1.));
+                }
+                copy(_window.x1, xa, y, dst);
+                dst += (xa - _window.x1) * nComponents;
+            }
+            for (int x = xa; x < xb; ++x, dst += nComponents) {
+                double u, v;
+                _map.map(x + 0.5, y + 0.5, u, v);
+                if (_filter == eArenaWarpFilterBicubic) {
+                    bicubic(u, v, pixel);
+                } else {
+                    bilinear(u, v, pixel);
+                }
+                put(pixel, dst);
+            }
+            if (_bounded) {
+                copy(xb, _window.x2, y, dst);
+            }
+        }
+    }
+
+private:
+    const PIX* address(int x, int y) const
+    {
+        return (const PIX*)(_srcData + (ptrdiff_t)(y - _srcBounds.y1) * _srcRowBytes) + (x - _srcBounds.x1) * nComponents;
+    }
+
+    // pixels x1..x2 of row y unchanged, straight from the source where it covers them
+    void copy(int x1, int x2, int y, PIX *dst) const
+    {
+        int a = x2;
+        int b = x2;
+        if (y >= _rect.y1 && y < _rect.y2) {
+            a = std::max(x1, std::min(_rect.x1, x2));
+            b = std::max(a, std::min(_rect.x2, x2));
+        }
+        if (_clamp && maxValue == 1) {
+            // clamped copies go through put as well
+            b = a;
+        }
+        float pixel[4];
+        for (int x = x1; x < a; ++x, dst += nComponents) {
+            fetch(x, y, pixel);
+            put(pixel, dst);
+        }
+        if (a < b) {
+            std::memcpy(dst, address(a, y), (size_t)(b - a) * nComponents * sizeof(PIX));
+            dst += (b - a) * nComponents;
+        }
+        for (int x = b; x < x2; ++x, dst += nComponents) {
+            fetch(x, y, pixel);
+            put(pixel, dst);
+        }
+    }
+
+    bool inside(int x1, int y1, int x2, int y2) const
+    {
+        return x1 >= _rect.x1 && x2 < _rect.x2 && y1 >= _rect.y1 && y2 < _rect.y2;
+    }
+
+    // source pixel with the edge mode applied outside of the sampling rect
+    void fetch(int x, int y, float *pixel) const
+    {
+        if (x < _rect.x1 || x >= _rect.x2 || y < _rect.y1 || y >= _rect.y2) {
+            int width = _rect.x2 - _rect.x1;
+            int height = _rect.y2 - _rect.y1;
+            switch (_edge) {
+            case eArenaWarpEdgeClamp:
+                x = std::max(_rect.x1, std::min(x, _rect.x2 - 1));
+                y = std::max(_rect.y1, std::min(y, _rect.y2 - 1));
+                break;
+            case eArenaWarpEdgeTile:
+                x = _rect.x1 + wrapIndex(x - _rect.x1, width);
+                y = _rect.y1 + wrapIndex(y - _rect.y1, height);
+                break;
+            case eArenaWarpEdgeMirror: {
+                int mx = wrapIndex(x - _rect.x1, 2 * width);
+                int my = wrapIndex(y - _rect.y1, 2 * height);
+                x = _rect.x1 + (mx < width ? mx : 2 * width - 1 - mx);
+                y = _rect.y1 + (my < height ? my : 2 * height - 1 - my);
+                break;
+            }
+            case eArenaWarpEdgeBlack:
+                for (int c = 0; c < nComponents; ++c) {
+                    pixel[c] = 0.f;
+                }
+                if (nComponents != 3) {
+                    pixel[nComponents - 1] = (float)maxValue;
+                }
+                return;
+            default:
+                for (int c = 0; c < nComponents; ++c) {
+                    pixel[c] = 0.f;
+                }
+                return;
+            }
+        }
+        const PIX *src = address(x, y);
+        for (int c = 0; c < nComponents; ++c) {
+            pixel[c] = (float)src[c];
+        }
+    }
+
+    void bilinear(double u, double v, float *pixel) const
+    {
+        if (!(std::fabs(u) < 1e8 && std::fabs(v) < 1e8)) {
+            // degenerate maps (NaN, infinity) give transparent pixels
+            for (int c = 0; c < nComponents; ++c) {
+                pixel[c] = 0.f;
+            }
+            return;
+        }
+        double fx = u - 0.5;
+        double fy = v - 0.5;
+        double floorX = std::floor(fx);
+        double floorY = std::floor(fy);
+        if (floorX < _rect.x1 - 2 || floorX >= _rect.x2 + 1 || floorY < _rect.y1 - 2 || floorY >= _rect.y2 + 1) {
+            if (_edge == eArenaWarpEdgeTransparent || _edge == eArenaWarpEdgeBlack) {
+                fetch(_rect.x1 - 1, _rect.y1 - 1, pixel);
+                return;
+            }
+        }
+        int x0 = (int)floorX;
+        int y0 = (int)floorY;
+        float ax = (float)(fx - floorX);
+        float ay = (float)(fy - floorY);
+        float w00 = (1.f - ax) * (1.f - ay);
+        float w10 = ax * (1.f - ay);
+        float w01 = (1.f - ax) * ay;
+        float w11 = ax * ay;
+        if (inside(x0, y0, x0 + 1, y0 + 1)) {
+            const PIX *p00 = address(x0, y0);
+            const PIX *p01 = address(x0, y0 + 1);
+#ifdef __SSE2__
+            if (nComponents == 4 && maxValue == 1) {
+                __m128 acc = _mm_mul_ps(_mm_loadu_ps((const float*)p00), _mm_set1_ps(w00));
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps((const float*)(p00 + 4)), _mm_set1_ps(w10)));
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps((const float*)p01), _mm_set1_ps(w01)));
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps((const float*)(p01 + 4)), _mm_set1_ps(w11)));
+                _mm_storeu_ps(pixel, acc);
+                return;
+            }
+#endif
+            for (int c = 0; c < nComponents; ++c) {
+                pixel[c] = p00[c] * w00 + p00[c + nComponents] * w10 + p01[c] * w01 + p01[c + nComponents] * w11;
+            }
+            return;
+        }
+        float p00[4], p10[4], p01[4], p11[4];
+        fetch(x0, y0, p00);
+        fetch(x0 + 1, y0, p10);
+        fetch(x0, y0 + 1, p01);
+        fetch(x0 + 1, y0 + 1, p11);
+        for (int c = 0; c < nComponents; ++c) {
+            pixel[c] = p00[c] * w00 + p10[c] * w10 + p01[c] * w01 + p11[c] * w11;
+        }
+    }
+
+    void bicubic(double u, double v, float *pixel) const
+    {
+        if (!(std::fabs(u) < 1e8 && std::fabs(v) < 1e8)) {
+            // degenerate maps (NaN, infinity) give transparent pixels
+            for (int c = 0; c < nComponents; ++c) {
+                pixel[c] = 0.f;
+            }
+            return;
+        }
+        double fx = u - 0.5;
+        double fy = v - 0.5;
+        double floorX = std::floor(fx);
+        double floorY = std::floor(fy);
+        if (floorX < _rect.x1 - 3 || floorX >= _rect.x2 + 1 || floorY < _rect.y1 - 3 || floorY >= _rect.y2 + 1) {
+            if (_edge == eArenaWarpEdgeTransparent || _edge == eArenaWarpEdgeBlack) {
+                fetch(_rect.x1 - 1, _rect.y1 - 1, pixel);
+                return;
+            }
+        }
+        int x0 = (int)floorX - 1;
+        int y0 = (int)floorY - 1;
+        float wx[4], wy[4];
+        catmullRom(fx - floorX, wx);
+        catmullRom(fy - floorY, wy);
+        if (inside(x0, y0, x0 + 3, y0 + 3)) {
+#ifdef __SSE2__
+            if (nComponents == 4 && maxValue == 1) {
+                __m128 acc = _mm_setzero_ps();
+                for (int j = 0; j < 4; ++j) {
+                    const float *row = (const float*)address(x0, y0 + j);
+                    __m128 sum = _mm_mul_ps(_mm_loadu_ps(row), _mm_set1_ps(wx[0]));
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + 4), _mm_set1_ps(wx[1])));
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + 8), _mm_set1_ps(wx[2])));
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + 12), _mm_set1_ps(wx[3])));
+                    acc = _mm_add_ps(acc, _mm_mul_ps(sum, _mm_set1_ps(wy[j])));
+                }
+                _mm_storeu_ps(pixel, acc);
+                return;
+            }
+#endif
+            for (int c = 0; c < nComponents; ++c) {
+                pixel[c] = 0.f;
+            }
+            for (int j = 0; j < 4; ++j) {
+                const PIX *row = address(x0, y0 + j);
+                for (int c = 0; c < nComponents; ++c) {
+                    float sum = row[c] * wx[0] + row[c + nComponents] * wx[1] + row[c + 2 * nComponents] * wx[2] + row[c + 3 * nComponents] * wx[3];
+                    pixel[c] += sum * wy[j];
+                }
+            }
+            return;
+        }
+        for (int c = 0; c < nComponents; ++c) {
+            pixel[c] = 0.f;
+        }
+        float tap[4];
+        for (int j = 0; j < 4; ++j) {
+            for (int i = 0; i < 4; ++i) {
+                fetch(x0 + i, y0 + j, tap);
+                float w = wx[i] * wy[j];
+                for (int c = 0; c < nComponents; ++c) {
+                    pixel[c] += tap[c] * w;
+                }
+            }
+        }
+    }
+
+    // store, clamping float samples to [0,1] if asked to
+    void put(float *pixel, PIX *dst) const
+    {
+        if (_clamp && maxValue == 1) {
+            for (int c = 0; c < nComponents; ++c) {
+                pixel[c] = std::max(0.f, std::min(pixel[c], 1.f));
+            }
+        }
+        store(pixel, dst);
+    }
+
+    static void store(const float *pixel, PIX *dst)
+    {
+        for (int c = 0; c < nComponents; ++c) {
+            if (maxValue == 1) {
+                dst[c] = (PIX)pixel[c];
+            } else {
+                float value = std::floor(pixel[c] + 0.5f);
+                dst[c] = (PIX)(value < 0.f ? 0.f : (value > (float)maxValue ? (float)maxValue : value));
+            }
+        }
+    }
+
+    OFX::ImageEffect &_effect;
+    const char *_srcData;
+    OfxRectI _srcBounds;
+    ptrdiff_t _srcRowBytes;
+    char *_dstData;
+    OfxRectI _dstBounds;
+    ptrdiff_t _dstRowBytes;
+    OfxRectI _window;
+    OfxRectI _rect;
+    const ArenaWarpMap &_map;
+    ArenaWarpFilterEnum _filter;
+    ArenaWarpEdgeEnum _edge;
+    bool _clamp;
+    bool _bounded;
+    OfxPointD _centre;
+    OfxPointD _radius;
+};
+
+template <class PIX, int nComponents, int maxValue>
+static void
+warpImage(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window,
+          const OfxRectI &rect, const ArenaWarpMap &map, ArenaWarpFilterEnum filter, ArenaWarpEdgeEnum edge, bool clamp)
+{
+    ArenaWarpProcessor<PIX, nComponents, maxValue> processor(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+    unsigned int nThreads = std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1));
+    processor.multiThread(std::max(1u, nThreads));
+}
+
+template <class PIX, int maxValue>
+static bool
+warpComponents(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window,
+               const OfxRectI &rect, const ArenaWarpMap &map, ArenaWarpFilterEnum filter, ArenaWarpEdgeEnum edge, bool clamp)
+{
+    switch (dstImg->getPixelComponentCount()) {
+    case 4:
+        warpImage<PIX, 4, maxValue>(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+        return true;
+    case 3:
+        warpImage<PIX, 3, maxValue>(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+        return true;
+    case 1:
+        warpImage<PIX, 1, maxValue>(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+        return true;
+    }
+    return false;
+}
+
+bool
+arenaWarp(OFX::ImageEffect &effect,
+          const OFX::Image *srcImg,
+          OFX::Image *dstImg,
+          const OfxRectI &window,
+          const OfxRectI &srcRect,
+          const ArenaWarpMap &map,
+          ArenaWarpFilterEnum filter,
+          ArenaWarpEdgeEnum edge,
+          bool clamp)
+{
+    if (!srcImg || !dstImg ||
+        srcImg->getPixelDepth() != dstImg->getPixelDepth() ||
+        srcImg->getPixelComponentCount() != dstImg->getPixelComponentCount() ||
+        window.x1 >= window.x2 || window.y1 >= window.y2) {
+        return false;
+    }
+
+    // only sample pixels that are both in srcRect and in the fetched image
+    OfxRectI bounds = srcImg->getBounds();
+    OfxRectI rect;
+    rect.x1 = std::max(srcRect.x1, bounds.x1);
+    rect.y1 = std::max(srcRect.y1, bounds.y1);
+    rect.x2 = std::min(srcRect.x2, bounds.x2);
+    rect.y2 = std::min(srcRect.y2, bounds.y2);
+    if (rect.x1 >= rect.x2 || rect.y1 >= rect.y2) {
+        // nothing to sample, every edge mode but black is transparent
+        rect.x1 = rect.x2 = bounds.x1;
+        rect.y1 = rect.y2 = bounds.y1;
+        if (edge != eArenaWarpEdgeBlack) {
+            edge = eArenaWarpEdgeTransparent;
+        }
+    }
+
+    switch (dstImg->getPixelDepth()) {
+    case OFX::eBitDepthFloat:
+        return warpComponents<float, 1>(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+    case OFX::eBitDepthUShort:
+        return warpComponents<unsigned short, 65535>(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+    case OFX::eBitDepthUByte:
+        return warpComponents<unsigned char, 255>(effect, srcImg, dstImg, window, rect, map, filter, edge, clamp);
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,214 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef ArenaWarp_h
+#define ArenaWarp_h
+
+#include "ofxsImageEffect.h"
+#include <vector>
+
+/* Native warp engine shared by the distortion plugins (Swirl, Implode, Wave and the CPU path of Twirl, Bulge and Ripple).
+ *
+ * Every output pixel is inverse mapped to a source position by an ArenaWarpMap and sampled there.
+ * Positions are pixel coordinates at render scale, pixel (i,j) covers [i,i+1[x[j,j+1[ and is mapped from its centre.
+ * Rows are spread over the host threads, RGBA float samples are computed four channels at a time (SSE2 when available).
+ * Maps that only move pixels inside an ellipse report it through getBounds, pixels outside of it are copied.
+ * The OpenCL kernels of Twirl, Bulge and Ripple implement the same maps and filters.
+ */
+
+enum ArenaWarpFilterEnum
+{
+    eArenaWarpFilterBilinear = 0,
+    eArenaWarpFilterBicubic // Catmull-Rom
+};
+
+enum ArenaWarpEdgeEnum
+{
+    eArenaWarpEdgeTransparent = 0,
+    eArenaWarpEdgeClamp,
+    eArenaWarpEdgeBlack,
+    eArenaWarpEdgeTile,
+    eArenaWarpEdgeMirror
+};
+
+class ArenaWarpMap
+{
+public:
+    virtual ~ArenaWarpMap() {}
+    // source position (u,v) for the output position (x,y)
+    virtual void map(double x, double y, double &u, double &v) const = 0;
+    // axis aligned ellipse outside of which the map is the identity, false if it may move any pixel
+    virtual bool getBounds(OfxPointD &/*centre*/, OfxPointD &/*radius*/) const { return false; }
+};
+
+/* Warp window of dstImg from srcImg, sampling inside srcRect (usually the source RoD) with edge outside of it.
+ * Float, UShort and UByte images with 1, 3 or 4 components are supported, false is returned for anything else.
+ * clamp limits float samples to [0,1], as the OpenCL kernels of Twirl and Ripple do. */
+bool arenaWarp(OFX::ImageEffect &effect,
+               const OFX::Image *srcImg,
+               OFX::Image *dstImg,
+               const OfxRectI &window,
+               const OfxRectI &srcRect,
+               const ArenaWarpMap &map,
+               ArenaWarpFilterEnum filter,
+               ArenaWarpEdgeEnum edge,
+               bool clamp = false);
+
+/* Pixels (at render scale) the map may move, false if it is not bounded. */
+bool arenaWarpBounds(const ArenaWarpMap &map, OfxRectI &rect);
+
+/* Edge mode matching an ImageMagick virtual pixel method (the Virtual Pixel choice of the Magick plugins),
+ * false if there is none. */
+bool arenaWarpEdge(int vpixel, ArenaWarpEdgeEnum &edge);
+
+/* Source positions of a width x height grid precomputed from a map that is expensive to evaluate.
+ * The grid starts at (0,0), positions mapped to NaN are transparent. */
+class ArenaWarpTable
+{
+public:
+    ArenaWarpTable(int width, int height);
+    // evaluate map at every pixel centre of the grid, spread over the host threads
+    void fill(const ArenaWarpMap &map);
+    int getWidth() const { return _width; }
+    int getHeight() const { return _height; }
+    size_t getMemorySize() const { return _table.size() * sizeof(float); }
+    const float* getRow(int y) const { return &_table[(size_t)y * _width * 2]; }
+    float* getRow(int y) { return &_table[(size_t)y * _width * 2]; }
+private:
+    int _width, _height;
+    std::vector<float> _table; // u,v pairs
+};
+
+// table lookup, grid pixel (0,0) is canvas pixel origin, pixels outside the grid are transparent
+class ArenaTableMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaTableMap(const ArenaWarpTable &table, const OfxPointI &origin) : _table(table), _origin(origin) {}
+    virtual void map(double x, double y, double &u, double &v) const;
+private:
+    const ArenaWarpTable &_table;
+    OfxPointI _origin;
+};
+
+// Memory budget of the warp table cache
+#define kArenaWarpTableCacheMB 256
+
+/* Process wide LRU of warp tables, shared by all plugins in the bundle so a sequence
+ * only builds its table once. Tables in use are never evicted. */
+class ArenaWarpTableCache
+{
+public:
+    // the table stored under key, in use until released, or NULL
+    static const ArenaWarpTable* acquire(unsigned long long key);
+    // store table under key (the cache takes ownership) and acquire it, a table stored meanwhile by another render wins
+    static const ArenaWarpTable* store(unsigned long long key, ArenaWarpTable *table);
+    static void release(const ArenaWarpTable *table);
+};
+
+// ImageMagick swirl, degrees of rotation at the centre falling off to 0 at the radius of rect
+class ArenaSwirlMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaSwirlMap(const OfxRectI &rect, double degrees);
+    virtual void map(double x, double y, double &u, double &v) const;
+    virtual bool getBounds(OfxPointD &centre, OfxPointD &radius) const;
+private:
+    double _cx, _cy, _sx, _sy, _radius, _radians;
+};
+
+// ImageMagick implode, pulls (amount > 0) or pushes (amount < 0) pixels inside the radius of rect
+class ArenaImplodeMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaImplodeMap(const OfxRectI &rect, double amount);
+    virtual void map(double x, double y, double &u, double &v) const;
+    virtual bool getBounds(OfxPointD &centre, OfxPointD &radius) const;
+private:
+    double _cx, _cy, _sx, _sy, _radius, _amount;
+};
+
+// ImageMagick wave, vertical sine offset of amplitude pixels, shifted down by the amplitude
+class ArenaWaveMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaWaveMap(const OfxRectI &rect, double amplitude, double length);
+    virtual void map(double x, double y, double &u, double &v) const;
+private:
+    double _x1, _amplitude, _length;
+};
+
+// Twirl, rotation of amount radians around centre with a gaussian falloff of radius,
+// bounded where the displacement falls under a thousandth of a pixel
+class ArenaTwirlMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaTwirlMap(const OfxPointD &centre, double amount, double radius);
+    virtual void map(double x, double y, double &u, double &v) const;
+    virtual bool getBounds(OfxPointD &centre, OfxPointD &radius) const;
+private:
+    OfxPointD _centre;
+    double _amount, _radius, _cutoff;
+};
+
+// Bulge, magnify (strength > 0) or shrink (strength < 0) the disc of diameter size around centre
+class ArenaBulgeMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaBulgeMap(const OfxPointD &centre, double size, double strength);
+    virtual void map(double x, double y, double &u, double &v) const;
+    virtual bool getBounds(OfxPointD &centre, OfxPointD &radius) const;
+private:
+    OfxPointD _centre;
+    double _radius, _strength;
+};
+
+// Ripple, two opposed circular waves plus a fixed swirl in normalized rect coordinates
+class ArenaRippleMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaRippleMap(const OfxRectI &rect, double amplitude, double length);
+    virtual void map(double x, double y, double &u, double &v) const;
+private:
+    double _x1, _y1, _width, _height, _amplitude, _length;
+};
+
+// first the output is mapped through outer, the result through inner (outer is applied last to the image)
+class ArenaChainMap
+    : public ArenaWarpMap
+{
+public:
+    ArenaChainMap(const ArenaWarpMap &outer, const ArenaWarpMap &inner) : _outer(outer), _inner(inner) {}
+    virtual void map(double x, double y, double &u, double &v) const
+    {
+        double s, t;
+        _outer.map(x, y, s, t);
+        _inner.map(s, t, u, v);
+    }
+    virtual bool getBounds(OfxPointD &centre, OfxPointD &radius) const;
+private:
+    const ArenaWarpMap &_outer;
+    const ArenaWarpMap &_inner;
+};
+
+#endif // ArenaWarp_h
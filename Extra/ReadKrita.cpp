@@ -194,27 +194,24 @@ ReadKritaPlugin::decode(const std::string& filename,
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
     }
 
-    unsigned char* pixels = new unsigned char[width * height * pixelComponentCount];
-    for (int i = 0; i < width; ++i) {
-        for (int j = 0; j < height; ++j) {
-            for (int k = 0; k < pixelComponentCount; ++k)
-                pixels[(i + j * width) * pixelComponentCount + k] = buffer[(i + (height - 1 - j) * width) * pixelComponentCount + k];
-        }
-    }
-
-    int offset = 0;
+    // flip and convert one row at a time, stop as soon as the host aborts the render
     for (int y = 0; y < height; y++) {
+        if (abort()) {
+            break;
+        }
+        const unsigned char *src = buffer + (size_t)(height - 1 - y) * width * pixelComponentCount;
+        float *dst = pixelData + (size_t)y * width * pixelComponentCount;
         for (int x = 0; x < width; x++) {
-            pixelData[offset + 0] = pixels[offset + 0] * (1.f / 255);
-            pixelData[offset + 1] = pixels[offset + 1] * (1.f / 255);
-            pixelData[offset + 2] = pixels[offset + 2] * (1.f / 255);
-            pixelData[offset + 3] = pixels[offset + 3] * (1.f / 255);
-            offset += pixelComponentCount;
+            dst[0] = src[0] * (1.f / 255);
+            dst[1] = src[1] * (1.f / 255);
+            dst[2] = src[2] * (1.f / 255);
+            dst[3] = src[3] * (1.f / 255);
+            src += pixelComponentCount;
+            dst += pixelComponentCount;
         }
     }
 
     buffer = NULL;
-    delete[] pixels;
 }
 
 bool ReadKritaPlugin::getFrameBounds(const std::string& filename,
@@ -284,22 +284,20 @@ ReadSVGPlugin::decodePlane(const std::string& filename, OfxTime time, int /*view
     cairo_surface_flush(surface);
 
     unsigned char* cdata = cairo_image_surface_get_data(surface);
-    unsigned char* pixels = new unsigned char[width * height * pixelComponentCount];
-    for (int i = 0; i < width; ++i) {
-        for (int j = 0; j < height; ++j) {
-            for (int k = 0; k < pixelComponentCount; ++k)
-                pixels[(i + j * width) * pixelComponentCount + k] = cdata[(i + (height - 1 - j) * width) * pixelComponentCount + k];
-        }
-    }
-
-    int offset = 0;
+    // flip and convert one row at a time, stop as soon as the host aborts the render
     for (int y = 0; y < height; y++) {
+        if (abort()) {
+            break;
+        }
+        const unsigned char *src = cdata + (size_t)(height - 1 - y) * width * pixelComponentCount;
+        float *dst = pixelData + (size_t)y * width * pixelComponentCount;
         for (int x = 0; x < width; x++) {
-            pixelData[offset + 0] = pixels[offset + 2] * (1.f / 255);
-            pixelData[offset + 1] = pixels[offset + 1] * (1.f / 255);
-            pixelData[offset + 2] = pixels[offset + 0] * (1.f / 255);
-            pixelData[offset + 3] = pixels[offset + 3] * (1.f / 255);
-            offset += pixelComponentCount;
+            dst[0] = src[2] * (1.f / 255);
+            dst[1] = src[1] * (1.f / 255);
+            dst[2] = src[0] * (1.f / 255);
+            dst[3] = src[3] * (1.f / 255);
+            src += pixelComponentCount;
+            dst += pixelComponentCount;
         }
     }
 
@@ -308,7 +306,6 @@ ReadSVGPlugin::decodePlane(const std::string& filename, OfxTime time, int /*view
     cairo_surface_destroy(surface);
     cdata = NULL;
     error = NULL;
-    delete[] pixels;
 }
 
 bool ReadSVGPlugin::getFrameBounds(const std::string& filename,
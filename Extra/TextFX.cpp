@@ -1077,6 +1077,9 @@ void TextFXPlugin::render(const OFX::RenderArguments &args)
         }
         cairo_translate(cr, circleX, circleY);
         for (int i = 0; i < circleWords; i++) {
+            if (abort()) {
+                break;
+            }
             int rwidth, rheight;
             double angle = (360. * i) / circleWords;
             cairo_save(cr);
@@ -1101,23 +1104,21 @@ void TextFXPlugin::render(const OFX::RenderArguments &args)
     cairo_surface_flush(surface);
 
     unsigned char* cdata = cairo_image_surface_get_data(surface);
-    unsigned char* pixels = new unsigned char[width * height * 4];
-    for (int i = 0; i < width; ++i) {
-        for (int j = 0; j < height; ++j) {
-            for (int k = 0; k < 4; ++k)
-                pixels[(i + j * width) * 4 + k] = cdata[(i + (height - 1 - j) * width) * 4 + k];
-        }
-    }
-
+    // flip and convert one row at a time, stop as soon as the host aborts the render
     float* pixelData = (float*)dstImg->getPixelData();
-    int offset = 0;
     for (int y = 0; y < height; y++) {
+        if (abort()) {
+            break;
+        }
+        const unsigned char *src = cdata + (size_t)(height - 1 - y) * width * 4;
+        float *dst = pixelData + (size_t)y * width * 4;
         for (int x = 0; x < width; x++) {
-            pixelData[offset + 0] = pixels[offset + 2] * (1.f / 255);
-            pixelData[offset + 1] = pixels[offset + 1] * (1.f / 255);
-            pixelData[offset + 2] = pixels[offset + 0] * (1.f / 255);
-            pixelData[offset + 3] = pixels[offset + 3] * (1.f / 255);
-            offset += 4;
+            dst[0] = src[2] * (1.f / 255);
+            dst[1] = src[1] * (1.f / 255);
+            dst[2] = src[0] * (1.f / 255);
+            dst[3] = src[3] * (1.f / 255);
+            src += 4;
+            dst += 4;
         }
     }
 
@@ -1128,7 +1129,6 @@ void TextFXPlugin::render(const OFX::RenderArguments &args)
     cairo_surface_destroy(surface);
     cdata = NULL;
     pixelData = NULL;
-    delete[] pixels;
 }
 
 void TextFXPlugin::changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName)
@@ -19,9 +19,13 @@
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
 #include <Magick++.h>
+#include "MagickThreads.h"
+#include "MagickCache.h"
+#include "ArenaWarp.h"
 #include <iostream>
 #include <stdint.h>
 #include <cmath>
+#include <limits>
 
 #define kPluginName "ArcOFX"
 #define kPluginGrouping "Extra/Distort"
@@ -75,8 +79,109 @@
 #define kParamFlipHint "Flip image"
 #define kParamFlipDefault false
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 using namespace OFX;
 
+/* The ImageMagick Arc distortion (always best fit) with the flips, scale to fit and centred extent
+ * of this plugin, as one map in pixels relative to the source RoD.
+ * radii is false when ImageMagick gets the two argument form (no top/bottom radius). */
+class ArcMap
+    : public ArenaWarpMap
+{
+public:
+    ArcMap(int width, int height, double angle, double rotate, bool radii, double top, double bottom, bool flip)
+        : _width(width)
+        , _height(height)
+        , _flip(flip)
+    {
+        _c0 = -M_PI / 2. + rotate * M_PI / 180.;
+        _c0 /= 2. * M_PI;
+        _c0 -= std::floor(_c0 + 0.5);
+        _c0 *= 2. * M_PI;
+        _c1 = angle * M_PI / 180.;
+        _c3 = height - 1.;
+        _c2 = width / _c1 + _c3 / 2.;
+        if (radii) {
+            _c3 = top - bottom;
+            _c2 = top;
+        }
+        _c4 = (width - 1.) / 2.;
+
+        // bounds of the corners and of the orthogonal points along the top of the arc
+        double minX, minY, maxX, maxY;
+        double a = _c0 - _c1 / 2.;
+        minX = maxX = _c2 * std::cos(a);
+        minY = maxY = _c2 * std::sin(a);
+        expand((_c2 - _c3) * std::cos(a), (_c2 - _c3) * std::sin(a), minX, minY, maxX, maxY);
+        a = _c0 + _c1 / 2.;
+        expand(_c2 * std::cos(a), _c2 * std::sin(a), minX, minY, maxX, maxY);
+        expand((_c2 - _c3) * std::cos(a), (_c2 - _c3) * std::sin(a), minX, minY, maxX, maxY);
+        for (a = std::ceil((_c0 - _c1 / 2.) / (M_PI / 2.)) * (M_PI / 2.); a < _c0 + _c1 / 2.; a += M_PI / 2.) {
+            expand(_c2 * std::cos(a), _c2 * std::sin(a), minX, minY, maxX, maxY);
+        }
+        _c1 = 2. * M_PI * width / _c1;
+        _c3 = height / _c3;
+
+        _gx = std::floor(minX - 0.5);
+        _gy = std::floor(minY - 0.5);
+        _w0 = (int)std::ceil(maxX - _gx + 0.5);
+        _h0 = (int)std::ceil(maxY - _gy + 0.5);
+        _w1 = _w0;
+        _h1 = _h0;
+        if (_w1 > width) {
+            _h1 = (int)std::floor((double)_h1 * width / _w1 + 0.5);
+            _w1 = width;
+        }
+        if (_h1 > height) {
+            _w1 = (int)std::floor((double)_w1 * height / _h1 + 0.5);
+            _h1 = height;
+        }
+        _ex = _w1 / 2 - width / 2;
+        _ey = _h1 / 2 - height / 2;
+    }
+
+    virtual void map(double x, double y, double &u, double &v) const
+    {
+        // ImageMagick is top-down
+        double px = x + _ex;
+        double py = _height - y + _ey;
+        if (px < 0. || px >= _w1 || py < 0. || py >= _h1) {
+            u = v = std::numeric_limits<double>::quiet_NaN();
+            return;
+        }
+        double qx = px * _w0 / _w1;
+        double qy = py * _h0 / _h1;
+        if (_flip) {
+            qy = _h0 - qy;
+        }
+        double dx = _gx + qx;
+        double dy = _gy + qy;
+        double sx = (std::atan2(dy, dx) - _c0) / (2. * M_PI);
+        sx -= std::floor(sx + 0.5);
+        sx = sx * _c1 + _c4 + 0.5;
+        double sy = (_c2 - std::sqrt(dx * dx + dy * dy)) * _c3;
+        u = sx;
+        v = _flip ? sy : _height - sy;
+    }
+
+private:
+    static void expand(double x, double y, double &minX, double &minY, double &maxX, double &maxY)
+    {
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+
+    int _width, _height;
+    bool _flip;
+    double _c0, _c1, _c2, _c3, _c4, _gx, _gy;
+    int _w0, _h0, _w1, _h1, _ex, _ey;
+};
+
 static bool _hasOpenMP = false;
 
 class ArcPlugin : public OFX::ImageEffect
@@ -216,14 +321,40 @@ void ArcPlugin::render(const OFX::RenderArguments &args)
     int width = srcRod.x2-srcRod.x1;
     int height = srcRod.y2-srcRod.y1;
 
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
+    // native, the map only depends on the frame size and params so a sequence reuses it
+    ArenaWarpEdgeEnum edge;
+    if (!matte && srcClip_ && srcClip_->isConnected() && arenaWarpEdge(vpixel, edge) && arcAngle >= 1e-6) {
+        bool radii = arcTopRadius != 0 && arcBottomRadius != 0;
+        double top = std::floor(arcTopRadius * args.renderScale.x + 0.5);
+        double bottom = std::floor(arcBottomRadius * args.renderScale.x + 0.5);
+        MagickCacheKey key;
+        key.add(kPluginIdentifier);
+        key.add(width);
+        key.add(height);
+        key.add(arcAngle);
+        key.add(arcRotate);
+        key.add(radii);
+        key.add(top);
+        key.add(bottom);
+        key.add(flip);
+        const ArenaWarpTable *table = ArenaWarpTableCache::acquire(key.value());
+        if (!table) {
+            ArenaWarpTable *newTable = new ArenaWarpTable(width, height);
+            newTable->fill(ArcMap(width, height, arcAngle, arcRotate, radii, top, bottom, flip));
+            table = ArenaWarpTableCache::store(key.value(), newTable);
+        }
+        OfxPointI origin;
+        origin.x = srcRod.x1;
+        origin.y = srcRod.y1;
+        bool done = arenaWarp(*this, srcImg.get(), dstImg.get(), args.renderWindow, srcRod, ArenaTableMap(*table, origin), eArenaWarpFilterBilinear, edge);
+        ArenaWarpTableCache::release(table);
+        if (done) {
+            return;
+        }
+    }
 
-    Magick::ResourceLimits::thread(threads);
-#endif
+    // OpenMP
+    MagickThreadBudget threads(_hasOpenMP && enableOpenMP);
 
     // read image
     Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
@@ -18,16 +18,20 @@
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
-#include <Magick++.h>
-#include <iostream>
-#include <stdint.h>
+#include "MagickCache.h"
+#include "ArenaTimer.h"
+#include "ArenaEdge.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
 
 #define kPluginName "CharcoalOFX"
 #define kPluginGrouping "Extra/Filter"
 #define kPluginIdentifier "net.fxarena.openfx.Charcoal"
-#define kPluginVersionMajor 2
-#define kPluginVersionMinor 2
+#define kPluginVersionMajor 3
+#define kPluginVersionMinor 0
 
 #define kParamRadius "radius"
 #define kParamRadiusLabel "Radius"
@@ -39,19 +43,181 @@
 #define kParamSigmaHint "Adjust sigma"
 #define kParamSigmaDefault 0
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault false
-
 using namespace OFX;
-static bool _hasOpenMP = false;
+
+/* The charcoal of ImageMagick (CharcoalImage) is a chain of whole image passes:
+ * grayscale, edge, blur, normalize and negate.
+ * Here the gray, edge and blur stages run fused on strips of rows (CharcoalEdgeProcessor),
+ * then the blurred edges are normalized, negated and written out (CharcoalShadeProcessor).
+ * Normalizing needs the levels of the whole frame, so the source is always fetched whole
+ * and the levels of a frame rendered in tiles are computed once and shared by its tiles.
+ */
+
+// threads for the rows of window
+static unsigned int
+charcoalThreads(const OfxRectI &window)
+{
+    return std::max(1u, std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1)));
+}
+
+template <class PIX, int nComponents, int maxValue>
+class CharcoalEdgeProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    /* values (may be NULL) gets the blurred edges of window row by row,
+     * histograms (kArenaLevelBins per thread, cleared) gets their levels. */
+    CharcoalEdgeProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, const OfxRectI &window,
+                          int edgeSize, const std::vector<float> &blur, float *values, unsigned int *histograms)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _window(window)
+        , _edgeSize(edgeSize)
+        , _blur(blur)
+        , _values(values)
+        , _histograms(histograms)
+    {
+    }
+
+    // each thread streams a strip of rows, starting from the rows above it the kernels reach
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        if (y1 >= y2) {
+            return;
+        }
+        int width = _window.x2 - _window.x1;
+        int blurSize = (int)_blur.size();
+        int margin = _edgeSize / 2 + blurSize / 2;
+        ArenaEdgeFilter edge(_edgeSize, width + blurSize - 1);
+        ArenaRowWindow blurred(blurSize, width);
+        std::vector<float> edgeRow(width + blurSize - 1);
+        std::vector<float> line(width);
+        unsigned int *histogram = _histograms + (size_t)threadId * kArenaLevelBins;
+
+        // once the kernels are full, the row pushed gives the row margin rows above it
+        for (int row = y1 - margin; row < y2 + margin; ++row) {
+            if (_effect.abort()) {
+                return;
+            }
+            grayRow(row, _window.x1 - margin, width + 2 * margin, edge.input());
+            if (!edge.push()) {
+                continue;
+            }
+            edge.apply(&edgeRow[0]);
+            arenaConvolveRow(&edgeRow[0], width, _blur, blurred.push());
+            if (blurred.count() < blurSize) {
+                continue;
+            }
+            float *dst = _values ? _values + (size_t)(row - margin - _window.y1) * width : &line[0];
+            arenaConvolveRows(blurred, width, _blur, dst);
+            arenaAddLevels(dst, width, histogram);
+        }
+    }
+
+private:
+    // Rec709 luma of columns from x1 of row, pixels outside the source repeat its edges
+    void grayRow(int row, int x1, int columns, float *dst)
+    {
+        OfxRectI bounds = _srcImg->getBounds();
+        if (bounds.x1 >= bounds.x2 || bounds.y1 >= bounds.y2) {
+            std::fill(dst, dst + columns, 0.f);
+            return;
+        }
+        row = std::max(bounds.y1, std::min(row, bounds.y2 - 1));
+        const PIX *src = (const PIX*)_srcImg->getPixelAddress(bounds.x1, row);
+        for (int c = 0; c < columns; ++c) {
+            int x = std::max(bounds.x1, std::min(x1 + c, bounds.x2 - 1));
+            const PIX *pix = src + (size_t)(x - bounds.x1) * nComponents;
+            dst[c] = (0.2126f * pix[0] + 0.7152f * pix[1] + 0.0722f * pix[2]) / maxValue;
+        }
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OfxRectI _window;
+    int _edgeSize;
+    const std::vector<float> &_blur;
+    float *_values;
+    unsigned int *_histograms;
+};
+
+template <class PIX, int nComponents, int maxValue>
+class CharcoalShadeProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    CharcoalShadeProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window,
+                           const float *values, float black, float white)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _values(values)
+        , _black(black)
+        , _white(white)
+    {
+    }
+
+    // negated normalized edges in gray, with the alpha of the source
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        int width = _window.x2 - _window.x1;
+        OfxRectI bounds = _srcImg->getBounds();
+        // arenaNormalize with the division taken out, equal levels send everything above them to white
+        float scale = _white > _black ? 1.f / (_white - _black) : 1e30f;
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            const float *values = _values + (size_t)(y - _window.y1) * width;
+            PIX *dst = (PIX*)_dstImg->getPixelAddress(_window.x1, y);
+            const PIX *src = (const PIX*)_srcImg->getPixelAddress(_window.x1, y);
+            bool inside = src && bounds.x2 >= _window.x2;
+            for (int x = 0; x < width; ++x, dst += nComponents) {
+                float gray = 1.f - std::max(0.f, std::min((values[x] - _black) * scale, 1.f));
+                if (nComponents == 4) {
+                    const PIX *pix = inside ? src + (size_t)x * nComponents : (const PIX*)_srcImg->getPixelAddress(_window.x1 + x, y);
+                    PIX alpha = pix ? pix[3] : PIX(0);
+                    dst[0] = dst[1] = dst[2] = convert(gray * ((float)alpha / maxValue));
+                    dst[3] = alpha;
+                } else {
+                    dst[0] = dst[1] = dst[2] = convert(gray);
+                }
+            }
+        }
+    }
+
+private:
+    static PIX convert(float v)
+    {
+        if (maxValue == 1) {
+            return PIX(v);
+        }
+        return PIX(std::max(0.f, std::min(v, 1.f)) * maxValue + 0.5f);
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    const float *_values;
+    float _black;
+    float _white;
+};
 
 class CharcoalPlugin : public OFX::ImageEffect
 {
@@ -60,36 +226,119 @@ public:
     virtual ~CharcoalPlugin();
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) OVERRIDE FINAL;
 private:
+    template <class PIX, int nComponents, int maxValue>
+    void charcoalImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, double radius, double sigma,
+                       unsigned long long levelsKey, ArenaTimer &timer);
+
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
     OFX::DoubleParam *radius_;
     OFX::DoubleParam *sigma_;
-    OFX::BooleanParam *enableOpenMP_;
+
+    // levels of the last frame rendered in tiles
+    OFX::MultiThread::Mutex levelsMutex_;
+    unsigned long long levelsKey_;
+    float black_;
+    float white_;
 };
 
 CharcoalPlugin::CharcoalPlugin(OfxImageEffectHandle handle)
 : OFX::ImageEffect(handle)
 , dstClip_(NULL)
 , srcClip_(NULL)
+, radius_(NULL)
+, sigma_(NULL)
+, levelsKey_(0)
+, black_(0.f)
+, white_(1.f)
 {
-    Magick::InitializeMagick(NULL);
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB));
     srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(srcClip_ && srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(srcClip_ && (srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentRGB));
 
     radius_ = fetchDoubleParam(kParamRadius);
     sigma_ = fetchDoubleParam(kParamSigma);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
 
-    assert(radius_ && sigma_ && enableOpenMP_);
+    assert(radius_ && sigma_);
 }
 
 CharcoalPlugin::~CharcoalPlugin()
 {
 }
 
+template <class PIX, int nComponents, int maxValue>
+void CharcoalPlugin::charcoalImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, double radius, double sigma,
+                                   unsigned long long levelsKey, ArenaTimer &timer)
+{
+    int edgeSize = arenaKernelWidth(radius, 0.5);
+    std::vector<float> blur;
+    arenaGaussianKernel(arenaKernelWidth(radius, sigma), sigma, true, blur);
+
+    // gray, edge and blur
+    timer.next("edge");
+    unsigned int nThreads = charcoalThreads(window);
+    std::vector<float> values((size_t)(window.x2 - window.x1) * (window.y2 - window.y1));
+    std::vector<unsigned int> histograms((size_t)nThreads * kArenaLevelBins, 0);
+    {
+        CharcoalEdgeProcessor<PIX, nComponents, maxValue> processor(*this, srcImg, window, edgeSize, blur, &values[0], &histograms[0]);
+        processor.multiThread(nThreads);
+    }
+    if (abort()) {
+        return;
+    }
+
+    // levels of the whole frame, a tile reuses those of the other tiles of its frame
+    timer.next("levels");
+    OfxRectI frame = srcImg->getRegionOfDefinition();
+    OfxRectI bounds = srcImg->getBounds();
+    frame.x1 = std::max(frame.x1, bounds.x1);
+    frame.y1 = std::max(frame.y1, bounds.y1);
+    frame.x2 = std::min(frame.x2, bounds.x2);
+    frame.y2 = std::min(frame.y2, bounds.y2);
+    bool whole = window.x1 <= frame.x1 && window.y1 <= frame.y1 && window.x2 >= frame.x2 && window.y2 >= frame.y2;
+    float black, white;
+    {
+        OFX::MultiThread::AutoMutex lock(levelsMutex_);
+        if (!whole && levelsKey_ == levelsKey) {
+            black = black_;
+            white = white_;
+        } else {
+            if (!whole && frame.x1 < frame.x2 && frame.y1 < frame.y2) {
+                // stream the whole frame for its levels only
+                nThreads = charcoalThreads(frame);
+                histograms.assign((size_t)nThreads * kArenaLevelBins, 0);
+                CharcoalEdgeProcessor<PIX, nComponents, maxValue> processor(*this, srcImg, frame, edgeSize, blur, NULL, &histograms[0]);
+                processor.multiThread(nThreads);
+                if (abort()) {
+                    return;
+                }
+            }
+            for (unsigned int t = 1; t < nThreads; ++t) {
+                for (int i = 0; i < kArenaLevelBins; ++i) {
+                    histograms[i] += histograms[(size_t)t * kArenaLevelBins + i];
+                }
+            }
+            arenaNormalizeLevels(&histograms[0], black, white);
+            levelsKey_ = levelsKey;
+            black_ = black;
+            white_ = white;
+        }
+    }
+#ifdef DEBUG
+    std::cout << kPluginIdentifier << " levels " << black << " " << white << std::endl;
+#endif
+
+    // normalize and negate
+    timer.next("shade");
+    CharcoalShadeProcessor<PIX, nComponents, maxValue> processor(*this, srcImg, dstImg, window, &values[0], black, white);
+    processor.multiThread(charcoalThreads(window));
+}
+
 void CharcoalPlugin::render(const OFX::RenderArguments &args)
 {
     // render scale
@@ -98,6 +347,8 @@ void CharcoalPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!srcClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -105,10 +356,7 @@ void CharcoalPlugin::render(const OFX::RenderArguments &args)
     }
     assert(srcClip_);
     OFX::auto_ptr<const OFX::Image> srcImg(srcClip_->fetchImage(args.time));
-    OfxRectI srcRod,srcBounds;
     if (srcImg.get()) {
-        srcRod = srcImg->getRegionOfDefinition();
-        srcBounds = srcImg->getBounds();
         if (srcImg->getRenderScale().x != args.renderScale.x ||
             srcImg->getRenderScale().y != args.renderScale.y ||
             srcImg->getField() != args.fieldToRender) {
@@ -118,6 +366,7 @@ void CharcoalPlugin::render(const OFX::RenderArguments &args)
         }
     } else {
         OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
     }
 
     // get dest clip
@@ -139,16 +388,10 @@ void CharcoalPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get bit depth
+    // get bit depth and pixel component
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
-        OFX::throwSuiteStatusException(kOfxStatErrFormat);
-        return;
-    }
-
-    // get pixel component
-    OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA) {
+    OFX::PixelComponentEnum dstComponents = dstImg->getPixelComponents();
+    if (dstBitDepth != srcImg->getPixelDepth() || dstComponents != srcImg->getPixelComponents()) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -161,45 +404,58 @@ void CharcoalPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get params
+    // get params, in pixels at render scale
     double radius, sigma;
-    bool enableOpenMP = false;
     radius_->getValueAtTime(args.time, radius);
     sigma_->getValueAtTime(args.time, sigma);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
-
-    // setup
-    int width = srcRod.x2-srcRod.x1;
-    int height = srcRod.y2-srcRod.y1;
-
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
-
-    // read image
-    Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,1)"));
-    if (srcClip_ && srcClip_->isConnected())
-        image.read(width,height,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
+    radius *= args.renderScale.x;
+    sigma *= args.renderScale.x;
+
+    // cached result, the normalization depends on the whole source
+    timer.next("cache");
+    MagickCacheKey frameKey;
+    frameKey.add(kPluginIdentifier);
+    frameKey.add(radius);
+    frameKey.add(sigma);
+    frameKey.addPixels(srcImg.get(), srcImg->getBounds());
+    MagickCacheKey key = frameKey;
+    key.add(args.renderWindow);
+    if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get()))
+        return;
 
     // charcoal
-    image.charcoal(radius,sigma);
-
-    // return image
-    if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(image,0,0,Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(image, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+    int nComponents = dstImg->getPixelComponentCount();
+    switch (dstBitDepth) {
+    case OFX::eBitDepthUByte:
+        if (nComponents == 4) {
+            charcoalImage<unsigned char, 4, 255>(srcImg.get(), dstImg.get(), args.renderWindow, radius, sigma, frameKey.value(), timer);
+        } else {
+            charcoalImage<unsigned char, 3, 255>(srcImg.get(), dstImg.get(), args.renderWindow, radius, sigma, frameKey.value(), timer);
+        }
+        break;
+    case OFX::eBitDepthUShort:
+        if (nComponents == 4) {
+            charcoalImage<unsigned short, 4, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, radius, sigma, frameKey.value(), timer);
+        } else {
+            charcoalImage<unsigned short, 3, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, radius, sigma, frameKey.value(), timer);
+        }
+        break;
+    case OFX::eBitDepthFloat:
+        if (nComponents == 4) {
+            charcoalImage<float, 4, 1>(srcImg.get(), dstImg.get(), args.renderWindow, radius, sigma, frameKey.value(), timer);
+        } else {
+            charcoalImage<float, 3, 1>(srcImg.get(), dstImg.get(), args.renderWindow, radius, sigma, frameKey.value(), timer);
+        }
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        return;
     }
+
+    if (abort())
+        return;
+
+    MagickResultCache::store(key, args.renderWindow, dstImg.get());
 }
 
 bool CharcoalPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
@@ -217,6 +473,15 @@ bool CharcoalPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArgument
     return true;
 }
 
+void CharcoalPlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+    if (!srcClip_ || !srcClip_->isConnected()) {
+        return;
+    }
+    // the levels are those of the whole source
+    rois.setRegionOfInterest(*srcClip_, srcClip_->getRegionOfDefinition(args.time));
+}
+
 mDeclarePluginFactory(CharcoalPluginFactory, {}, {});
 
 /** @brief The basic describe function, passed a plugin descriptor */
@@ -232,6 +497,8 @@ void CharcoalPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     desc.setSupportsTiles(kSupportsTiles);
@@ -245,13 +512,10 @@ void CharcoalPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void CharcoalPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-
     // create the mandated source clip
     ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
@@ -259,6 +523,7 @@ void CharcoalPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc,
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make some pages
@@ -282,17 +547,6 @@ void CharcoalPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc,
         param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
     }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
-    }
 }
 
 /** @brief The create instance function, the plugin must return an object derived from the \ref OFX::ImageEffect class */
@@ -19,6 +19,9 @@
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
 #include <Magick++.h>
+#include "MagickThreads.h"
+#include "MagickCache.h"
+#include "MagickAbort.h"
 #include <iostream>
 #include <stdint.h>
 #include <cmath>
@@ -199,14 +202,23 @@ void EdgesPlugin::render(const OFX::RenderArguments &args)
     int width = srcRod.x2-srcRod.x1;
     int height = srcRod.y2-srcRod.y1;
 
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
+    // cached result
+    MagickCacheKey key;
+    key.add(kPluginIdentifier);
+    key.add(brightness);
+    key.add(smoothing);
+    key.add(edge);
+    key.add(gray);
+    key.add(kernel);
+    key.add(args.renderScale.x);
+    key.add(args.renderScale.y);
+    key.add(args.renderWindow);
+    key.addPixels(srcImg.get(), srcRod);
+    if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get()))
+        return;
 
-    Magick::ResourceLimits::thread(threads);
-#endif
+    // OpenMP
+    MagickThreadBudget threads(_hasOpenMP && enableOpenMP);
 
     // read image
     Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
@@ -214,6 +226,9 @@ void EdgesPlugin::render(const OFX::RenderArguments &args)
     if (srcClip_ && srcClip_->isConnected())
         image.read(width,height,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
 
+    // stop the effect if the host aborts the render
+    MagickAbortMonitor monitor(this, image);
+
     // grayscale
     if (gray) {
         image.quantizeColorSpace(Magick::GRAYColorspace);
@@ -331,6 +346,9 @@ void EdgesPlugin::render(const OFX::RenderArguments &args)
 #endif
     }
 
+    if (abort())
+        return;
+
     // return image
     if (dstClip_ && dstClip_->isConnected()) {
         output.composite(image, 0, 0, Magick::OverCompositeOp);
@@ -340,6 +358,7 @@ void EdgesPlugin::render(const OFX::RenderArguments &args)
         output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
 #endif
         output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+        MagickResultCache::store(key, args.renderWindow, dstImg.get());
     }
 }
 
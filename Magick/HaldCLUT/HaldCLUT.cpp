@@ -16,18 +16,30 @@
 */
 
 #include "MagickPlugin.h"
+#include "ArenaLut.h"
+#include "ArenaLutArchive.h"
+#include "HaldPresets.h"
+#include "ofxsMultiThread.h"
 
-#include <libxml/xmlmemory.h>
-#include <libxml/parser.h>
 #include <curl/curl.h>
 
 #include <stdio.h>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <set>
 #include <string>
 #include <iostream>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <cstring>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 using namespace OFX;
 OFXS_NAMESPACE_ANONYMOUS_ENTER
 
@@ -58,7 +70,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "\n\n" \
     "The CLUT presets is licenced under the Creative Commons Attribution-ShareAlike license." \
     "\n\n" \
-    "CLUT presets are downloaded on-demand if missing from disk, an active internet connection is needed during that time." \
+    "CLUT presets are read from the preset archive installed with the plugin (built with HaldPack, see the HaldCLUT Makefile). " \
+    "Presets missing from it are looked up in the preset path, and downloaded there in the background when selected if 'Download Missing Looks' is checked. " \
+    "A look being downloaded fails to render until its download has finished, renders never wait on the network." \
     "\n\n" \
     "Trademarked names which may appear are there for informational purposes only. " \
     "They serve only to inform the user which film stock the given HaldCLUT image is designed to approximate. " \
@@ -67,9 +81,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginRepoURL "https://raw.githubusercontent.com/olear/clut/master"
 #define kPluginRepoZIP "https://github.com/olear/clut/archive/master.zip"
 #define kPluginVersionMajor 1
-#define kPluginVersionMinor 1
+#define kPluginVersionMinor 2
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
@@ -88,7 +102,18 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 
 #define kParamCustomPath "customPath"
 #define kParamCustomPathLabel "Custom Preset Path"
-#define kParamCustomPathHint "Add a custom path where the presets are located (or will be downloaded)."
+#define kParamCustomPathHint "Add a custom path where the presets that are not installed with the plugin are located (or will be downloaded)."
+
+#define kParamDownload "download"
+#define kParamDownloadLabel "Download Missing Looks"
+#define kParamDownloadHint "Download the looks that are not installed with the plugin in the background, when they are selected. Nothing is downloaded when a project is opened or rendered."
+#define kParamDownloadDefault false
+
+// the looks expect their input raised to 1/2.2
+#define kHaldGamma 2.2
+
+// Override the location of the preset archive, by default it is in the bundle resources
+#define kHaldArchiveEnv "ARENA_HALDCLUT_ARCHIVE"
 
 static bool gHostIsNatron = false;
 
@@ -99,109 +124,336 @@ existsFile(const std::string &filename)
     return (stat(filename.c_str(), &st) == 0);
 }
 
-std::vector<std::string>
-parsePreset(xmlDocPtr doc, xmlNodePtr cur)
+size_t
+curlWriteData(void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
-    cur = cur->xmlChildrenNode;
-    xmlChar *key;
-    std::vector<std::string> preset;
-    while (cur != NULL) {
-        if ((!xmlStrcmp(cur->name, (const xmlChar *)"title"))) {
-            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-            preset.push_back((reinterpret_cast<char*>(key)));
-            xmlFree(key);
-        }
-        if ((!xmlStrcmp(cur->name, (const xmlChar *)"file"))) {
-            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-            preset.push_back((reinterpret_cast<char*>(key)));
-            xmlFree(key);
+    size_t written = fwrite(ptr, size, nmemb, stream);
+    return written;
+}
+
+static OFX::MultiThread::Mutex&
+haldMutex()
+{
+    static OFX::MultiThread::Mutex mutex;
+    return mutex;
+}
+
+// the preset archive of the bundle, opened once by the first instance and read only afterwards
+static const ArenaLutArchive&
+haldArchive(const std::string &bundle)
+{
+    static ArenaLutArchive archive;
+    static bool opened = false;
+    OFX::MultiThread::AutoMutex lock(haldMutex());
+    if (!opened) {
+        opened = true;
+        const char *env = getenv(kHaldArchiveEnv);
+        std::string path = (env && *env) ? std::string(env) : bundle + "/Contents/Resources/" + kPluginIdentifier + ".lut";
+        if (!archive.open(path)) {
+#ifdef DEBUG
+            std::cout << "HaldCLUT: no preset archive at " << path << std::endl;
+#endif
         }
-        if ((!xmlStrcmp(cur->name, (const xmlChar *)"checksum"))) {
-            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-            preset.push_back((reinterpret_cast<char*>(key)));
-            xmlFree(key);
+    }
+    return archive;
+}
+
+/* Presets missing from disk are downloaded by one background thread, started when the plugin is loaded
+ * and joined when it is unloaded, so it never outlives the bundle. Files are written next to their
+ * destination and renamed, so a render never reads a partial download. */
+struct HaldDownload
+{
+    std::string url;
+    std::string directory;
+    std::string destination;
+};
+
+static std::deque<HaldDownload> _downloads;
+static std::set<std::string> _downloading; // destinations queued or being downloaded
+static bool _downloaderRunning = false;
+static bool _downloaderStop = false;
+static bool _curlReady = false;
+
+// the downloader sleeps on _downloadWake until something is queued or it is asked to stop
+#ifdef _WIN32
+static SRWLOCK _downloadLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE _downloadWake = CONDITION_VARIABLE_INIT;
+static HANDLE _downloader = NULL;
+#else
+static pthread_mutex_t _downloadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _downloadWake = PTHREAD_COND_INITIALIZER;
+static pthread_t _downloader;
+#endif
+
+static void
+haldLockDownloads()
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&_downloadLock);
+#else
+    pthread_mutex_lock(&_downloadLock);
+#endif
+}
+
+static void
+haldUnlockDownloads()
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&_downloadLock);
+#else
+    pthread_mutex_unlock(&_downloadLock);
+#endif
+}
+
+// called with the downloads locked
+static void
+haldWaitDownloads()
+{
+#ifdef _WIN32
+    SleepConditionVariableSRW(&_downloadWake, &_downloadLock, INFINITE, 0);
+#else
+    pthread_cond_wait(&_downloadWake, &_downloadLock);
+#endif
+}
+
+// called with the downloads locked
+static void
+haldWakeDownloader()
+{
+#ifdef _WIN32
+    WakeConditionVariable(&_downloadWake);
+#else
+    pthread_cond_signal(&_downloadWake);
+#endif
+}
+
+// curl progress callback, aborts the transfer in progress when the plugin is unloaded
+static int
+curlProgress(void */*data*/, double /*dltotal*/, double /*dlnow*/, double /*ultotal*/, double /*ulnow*/)
+{
+    haldLockDownloads();
+    bool stop = _downloaderStop;
+    haldUnlockDownloads();
+    return stop ? 1 : 0;
+}
+
+static bool
+haldDownload(const HaldDownload &download)
+{
+    if (!existsFile(download.directory)) {
+#ifdef _WIN32
+        mkdir(download.directory.c_str());
+#else
+        mkdir(download.directory.c_str(), 0750);
+#endif
+    }
+    std::string part = download.destination + ".part";
+    FILE *fp = fopen(part.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    CURLcode res = CURLE_FAILED_INIT;
+    CURL *curl = curl_easy_init();
+    if (curl) {
+        curl_easy_setopt(curl, CURLOPT_URL, download.url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteData);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
+        curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, curlProgress);
+        res = curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+    }
+    if (fclose(fp) != 0 || res != CURLE_OK) {
+        remove(part.c_str());
+        return false;
+    }
+    remove(download.destination.c_str());
+    return rename(part.c_str(), download.destination.c_str()) == 0;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+haldDownloader(LPVOID)
+#else
+static void*
+haldDownloader(void*)
+#endif
+{
+    haldLockDownloads();
+    for (;;) {
+        while (!_downloaderStop && _downloads.empty()) {
+            haldWaitDownloads();
         }
-        if ((!xmlStrcmp(cur->name, (const xmlChar *)"category"))) {
-            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-            preset.push_back((reinterpret_cast<char*>(key)));
-            xmlFree(key);
+        if (_downloaderStop) {
+            break;
         }
-        cur = cur->next;
-    }
-    if (preset.size() != 4) {
-        preset.clear();
+        HaldDownload download = _downloads.front();
+        _downloads.pop_front();
+        haldUnlockDownloads();
+        bool done = haldDownload(download);
+#ifdef DEBUG
+        std::cout << "HaldCLUT: " << (done ? "downloaded " : "unable to download ") << download.url << std::endl;
+#else
+        (void)done;
+#endif
+        haldLockDownloads();
+        _downloading.erase(download.destination);
     }
-    return preset;
+    haldUnlockDownloads();
+    return 0;
 }
 
-void
-parseXML(const std::string &filename, std::vector<std::vector<std::string> >* presets)
+// plugin load: set up curl and start the downloader, from the host's main thread
+static void
+haldStartDownloader()
 {
-    xmlDocPtr doc;
-    xmlNodePtr cur;
+    if (!_curlReady) {
+        _curlReady = (curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK);
+    }
+    haldLockDownloads();
+    if (_curlReady && !_downloaderRunning) {
+        _downloaderStop = false;
+#ifdef _WIN32
+        _downloader = CreateThread(NULL, 0, haldDownloader, NULL, 0, NULL);
+        _downloaderRunning = (_downloader != NULL);
+#else
+        _downloaderRunning = (pthread_create(&_downloader, NULL, haldDownloader, NULL) == 0);
+#endif
+    }
+    haldUnlockDownloads();
+}
 
-    if (!existsFile(filename)) {
-        return;
+// plugin unload: stop the downloader, aborting the download in progress, and wait for it
+static void
+haldStopDownloader()
+{
+    haldLockDownloads();
+    bool running = _downloaderRunning;
+    _downloaderStop = true;
+    haldWakeDownloader();
+    haldUnlockDownloads();
+    if (running) {
+#ifdef _WIN32
+        WaitForSingleObject(_downloader, INFINITE);
+        CloseHandle(_downloader);
+        _downloader = NULL;
+#else
+        pthread_join(_downloader, NULL);
+#endif
+    }
+    haldLockDownloads();
+    _downloaderRunning = false;
+    _downloads.clear();
+    _downloading.clear();
+    haldUnlockDownloads();
+    if (_curlReady) {
+        curl_global_cleanup();
+        _curlReady = false;
     }
+}
 
-    doc = xmlParseFile(filename.c_str());
+// true while destination is queued or being downloaded
+static bool
+haldDownloading(const std::string &destination)
+{
+    haldLockDownloads();
+    bool downloading = _downloading.find(destination) != _downloading.end();
+    haldUnlockDownloads();
+    return downloading;
+}
 
-    if (doc == NULL ) {
-        return;
+// queue the download of url to destination in directory, returns at once, false if there is no downloader
+static bool
+haldQueueDownload(const std::string &url, const std::string &directory, const std::string &destination)
+{
+    haldLockDownloads();
+    bool queued = _downloaderRunning;
+    if (queued && _downloading.insert(destination).second) {
+        HaldDownload download;
+        download.url = url;
+        download.directory = directory;
+        download.destination = destination;
+        _downloads.push_back(download);
+        haldWakeDownloader();
     }
+    haldUnlockDownloads();
+    return queued;
+}
 
-    cur = xmlDocGetRootElement(doc);
-    if (cur == NULL) {
-        xmlFreeDoc(doc);
-        return;
+// decodes Hald CLUT image files for the LUT store
+class HaldLutLoader
+    : public ArenaLutLoader
+{
+public:
+    virtual bool load(const std::string &path, ArenaLut3D &lut) OVERRIDE FINAL
+    {
+        std::vector<float> pixels;
+        int width;
+        if (!haldReadImage(path, pixels, width)) {
+            return false;
+        }
+        return lut.setHald(&pixels[0], width, width, kHaldGamma);
     }
+};
 
-    if (xmlStrcmp(cur->name, (const xmlChar *)"looks")) {
-        xmlFreeDoc(doc);
-        return;
+// decodes a preset of the archive for the LUT store
+class HaldArchiveLoader
+    : public ArenaLutLoader
+{
+public:
+    HaldArchiveLoader(const ArenaLutArchive &archive, const std::string &name)
+        : _archive(archive)
+        , _name(name)
+    {
     }
 
-    cur = cur->xmlChildrenNode;
-    while (cur != NULL) {
-        if ((!xmlStrcmp(cur->name, (const xmlChar *)"preset"))) {
-            presets->push_back(parsePreset(doc, cur));
-        }
-        cur = cur->next;
+    virtual bool load(const std::string &/*path*/, ArenaLut3D &lut) OVERRIDE FINAL
+    {
+        return _archive.load(_name, lut, kHaldGamma);
     }
 
-    xmlFreeDoc(doc);
-    xmlCleanupParser();
-}
+private:
+    const ArenaLutArchive &_archive;
+    std::string _name;
+};
 
-size_t
-curlWriteData(void *ptr, size_t size, size_t nmemb, FILE *stream)
+// where a look comes from, or why it can not be rendered
+struct HaldLook
 {
-    size_t written = fwrite(ptr, size, nmemb, stream);
-    return written;
-}
+    ArenaLutKey key;
+    std::string error;
+};
 
 class HaldCLUTPlugin
-    : public MagickPluginHelper<kSupportsRenderScale>
+    : public MagickPluginHelper<kSupportsRenderScale, kSupportsTiles>
 {
 public:
     HaldCLUTPlugin(OfxImageEffectHandle handle)
-        : MagickPluginHelper<kSupportsRenderScale>(handle)
+        : MagickPluginHelper<kSupportsRenderScale, kSupportsTiles>(handle, kPluginIdentifier)
         , _presets()
         , _preset(NULL)
+        , _customSelected(false)
+        , _archive(NULL)
         , _custom(NULL)
         , _path(NULL)
+        , _download(NULL)
     {
         _preset = fetchChoiceParam(kParamPreset);
         _custom = fetchStringParam(kParamCustom);
         _path = fetchStringParam(kParamCustomPath);
-        assert(_preset && _custom && _path);
+        _download = fetchBooleanParam(kParamDownload);
+        assert(_preset && _custom && _path && _download);
 
+        std::string bundle = getPropertySet().propGetString(kOfxPluginPropFilePath, false);
         std::string xml;
-        xml.append(getPropertySet().propGetString(kOfxPluginPropFilePath, false));
+        xml.append(bundle);
         xml.append("/Contents/Resources/");
         xml.append(kPluginIdentifier);
         xml.append(".xml");
-        parseXML(xml, &_presets);
+        haldParsePresets(xml, &_presets);
+        _archive = &haldArchive(bundle);
 
         if (_presets.size() > 0) {
             std::string presetSelected;
@@ -223,139 +475,196 @@ public:
             }
         }
 
-        _lut = Magick::Image(Magick::Geometry(512, 512), Magick::Color("rgb(0,0,0)"));
-        _lut.comment("N/A");
-
-        std::string currPath;
-        _path->getValue(currPath);
-        if (currPath.empty()) {
-            currPath = presetPath("");
+        if (!_archive->isOpen()) {
+            std::string currPath;
+            _path->getValue(currPath);
+            if (currPath.empty()) {
+                currPath = presetPath("");
+            }
+            std::stringstream msg;
+            msg << "The presets are not installed with this plugin, they are read from the " << currPath << " directory and can be downloaded there in the background (see 'Download Missing Looks'). You can override this location with the 'customPath' param. You can also download the presets manually from " << kPluginRepoZIP << ", extract and copy the preset files to the " << currPath << " directory.";
+            setPersistentMessage(OFX::Message::eMessageMessage, "", msg.str());
         }
-        std::stringstream msg;
-        msg << "This plugin will download presets if they are not found on disk. The presets are stored in the " << currPath << " directory, you can override this location with the 'customPath' param. You can also download the presets manually from " << kPluginRepoZIP << ", extract and copy the preset files to the " << currPath << " directory.";
-        setPersistentMessage(OFX::Message::eMessageMessage, "", msg.str());
+
+        resolveLooks(false);
+    }
+
+    virtual bool renderNative(const OFX::RenderArguments &args, const OFX::Image *srcImg, OFX::Image *dstImg, ArenaWarpEdgeEnum /*edge*/) OVERRIDE FINAL
+    {
+        ArenaLutHandle lut = fetchLut(args.time);
+        return arenaLutApply(*this, srcImg, dstImg, args.renderWindow, *lut.get());
     }
 
     virtual void render(const OFX::RenderArguments &args, Magick::Image &image) OVERRIDE FINAL
     {
-        int preset = 0;
-        std::string custom, url, clut, category, filename/*, checksum*/, customPath;
-        _preset->getValueAtTime(args.time, preset);
-        _custom->getValueAtTime(args.time, custom);
-        _path->getValueAtTime(args.time, customPath);
+        ArenaLutHandle lut = fetchLut(args.time);
+
+        // the matte option and images the native path does not handle, rebuild a Hald image from the lattice
+        std::vector<float> pixels;
+        int width;
+        lut.get()->getHald(pixels, width);
+        Magick::Image hald;
+        hald.read(width, width, "RGB", Magick::FloatPixel, &pixels[0]);
+        image.gamma(lut.get()->gamma());
+        image.haldClut(hald);
+    }
 
-        std::string presetFile;
+    // files may have been edited or downloaded since the last render, look at the disk again
+    virtual void beginSequenceRender(const OFX::BeginSequenceRenderArguments &/*args*/) OVERRIDE FINAL
+    {
+        resolveLooks(false);
+    }
 
+    /* Finds where the looks that can be selected are, this is the only place that reads the file system.
+     * The look choice is the only animated param and it does not interpolate, so its value at any time
+     * is its current value or its value at one of its keys: those presets are resolved.
+     * Missing presets are only downloaded when the user selects them, queueDownload is set then. */
+    void resolveLooks(bool queueDownload)
+    {
+        std::string custom, customPath;
+        bool download = kParamDownloadDefault;
+        _custom->getValue(custom);
+        _path->getValue(customPath);
+        _download->getValue(download);
+
+        HaldLook customLook;
+        std::map<int, HaldLook> looks;
         if (custom.empty()) {
-            if (_presets.size() > 0) {
-                category = _presets[preset][1];
-                filename = _presets[preset][2];
-            }
-            //checksum = _presets[preset][3];
-            if (category.empty() || filename.empty() /*|| checksum.empty()*/) {
-                setPersistentMessage(OFX::Message::eMessageError, "", "Unable to read XML");
-                OFX::throwSuiteStatusException(kOfxStatFailed);
+            int preset = 0;
+            _preset->getValue(preset);
+            looks[preset] = resolvePreset(preset, customPath, download && queueDownload);
+            int keys = _preset->getNumKeys();
+            for (int i = 0; i < keys; ++i) {
+                _preset->getValueAtTime(_preset->getKeyTime(i), preset);
+                if (looks.find(preset) == looks.end()) {
+                    looks[preset] = resolvePreset(preset, customPath, false);
+                }
             }
-            url.append(kPluginRepoURL);
-            url.append("/" + category + "/" + filename);
-            clut.append(presetPath(customPath) + "/" + filename);
-            if (url.empty() || clut.empty()) {
-                setPersistentMessage(OFX::Message::eMessageError, "", "Missing XML data");
-                OFX::throwSuiteStatusException(kOfxStatFailed);
+        } else {
+            customLook.key = ArenaLutStore::resolve(custom);
+            if (customLook.key.empty()) {
+                customLook.error = "Unable to read CLUT";
             }
-            if (!existsFile(clut)) {
-                if (!getFile(url, clut)) {
-                    setPersistentMessage(OFX::Message::eMessageError, "", "Unable to download LUT");
-                    OFX::throwSuiteStatusException(kOfxStatFailed);
+        }
+
+        OFX::MultiThread::AutoMutex lock(_lutMutex);
+        _customSelected = !custom.empty();
+        _customLook = customLook;
+        _looks.swap(looks);
+    }
+
+    /* Presets come from the archive, else from the preset path. A preset missing from both is queued
+     * for the background downloader if download is set, it is found by the next resolve once on disk. */
+    HaldLook resolvePreset(int preset, const std::string &customPath, bool download)
+    {
+        HaldLook look;
+        std::string category, filename;
+        if (preset >= 0 && preset < (int)_presets.size() && _presets[preset].size() == 4) {
+            category = _presets[preset][1];
+            filename = _presets[preset][2];
+        }
+        if (category.empty() || filename.empty()) {
+            look.error = "Unable to read XML";
+        } else if (_archive->contains(filename)) {
+            look.key = ArenaLutStore::resolve(_archive->path(), filename);
+        } else {
+            std::string source = presetPath(customPath) + "/" + filename;
+            look.key = ArenaLutStore::resolve(source);
+            if (look.key.empty()) {
+                if ((download && haldQueueDownload(std::string(kPluginRepoURL) + "/" + category + "/" + filename, presetPath(customPath), source)) ||
+                    haldDownloading(source)) {
+                    look.error = "Downloading " + filename + ", render again when it has finished";
+                } else {
+                    look.error = filename + " is not installed";
                 }
             }
-            presetFile = clut;
-        } else {
-            presetFile = custom;
         }
+        return look;
+    }
 
-        if (_lut.comment() != presetFile) {
-            try {
-                _lut.read(presetFile.c_str());
-            } catch(Magick::Exception &exp) {
-                if (custom.empty()) {
-                    _lut.comment("N/A");
-                    if (!getFile(url, clut)) {
-                        setPersistentMessage(OFX::Message::eMessageError, "", "Unable to download LUT");
-                        OFX::throwSuiteStatusException(kOfxStatFailed);
-                    } else {
-                        _lut.read(presetFile.c_str());
-                    }
+    /* The look selected at time, as last resolved, from the shared LUT store. The store is only asked
+     * when the resolved file changed, renders never touch the disk unless the LUT has to be decoded. */
+    ArenaLutHandle fetchLut(double time)
+    {
+        int preset = 0;
+        _preset->getValueAtTime(time, preset);
+
+        HaldLook look;
+        {
+            OFX::MultiThread::AutoMutex lock(_lutMutex);
+            if (_customSelected) {
+                look = _customLook;
+            } else {
+                std::map<int, HaldLook>::const_iterator found = _looks.find(preset);
+                if (found != _looks.end()) {
+                    look = found->second;
+                } else {
+                    look.error = "Unable to read CLUT";
                 }
             }
-            _lut.colorSpace(Magick::RGBColorspace);
-            _lut.comment(presetFile);
+            if (look.error.empty() && _lutKey == look.key && _lut.get()) {
+                return _lut;
+            }
+        }
+        if (!look.error.empty()) {
+            setPersistentMessage(OFX::Message::eMessageError, "", look.error);
+            OFX::throwSuiteStatusException(kOfxStatFailed);
         }
 
-        if (_lut.rows() >= 512 && _lut.rows() == _lut.columns() && _lut.comment() == presetFile) {
-            image.gamma(2.2);
-            image.haldClut(_lut);
+        ArenaLutHandle lut;
+        if (!look.key.entry.empty()) {
+            HaldArchiveLoader loader(*_archive, look.key.entry);
+            lut = ArenaLutStore::fetch(look.key, loader);
         } else {
+            HaldLutLoader loader;
+            lut = ArenaLutStore::fetch(look.key, loader);
+        }
+        if (!lut.get()) {
             setPersistentMessage(OFX::Message::eMessageError, "", "Unable to read CLUT");
             OFX::throwSuiteStatusException(kOfxStatFailed);
         }
 
+        OFX::MultiThread::AutoMutex lock(_lutMutex);
+        _lut = lut;
+        _lutKey = look.key;
+        return lut;
     }
     virtual void changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
-    bool getFile(const std::string location, const std::string &destination)
+    // where the presets missing from the archive are, does not touch the disk
+    std::string presetPath(const std::string &altpath)
     {
-        CURL *curl;
-        FILE *fp;
-        CURLcode res;
-        curl = curl_easy_init();
-        if (curl) {
-            fp = fopen(destination.c_str(),"wb");
-            curl_easy_setopt(curl, CURLOPT_URL, location.c_str());
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteData);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-            curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-            res = curl_easy_perform(curl);
-            curl_easy_cleanup(curl);
-            fclose(fp);
-        }
-        if (existsFile(destination) && res == CURLE_OK) {
-            return true;
-        } else {
-            return false;
+        if (!altpath.empty()) {
+            return altpath;
         }
-    }
-    std::string presetPath(std::string altpath)
-    {
         std::string path;
-        if (altpath.empty()) {
 #ifdef _WIN32
-            path.append(getenv("HOMEDRIVE"));
-            path.append(getenv("HOMEPATH"));
-#else
-            path.append(getenv("HOME"));
-#endif
-            path.append("/.clut");
+        const char *drive = getenv("HOMEDRIVE");
+        const char *home = getenv("HOMEPATH");
+        if (drive) {
+            path.append(drive);
         }
-        if (!path.empty()) {
-            if (!existsFile(path)) {
-#ifdef _WIN32
-                mkdir(path.c_str());
 #else
-                mkdir(path.c_str(), 0750);
+        const char *home = getenv("HOME");
 #endif
-            }
-        }
-        if (!altpath.empty()) {
-            path = altpath;
+        if (home) {
+            path.append(home);
         }
+        path.append("/.clut");
         return path;
     }
 private:
     std::vector<std::vector<std::string> > _presets;
     ChoiceParam *_preset;
-    Magick::Image _lut;
+    ArenaLutHandle _lut; // the look last used, keeps it in the store
+    ArenaLutKey _lutKey; // file _lut was decoded from
+    std::map<int, HaldLook> _looks; // presets the look choice takes, as last resolved
+    HaldLook _customLook;
+    bool _customSelected;
+    OFX::MultiThread::Mutex _lutMutex;
+    const ArenaLutArchive *_archive;
     StringParam *_custom;
     StringParam *_path;
+    BooleanParam *_download;
 };
 
 void
@@ -365,13 +674,14 @@ HaldCLUTPlugin::changedParam(const OFX::InstanceChangedArgs &args, const std::st
         OFX::throwSuiteStatusException(kOfxStatFailed);
         return;
     }
-    if (paramName == kParamCustom) {
-        _lut.comment("N/A");
+    if (paramName == kParamPreset || paramName == kParamCustom || paramName == kParamCustomPath || paramName == kParamDownload) {
+        // a look the user picks starts downloading now if missing, rather than at its first render
+        resolveLooks(args.reason == OFX::eChangeUserEdit);
     }
     clearPersistentMessage();
 }
 
-mDeclarePluginFactory(HaldCLUTPluginFactory, {}, {});
+mDeclarePluginFactory(HaldCLUTPluginFactory, {haldStartDownloader();}, {haldStopDownloader();});
 
 void
 HaldCLUTPluginFactory::describe(ImageEffectDescriptor &desc)
@@ -381,6 +691,9 @@ HaldCLUTPluginFactory::describe(ImageEffectDescriptor &desc)
     desc.setPluginDescription(kPluginDescription);
     desc.addSupportedContext(eContextGeneral);
     desc.addSupportedContext(eContextFilter);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
     desc.setSupportsTiles(kSupportsTiles);
     desc.setSupportsMultiResolution(kSupportsMultiResolution);
@@ -401,7 +714,7 @@ HaldCLUTPluginFactory::describeInContext(ImageEffectDescriptor &desc, ContextEnu
     filename.append(kPluginIdentifier);
     filename.append(".xml");
     std::vector<std::vector<std::string> > presets;
-    parseXML(filename, &presets);
+    haldParsePresets(filename, &presets);
 
     PageParamDescriptor *page = HaldCLUTPlugin::describeInContextBegin(desc, context);
     {
@@ -469,6 +782,16 @@ HaldCLUTPluginFactory::describeInContext(ImageEffectDescriptor &desc, ContextEnu
             page->addChild(*param);
         }
     }
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamDownload);
+        param->setLabel(kParamDownloadLabel);
+        param->setHint(kParamDownloadHint);
+        param->setDefault(kParamDownloadDefault);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
     HaldCLUTPlugin::describeInContextEnd(desc, context, page);
 }
 
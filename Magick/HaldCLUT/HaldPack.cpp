@@ -0,0 +1,152 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+/* HaldPack: packs the HaldCLUT presets into the preset archive installed in the plugin bundle.
+ *
+ * usage: HaldPack presets.xml clutdir archive
+ *
+ * clutdir is a copy of the preset repository (category/file) or a flat preset directory.
+ * Presets that cannot be found or read are reported and left out, the plugin downloads them if asked to.
+ */
+
+#include "HaldPresets.h"
+#include "ArenaLut.h"
+#include "ArenaLutArchive.h"
+
+#include <Magick++.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// the nodes of a preset, by name
+typedef std::map<std::string, std::vector<unsigned short> > HaldPackMap;
+
+static bool
+packPreset(const std::string &path, std::vector<unsigned short> &nodes)
+{
+    std::vector<float> pixels;
+    int width;
+    if (!haldReadImage(path, pixels, width)) {
+        return false;
+    }
+    int size = arenaLutHaldSize(width, width);
+    if (size == 0) {
+        return false;
+    }
+    nodes.resize((size_t)size * size * size * 3);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        float v = std::max(0.f, std::min(pixels[i], 1.f));
+        nodes[i] = (unsigned short)(v * 65535.f + 0.5f);
+    }
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 4) {
+        std::cerr << "usage: " << argv[0] << " presets.xml clutdir archive" << std::endl;
+        return 1;
+    }
+    Magick::InitializeMagick(*argv);
+
+    std::vector<std::vector<std::string> > presets;
+    haldParsePresets(argv[1], &presets);
+    if (presets.empty()) {
+        std::cerr << "no presets in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::string clutdir(argv[2]);
+    HaldPackMap packed;
+    int missing = 0;
+    for (size_t i = 0; i < presets.size(); ++i) {
+        if (presets[i].size() != 4) {
+            continue;
+        }
+        const std::string &category = presets[i][1];
+        const std::string &filename = presets[i][2];
+        if (filename.empty() || filename.size() >= kArenaLutArchiveNameSize || packed.count(filename)) {
+            continue;
+        }
+        std::vector<unsigned short> nodes;
+        if (!packPreset(clutdir + "/" + category + "/" + filename, nodes) &&
+            !packPreset(clutdir + "/" + filename, nodes)) {
+            std::cerr << "skipping " << filename << ": not found or not a Hald CLUT" << std::endl;
+            ++missing;
+            continue;
+        }
+        packed[filename].swap(nodes);
+    }
+
+    // the map is sorted by name, the order the plugin searches the index in
+    ArenaLutArchiveHeader header;
+    std::memcpy(header.magic, kArenaLutArchiveMagic, sizeof(header.magic));
+    header.version = kArenaLutArchiveVersion;
+    header.count = (unsigned int)packed.size();
+
+    std::vector<ArenaLutArchiveEntry> entries;
+    unsigned long long offset = sizeof(ArenaLutArchiveHeader) + packed.size() * sizeof(ArenaLutArchiveEntry);
+    for (HaldPackMap::const_iterator it = packed.begin(); it != packed.end(); ++it) {
+        ArenaLutArchiveEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        std::strcpy(entry.name, it->first.c_str());
+        int size = 2;
+        while ((size_t)size * size * size * 3 < it->second.size()) {
+            ++size;
+        }
+        entry.size = size;
+        entry.offset = offset;
+        entry.checksum = arenaLutArchiveChecksum(&it->second[0], it->second.size() * sizeof(unsigned short));
+        entries.push_back(entry);
+        offset += it->second.size() * sizeof(unsigned short);
+    }
+
+    // write next to the archive and rename, so an interrupted build does not leave a broken archive
+    std::string archive(argv[3]);
+    std::string tmp = archive + ".tmp";
+    FILE *fp = std::fopen(tmp.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "unable to write " << tmp << std::endl;
+        return 1;
+    }
+    bool written = std::fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (written && !entries.empty()) {
+        written = std::fwrite(&entries[0], sizeof(ArenaLutArchiveEntry), entries.size(), fp) == entries.size();
+    }
+    for (HaldPackMap::const_iterator it = packed.begin(); written && it != packed.end(); ++it) {
+        written = std::fwrite(&it->second[0], sizeof(unsigned short), it->second.size(), fp) == it->second.size();
+    }
+    if (std::fclose(fp) != 0 || !written) {
+        std::remove(tmp.c_str());
+        std::cerr << "unable to write " << tmp << std::endl;
+        return 1;
+    }
+    std::remove(archive.c_str());
+    if (std::rename(tmp.c_str(), archive.c_str()) != 0) {
+        std::cerr << "unable to write " << archive << std::endl;
+        return 1;
+    }
+
+    std::cout << archive << ": " << packed.size() << " presets, " << missing << " missing, " << (offset >> 20) << " MB" << std::endl;
+    return 0;
+}
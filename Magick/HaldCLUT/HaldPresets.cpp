@@ -0,0 +1,124 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "HaldPresets.h"
+
+#include <Magick++.h>
+#include <libxml/xmlmemory.h>
+#include <libxml/parser.h>
+
+#include <iostream>
+#include <sys/stat.h>
+
+static std::vector<std::string>
+parsePreset(xmlDocPtr doc, xmlNodePtr cur)
+{
+    cur = cur->xmlChildrenNode;
+    xmlChar *key;
+    std::vector<std::string> preset;
+    while (cur != NULL) {
+        if ((!xmlStrcmp(cur->name, (const xmlChar *)"title"))) {
+            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+            preset.push_back((reinterpret_cast<char*>(key)));
+            xmlFree(key);
+        }
+        if ((!xmlStrcmp(cur->name, (const xmlChar *)"file"))) {
+            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+            preset.push_back((reinterpret_cast<char*>(key)));
+            xmlFree(key);
+        }
+        if ((!xmlStrcmp(cur->name, (const xmlChar *)"checksum"))) {
+            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+            preset.push_back((reinterpret_cast<char*>(key)));
+            xmlFree(key);
+        }
+        if ((!xmlStrcmp(cur->name, (const xmlChar *)"category"))) {
+            key = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+            preset.push_back((reinterpret_cast<char*>(key)));
+            xmlFree(key);
+        }
+        cur = cur->next;
+    }
+    if (preset.size() != 4) {
+        preset.clear();
+    }
+    return preset;
+}
+
+void
+haldParsePresets(const std::string &filename, std::vector<std::vector<std::string> >* presets)
+{
+    xmlDocPtr doc;
+    xmlNodePtr cur;
+
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return;
+    }
+
+    doc = xmlParseFile(filename.c_str());
+
+    if (doc == NULL ) {
+        return;
+    }
+
+    cur = xmlDocGetRootElement(doc);
+    if (cur == NULL) {
+        xmlFreeDoc(doc);
+        return;
+    }
+
+    if (xmlStrcmp(cur->name, (const xmlChar *)"looks")) {
+        xmlFreeDoc(doc);
+        return;
+    }
+
+    cur = cur->xmlChildrenNode;
+    while (cur != NULL) {
+        if ((!xmlStrcmp(cur->name, (const xmlChar *)"preset"))) {
+            presets->push_back(parsePreset(doc, cur));
+        }
+        cur = cur->next;
+    }
+
+    xmlFreeDoc(doc);
+    xmlCleanupParser();
+}
+
+bool
+haldReadImage(const std::string &path, std::vector<float> &pixels, int &width)
+{
+    try {
+        Magick::Image hald;
+        hald.read(path.c_str());
+        hald.colorSpace(Magick::RGBColorspace);
+        int columns = (int)hald.columns();
+        int rows = (int)hald.rows();
+        if (rows < 512 || rows != columns) {
+            return false;
+        }
+        pixels.resize((size_t)columns * rows * 3);
+        hald.write(0, 0, columns, rows, "RGB", Magick::FloatPixel, &pixels[0]);
+        width = columns;
+        return true;
+    } catch(Magick::Exception &e) {
+#ifdef DEBUG
+        std::cout << e.what() << std::endl;
+#endif
+        return false;
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef HaldPresets_h
+#define HaldPresets_h
+
+#include <string>
+#include <vector>
+
+// Shared by the HaldCLUT plugin and the HaldPack tool, so nothing here depends on the OFX runtime.
+
+// title, category, file and checksum of each preset of the XML preset list
+void haldParsePresets(const std::string &filename, std::vector<std::vector<std::string> >* presets);
+
+/* Read the Hald CLUT image at path as linear RGB float pixels (first row first).
+ * Returns false if it cannot be read or is not a square image of level 8 or more. */
+bool haldReadImage(const std::string &path, std::vector<float> &pixels, int &width);
+
+#endif // HaldPresets_h
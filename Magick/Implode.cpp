@@ -19,6 +19,8 @@
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
 #include <Magick++.h>
+#include "MagickThreads.h"
+#include "ArenaWarp.h"
 #include <iostream>
 #include <stdint.h>
 #include <cmath>
@@ -55,6 +57,9 @@
 #define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
 #define kParamOpenMPDefault false
 
+// virtual pixel method of the ImageMagick path, which keeps the image default (Undefined)
+#define kImplodeVirtualPixel 0
+
 using namespace OFX;
 static bool _hasOpenMP = false;
 
@@ -65,6 +70,7 @@ public:
     virtual ~ImplodePlugin();
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
 private:
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
@@ -177,18 +183,24 @@ void ImplodePlugin::render(const OFX::RenderArguments &args)
     swirl_->getValueAtTime(args.time, swirl);
     enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
 
+    // native warp, swirl is applied after implode so its map comes first
+    ArenaWarpEdgeEnum edge;
+    if (!matte && srcClip_ && srcClip_->isConnected() && arenaWarpEdge(kImplodeVirtualPixel, edge)) {
+        ArenaImplodeMap implodeMap(srcRod, implode);
+        ArenaSwirlMap swirlMap(srcRod, swirl);
+        ArenaChainMap chainMap(swirlMap, implodeMap);
+        const ArenaWarpMap &map = swirl != 0 ? static_cast<const ArenaWarpMap&>(chainMap) : static_cast<const ArenaWarpMap&>(implodeMap);
+        if (arenaWarp(*this, srcImg.get(), dstImg.get(), args.renderWindow, srcRod, map, eArenaWarpFilterBilinear, edge)) {
+            return;
+        }
+    }
+
     // setup
     int width = srcRod.x2-srcRod.x1;
     int height = srcRod.y2-srcRod.y1;
 
     // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
+    MagickThreadBudget threads(_hasOpenMP && enableOpenMP);
 
     // read image
     Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
@@ -241,6 +253,24 @@ bool ImplodePlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments
     return true;
 }
 
+bool ImplodePlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!kSupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    double implode, swirl;
+    bool matte = false;
+    implode_->getValueAtTime(args.time, implode);
+    swirl_->getValueAtTime(args.time, swirl);
+    matte_->getValueAtTime(args.time, matte);
+    if (implode == 0. && swirl == 0. && !matte) {
+        identityClip = srcClip_;
+        return true;
+    }
+    return false;
+}
+
 mDeclarePluginFactory(ImplodePluginFactory, {}, {});
 
 /** @brief The basic describe function, passed a plugin descriptor */
@@ -0,0 +1,59 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef MagickAbort_h
+#define MagickAbort_h
+
+#include "ofxsImageEffect.h"
+#include <Magick++.h>
+
+/* Cancels long ImageMagick operations when the host aborts the render.
+ *
+ * Installs a progress monitor on image for the lifetime of the object. ImageMagick calls it
+ * for every row it processes (images created from image inherit it), and the running
+ * operation is stopped as soon as effect->abort() is true. The image content is undefined
+ * after a cancelled operation, so check effect->abort() before exporting it.
+ */
+class MagickAbortMonitor
+{
+public:
+    MagickAbortMonitor(OFX::ImageEffect *effect, Magick::Image &image)
+        : _image(image)
+    {
+        MagickCore::SetImageProgressMonitor(_image.image(), progress, effect);
+    }
+
+    ~MagickAbortMonitor()
+    {
+        MagickCore::SetImageProgressMonitor(_image.image(), NULL, NULL);
+    }
+
+private:
+    MagickAbortMonitor(const MagickAbortMonitor&);
+    MagickAbortMonitor& operator=(const MagickAbortMonitor&);
+
+    static MagickCore::MagickBooleanType progress(const char * /*text*/, const MagickCore::MagickOffsetType /*offset*/,
+                                                  const MagickCore::MagickSizeType /*span*/, void *clientData)
+    {
+        OFX::ImageEffect *effect = (OFX::ImageEffect*)clientData;
+        return (effect && effect->abort()) ? MagickCore::MagickFalse : MagickCore::MagickTrue;
+    }
+
+    Magick::Image &_image;
+};
+
+#endif // MagickAbort_h
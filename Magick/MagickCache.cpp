@@ -0,0 +1,319 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "MagickCache.h"
+#include "ofxsMultiThread.h"
+#include <list>
+#include <map>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const unsigned long long kHashKey[2] = { 0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL };
+
+static inline unsigned long long
+hashMix(unsigned long long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// accumulate count 16 byte blocks, first is the index of the first block in the stream
+static void
+hashBlocks(const unsigned char *data, size_t count, unsigned int first, unsigned long long acc[2])
+{
+#ifdef __SSE2__
+    __m128i a = _mm_loadu_si128((const __m128i*)acc);
+    const __m128i key = _mm_loadu_si128((const __m128i*)kHashKey);
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i pos = _mm_set1_epi32((int)first);
+    for (size_t i = 0; i < count; ++i) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(data + 16 * i));
+        __m128i dk = _mm_add_epi32(_mm_xor_si128(d, key), pos);
+        __m128i hi = _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+        __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        a = _mm_add_epi64(a, _mm_add_epi64(_mm_mul_epu32(dk, hi), swapped));
+        pos = _mm_add_epi32(pos, one);
+    }
+    _mm_storeu_si128((__m128i*)acc, a);
+#else
+    for (size_t i = 0; i < count; ++i) {
+        unsigned long long d[2];
+        std::memcpy(d, data + 16 * i, 16);
+        unsigned int pos = first + (unsigned int)i;
+        for (int lane = 0; lane < 2; ++lane) {
+            unsigned long long dk = d[lane] ^ kHashKey[lane];
+            unsigned int lo = (unsigned int)dk + pos;
+            unsigned int hi = (unsigned int)(dk >> 32) + pos;
+            acc[lane] += (unsigned long long)lo * hi + d[lane ^ 1];
+        }
+    }
+#endif
+}
+
+static int
+bytesPerPixel(const OFX::ImageBase *img)
+{
+    int depth = 4;
+    switch (img->getPixelDepth()) {
+    case OFX::eBitDepthUByte:
+        depth = 1;
+        break;
+    case OFX::eBitDepthUShort:
+    case OFX::eBitDepthHalf:
+        depth = 2;
+        break;
+    default:
+        break;
+    }
+    return img->getPixelComponentCount() * depth;
+}
+
+static inline char*
+pixelAddress(const OFX::ImageBase *img, int x, int y)
+{
+    OfxRectI bounds = img->getBounds();
+    return (char*)img->getPixelData()
+           + (ptrdiff_t)(y - bounds.y1) * img->getRowBytes()
+           + (ptrdiff_t)(x - bounds.x1) * bytesPerPixel(img);
+}
+
+MagickCacheKey::MagickCacheKey()
+    : _blocks(0)
+    , _length(0)
+{
+    _acc[0] = kHashKey[1];
+    _acc[1] = kHashKey[0];
+}
+
+void
+MagickCacheKey::addBytes(const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    size_t count = size / 16;
+    hashBlocks(bytes, count, _blocks, _acc);
+    _blocks += (unsigned int)count;
+    size_t tail = size - count * 16;
+    if (tail) {
+        unsigned char block[16];
+        std::memset(block, 0, sizeof(block));
+        std::memcpy(block, bytes + count * 16, tail);
+        hashBlocks(block, 1, _blocks, _acc);
+        ++_blocks;
+    }
+    _length += size;
+}
+
+void
+MagickCacheKey::add(const char *value)
+{
+    addBytes(value, std::strlen(value) + 1);
+}
+
+void
+MagickCacheKey::add(const std::string &value)
+{
+    addBytes(value.c_str(), value.size() + 1);
+}
+
+void
+MagickCacheKey::add(double value)
+{
+    addBytes(&value, sizeof(value));
+}
+
+void
+MagickCacheKey::add(int value)
+{
+    addBytes(&value, sizeof(value));
+}
+
+void
+MagickCacheKey::add(bool value)
+{
+    add(value ? 1 : 0);
+}
+
+void
+MagickCacheKey::add(const OfxRectI &rect)
+{
+    int coords[4] = { rect.x1, rect.y1, rect.x2, rect.y2 };
+    addBytes(coords, sizeof(coords));
+}
+
+void
+MagickCacheKey::addPixels(const OFX::Image *img, const OfxRectI &rect)
+{
+    if (!img) {
+        add(std::string("no pixels"));
+        return;
+    }
+    OfxRectI bounds = img->getBounds();
+    OfxRectI area;
+    area.x1 = std::max(rect.x1, bounds.x1);
+    area.y1 = std::max(rect.y1, bounds.y1);
+    area.x2 = std::min(rect.x2, bounds.x2);
+    area.y2 = std::min(rect.y2, bounds.y2);
+    add(area);
+    add((int)img->getPixelDepth());
+    add((int)img->getPixelComponents());
+    if (area.x1 >= area.x2 || area.y1 >= area.y2) {
+        return;
+    }
+    size_t rowSize = (size_t)(area.x2 - area.x1) * bytesPerPixel(img);
+    for (int y = area.y1; y < area.y2; ++y) {
+        addBytes(pixelAddress(img, area.x1, y), rowSize);
+    }
+}
+
+unsigned long long
+MagickCacheKey::value() const
+{
+    return hashMix(_acc[0] ^ hashMix(_acc[1] + _length));
+}
+
+bool
+MagickCacheKey::operator==(const MagickCacheKey &other) const
+{
+    return _acc[0] == other._acc[0] && _acc[1] == other._acc[1] &&
+           _blocks == other._blocks && _length == other._length;
+}
+
+struct MagickCacheEntry
+{
+    MagickCacheKey key;
+    OfxRectI window;
+    int pixelBytes;
+    std::vector<char> pixels;
+};
+
+typedef std::list<MagickCacheEntry> MagickCacheList;
+
+static MagickCacheList _entries; // most recently used first
+static std::map<unsigned long long, MagickCacheList::iterator> _index;
+static size_t _used = 0;
+#ifdef DEBUG
+static unsigned long long _hits = 0;
+static unsigned long long _misses = 0;
+#endif
+
+static OFX::MultiThread::Mutex&
+cacheMutex()
+{
+    static OFX::MultiThread::Mutex mutex;
+    return mutex;
+}
+
+bool
+MagickResultCache::fetch(const MagickCacheKey &key, const OfxRectI &window, OFX::Image *dstImg)
+{
+    if (!dstImg) {
+        return false;
+    }
+    OFX::MultiThread::AutoMutex lock(cacheMutex());
+    std::map<unsigned long long, MagickCacheList::iterator>::iterator found = _index.find(key.value());
+    bool hit = found != _index.end();
+    int pixelBytes = bytesPerPixel(dstImg);
+    if (hit) {
+        const MagickCacheEntry &entry = *found->second;
+        hit = entry.key == key &&
+              entry.window.x1 == window.x1 && entry.window.y1 == window.y1 &&
+              entry.window.x2 == window.x2 && entry.window.y2 == window.y2 &&
+              entry.pixelBytes == pixelBytes;
+    }
+    if (!hit) {
+#ifdef DEBUG
+        ++_misses;
+#endif
+        return false;
+    }
+    MagickCacheEntry &entry = *found->second;
+    size_t rowSize = (size_t)(window.x2 - window.x1) * pixelBytes;
+    const char *src = &entry.pixels[0];
+    for (int y = window.y1; y < window.y2; ++y, src += rowSize) {
+        std::memcpy(pixelAddress(dstImg, window.x1, y), src, rowSize);
+    }
+    _entries.splice(_entries.begin(), _entries, found->second);
+#ifdef DEBUG
+    ++_hits;
+    std::cout << "Magick result cache hit (" << _hits << " hits, " << _misses << " misses, " << _used / 1048576 << "/" << memoryBudget() / 1048576 << " MB)" << std::endl;
+#endif
+    return true;
+}
+
+void
+MagickResultCache::store(const MagickCacheKey &key, const OfxRectI &window, const OFX::Image *dstImg)
+{
+    if (!dstImg || window.x1 >= window.x2 || window.y1 >= window.y2) {
+        return;
+    }
+    int pixelBytes = bytesPerPixel(dstImg);
+    size_t rowSize = (size_t)(window.x2 - window.x1) * pixelBytes;
+    size_t size = rowSize * (window.y2 - window.y1);
+    size_t budget = memoryBudget();
+    if (size > budget) {
+        return;
+    }
+
+    OFX::MultiThread::AutoMutex lock(cacheMutex());
+    std::map<unsigned long long, MagickCacheList::iterator>::iterator found = _index.find(key.value());
+    if (found != _index.end()) {
+        _used -= found->second->pixels.size();
+        _entries.erase(found->second);
+        _index.erase(found);
+    }
+    while (!_entries.empty() && _used + size > budget) {
+        _used -= _entries.back().pixels.size();
+        _index.erase( _entries.back().key.value() );
+        _entries.pop_back();
+    }
+
+    _entries.push_front(MagickCacheEntry());
+    MagickCacheEntry &entry = _entries.front();
+    entry.key = key;
+    entry.window = window;
+    entry.pixelBytes = pixelBytes;
+    entry.pixels.resize(size);
+    char *dst = &entry.pixels[0];
+    for (int y = window.y1; y < window.y2; ++y, dst += rowSize) {
+        std::memcpy(dst, pixelAddress(dstImg, window.x1, y), rowSize);
+    }
+    _index[key.value()] = _entries.begin();
+    _used += size;
+}
+
+size_t
+MagickResultCache::memoryBudget()
+{
+    static size_t budget = 0;
+    if (budget == 0) {
+        const char *env = std::getenv(kMagickCacheEnv);
+        int value = env ? std::atoi(env) : 0;
+        budget = (size_t)(value > 0 ? value : kMagickCacheDefaultMB) * 1048576;
+    }
+    return budget;
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef MagickCache_h
+#define MagickCache_h
+
+#include "ofxsImageEffect.h"
+#include <string>
+
+// Override the memory budget (in MB) of the result cache
+#define kMagickCacheEnv "ARENA_MAGICK_CACHE_MB"
+#define kMagickCacheDefaultMB 512
+
+/* Fingerprint of everything a render depends on: source pixels, parameter values at
+ * render time, render scale and window. Pixels are hashed 16 bytes at a time (SSE2 when
+ * available, with an identical scalar fallback), the block position is mixed in so
+ * reordered pixels give a different key.
+ */
+class MagickCacheKey
+{
+public:
+    MagickCacheKey();
+
+    void add(const char *value);
+    void add(const std::string &value);
+    void add(double value);
+    void add(int value);
+    void add(bool value);
+    void add(const OfxRectI &rect);
+    void addPixels(const OFX::Image *img, const OfxRectI &rect);
+
+    unsigned long long value() const;
+    // compares the whole hash state, not only value()
+    bool operator==(const MagickCacheKey &other) const;
+
+private:
+    void addBytes(const void *data, size_t size);
+
+    unsigned long long _acc[2];
+    unsigned int _blocks;
+    unsigned long long _length;
+};
+
+/* Process-wide LRU cache of rendered windows, shared by all Magick plugins in the bundle.
+ * A hit copies the stored pixels to the output and the effect is skipped. Entries are
+ * indexed by the 64-bit key value, and only hit when the full key, window and pixel
+ * size all match.
+ */
+class MagickResultCache
+{
+public:
+    // copy the result stored for key to window in dstImg, returns false on a miss
+    static bool fetch(const MagickCacheKey &key, const OfxRectI &window, OFX::Image *dstImg);
+    // store window of the freshly rendered dstImg under key
+    static void store(const MagickCacheKey &key, const OfxRectI &window, const OFX::Image *dstImg);
+
+    static size_t memoryBudget();
+};
+
+#endif // MagickCache_h
@@ -0,0 +1,198 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "MagickPixels.h"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+static inline size_t
+componentBytes(OFX::BitDepthEnum depth)
+{
+    switch (depth) {
+    case OFX::eBitDepthUByte:
+        return 1;
+    case OFX::eBitDepthUShort:
+    case OFX::eBitDepthHalf:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+static inline char*
+pixelAddress(const OFX::Image *img, int x, int y)
+{
+    OfxRectI bounds = img->getBounds();
+    return (char*)img->getPixelData()
+           + (ptrdiff_t)(y - bounds.y1) * img->getRowBytes()
+           + (ptrdiff_t)(x - bounds.x1) * img->getPixelComponentCount() * componentBytes(img->getPixelDepth());
+}
+
+// Magick channel map for the OFX components
+static inline const char*
+pixelMap(int nComponents)
+{
+    switch (nComponents) {
+    case 1:
+        return "A";
+    case 3:
+        return "RGB";
+    default:
+        return "RGBA";
+    }
+}
+
+// premultiply a row of RGBA pixels, maxValue is the value of an opaque alpha
+template <class PIX, int maxValue>
+static void
+premultiplyRow(PIX *dst, int width)
+{
+    for (int x = 0; x < width; ++x, dst += 4) {
+        unsigned int a = dst[3];
+        dst[0] = (PIX)((dst[0] * a + maxValue / 2) / maxValue);
+        dst[1] = (PIX)((dst[1] * a + maxValue / 2) / maxValue);
+        dst[2] = (PIX)((dst[2] * a + maxValue / 2) / maxValue);
+    }
+}
+
+template <>
+void
+premultiplyRow<float, 1>(float *dst, int width)
+{
+    for (int x = 0; x < width; ++x, dst += 4) {
+        dst[0] *= dst[3];
+        dst[1] *= dst[3];
+        dst[2] *= dst[3];
+    }
+}
+
+void
+magickImportPixels(const OFX::Image *srcImg, const OfxRectI &rect, Magick::Image &image)
+{
+    if (!srcImg) {
+        return;
+    }
+    OfxRectI srcBounds = srcImg->getBounds();
+    int x1 = std::max(rect.x1, srcBounds.x1);
+    int x2 = std::min(rect.x2, srcBounds.x2);
+    int y1 = std::max(rect.y1, srcBounds.y1);
+    int y2 = std::min(rect.y2, srcBounds.y2);
+    if (x1 >= x2 || y1 >= y2) {
+        return;
+    }
+
+    int width = x2 - x1;
+    OFX::BitDepthEnum depth = srcImg->getPixelDepth();
+    int nComponents = srcImg->getPixelComponentCount();
+    const char *map = pixelMap(nComponents);
+    std::vector<float> row;
+    if (depth == OFX::eBitDepthHalf) {
+        row.resize(width * nComponents);
+    }
+    image.modifyImage();
+#if MagickLibVersion >= 0x700
+    MagickCore::ExceptionInfo *exception = MagickCore::AcquireExceptionInfo();
+#endif
+    for (int y = y1; y < y2; ++y) {
+        const void *src = pixelAddress(srcImg, x1, y);
+        Magick::StorageType type;
+        switch (depth) {
+        case OFX::eBitDepthUByte:
+            type = Magick::CharPixel;
+            break;
+        case OFX::eBitDepthUShort:
+            type = Magick::ShortPixel;
+            break;
+        case OFX::eBitDepthHalf: {
+            const unsigned short *half = (const unsigned short*)src;
+            for (int i = 0; i < width * nComponents; ++i) {
+                row[i] = magickHalfToFloat(half[i]);
+            }
+            src = &row[0];
+            type = Magick::FloatPixel;
+            break;
+        }
+        default:
+            type = Magick::FloatPixel;
+            break;
+        }
+#if MagickLibVersion >= 0x700
+        MagickCore::ImportImagePixels(image.image(), x1 - rect.x1, rect.y2 - 1 - y, width, 1, map, type, src, exception);
+#else
+        MagickCore::ImportImagePixels(image.image(), x1 - rect.x1, rect.y2 - 1 - y, width, 1, map, type, src);
+#endif
+    }
+#if MagickLibVersion >= 0x700
+    MagickCore::DestroyExceptionInfo(exception);
+#endif
+}
+
+void
+magickExportPixels(Magick::Image &image, const OfxRectI &rect, const OfxRectI &window, OFX::Image *dstImg)
+{
+    if (!dstImg) {
+        return;
+    }
+    assert(window.x1 >= rect.x1 && window.x2 <= rect.x2 && window.y1 >= rect.y1 && window.y2 <= rect.y2);
+    int width = window.x2 - window.x1;
+    OFX::BitDepthEnum depth = dstImg->getPixelDepth();
+    int nComponents = dstImg->getPixelComponentCount();
+    const char *map = pixelMap(nComponents);
+    // premultiply RGBA, this is what compositing over an opaque black image used to give us
+    bool premultiply = nComponents == 4;
+    std::vector<float> row;
+    if (depth == OFX::eBitDepthHalf) {
+        row.resize(width * nComponents);
+    }
+    for (int y = window.y1; y < window.y2; ++y) {
+        void *dst = pixelAddress(dstImg, window.x1, y);
+        int srcX = window.x1 - rect.x1;
+        int srcY = rect.y2 - 1 - y;
+        switch (depth) {
+        case OFX::eBitDepthUByte:
+            image.write(srcX, srcY, width, 1, map, Magick::CharPixel, dst);
+            if (premultiply) {
+                premultiplyRow<unsigned char, 255>((unsigned char*)dst, width);
+            }
+            break;
+        case OFX::eBitDepthUShort:
+            image.write(srcX, srcY, width, 1, map, Magick::ShortPixel, dst);
+            if (premultiply) {
+                premultiplyRow<unsigned short, 65535>((unsigned short*)dst, width);
+            }
+            break;
+        case OFX::eBitDepthHalf: {
+            image.write(srcX, srcY, width, 1, map, Magick::FloatPixel, &row[0]);
+            if (premultiply) {
+                premultiplyRow<float, 1>(&row[0], width);
+            }
+            unsigned short *half = (unsigned short*)dst;
+            for (int i = 0; i < width * nComponents; ++i) {
+                half[i] = magickFloatToHalf(row[i]);
+            }
+            break;
+        }
+        default:
+            image.write(srcX, srcY, width, 1, map, Magick::FloatPixel, dst);
+            if (premultiply) {
+                premultiplyRow<float, 1>((float*)dst, width);
+            }
+            break;
+        }
+    }
+}
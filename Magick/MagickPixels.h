@@ -0,0 +1,142 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef MagickPixels_h
+#define MagickPixels_h
+
+#include "ofxsImageEffect.h"
+#include <Magick++.h>
+#include <algorithm>
+#include <cstring>
+
+/* Pixel bridge between OFX images and the Magick pixel cache.
+ * Rows are mapped one at a time from/to the OFX buffer (honouring bounds and rowBytes),
+ * the vertical flip (OFX is bottom-up, Magick is top-down) is part of the row mapping.
+ * rect is the canvas area covered by image, pixels outside the OFX bounds are left untouched.
+ * UByte/UShort/Float rows map to the matching Magick::StorageType, Half rows are converted through a float row.
+ * RGBA, RGB and Alpha images map to the "RGBA", "RGB" and "A" channels.
+ */
+void magickImportPixels(const OFX::Image *srcImg, const OfxRectI &rect, Magick::Image &image);
+
+/* Export window from image (covering rect) to dstImg, RGBA is premultiplied by alpha on the way out. */
+void magickExportPixels(Magick::Image &image, const OfxRectI &rect, const OfxRectI &window, OFX::Image *dstImg);
+
+// IEEE 754 half <-> float, Magick has no half StorageType so half pixels go through floats
+inline float
+magickHalfToFloat(unsigned short h)
+{
+    unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+    unsigned int exponent = (h >> 10) & 0x1f;
+    unsigned int mantissa = h & 0x3ff;
+    unsigned int bits;
+    if (exponent == 0x1f) { // inf/nan
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa) { // denormal
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    } else {
+        bits = sign;
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline unsigned short
+magickFloatToHalf(float f)
+{
+    unsigned int bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+    int exponent = (int)((bits >> 23) & 0xff) - 112;
+    unsigned int mantissa = bits & 0x7fffff;
+    if (exponent >= 0x1f) { // overflow, inf or nan
+        if (((bits >> 23) & 0xff) == 0xff && mantissa) {
+            return sign | 0x7e00;
+        }
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) { // denormal or zero
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) { // round
+            ++half;
+        }
+        return sign | (unsigned short)half;
+    }
+    unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) { // round, may carry into the exponent which is what we want
+        ++half;
+    }
+    return sign | (unsigned short)half;
+}
+
+// a sample of a Half image, the IEEE 754 bits
+struct MagickHalf
+{
+    unsigned short bits;
+};
+
+/* Sample conversion to and from float for processors templated on the pixel type, 1 is the
+ * opaque value. Integer samples are scaled by their maximum and clamped, floats pass through. */
+template <class PIX>
+struct MagickPixelTraits;
+
+template <class PIX, int maxValue>
+struct MagickIntegerTraits
+{
+    static float toFloat(PIX v) { return (float)v / maxValue; }
+    static PIX fromFloat(float v) { return (PIX)(std::max(0.f, std::min(1.f, v)) * maxValue + 0.5f); }
+};
+
+template <>
+struct MagickPixelTraits<unsigned char>
+    : public MagickIntegerTraits<unsigned char, 255>
+{
+};
+
+template <>
+struct MagickPixelTraits<unsigned short>
+    : public MagickIntegerTraits<unsigned short, 65535>
+{
+};
+
+template <>
+struct MagickPixelTraits<MagickHalf>
+{
+    static float toFloat(MagickHalf v) { return magickHalfToFloat(v.bits); }
+    static MagickHalf fromFloat(float v) { MagickHalf h; h.bits = magickFloatToHalf(v); return h; }
+};
+
+template <>
+struct MagickPixelTraits<float>
+{
+    static float toFloat(float v) { return v; }
+    static float fromFloat(float v) { return v; }
+};
+
+#endif // MagickPixels_h
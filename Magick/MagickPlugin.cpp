@@ -17,19 +17,25 @@
 
 #include "MagickPlugin.h"
 #include <iostream>
+#include <algorithm>
 
-MagickPluginHelperBase::MagickPluginHelperBase(OfxImageEffectHandle handle)
+MagickPluginHelperBase::MagickPluginHelperBase(OfxImageEffectHandle handle, const std::string &pluginID)
     : ImageEffect(handle)
     , _dstClip(NULL)
     , _srcClip(NULL)
     , _enableMP(NULL)
     , _matte(NULL)
     , _vpixel(NULL)
+    , _plugin(pluginID)
 {
     _dstClip = fetchClip(kOfxImageEffectOutputClipName);
-    assert(_dstClip && _dstClip->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(_dstClip && (_dstClip->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        _dstClip->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        _dstClip->getPixelComponents() == OFX::ePixelComponentAlpha));
     _srcClip = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(_srcClip && _srcClip->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(_srcClip && (_srcClip->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        _srcClip->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        _srcClip->getPixelComponents() == OFX::ePixelComponentAlpha));
 
     _enableMP = fetchBooleanParam(kParamOpenMP);
     _matte = fetchBooleanParam(kParamMatte);
@@ -48,17 +54,21 @@ MagickPluginHelperBase::changedParam(const OFX::InstanceChangedArgs &args, const
 }
 
 OFX::PageParamDescriptor*
-MagickPluginHelperBase::describeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum /*context*/)
+MagickPluginHelperBase::describeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum /*context*/, bool supportsTiles)
 {
     OFX::ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(OFX::ePixelComponentRGBA);
+    srcClip->addSupportedComponent(OFX::ePixelComponentRGB);
+    srcClip->addSupportedComponent(OFX::ePixelComponentAlpha);
     srcClip->setTemporalClipAccess(false);
-    srcClip->setSupportsTiles(false);
+    srcClip->setSupportsTiles(supportsTiles);
     srcClip->setIsMask(false);
 
     OFX::ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(OFX::ePixelComponentRGBA);
-    dstClip->setSupportsTiles(false);
+    dstClip->addSupportedComponent(OFX::ePixelComponentRGB);
+    dstClip->addSupportedComponent(OFX::ePixelComponentAlpha);
+    dstClip->setSupportsTiles(supportsTiles);
 
     std::string features = MagickCore::GetMagickFeatures();
     if (features.find("OpenMP") != std::string::npos) {
@@ -21,7 +21,14 @@
 #include "ofxsImageEffect.h"
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
+#include <algorithm>
 #include <Magick++.h>
+#include "MagickThreads.h"
+#include "MagickCache.h"
+#include "MagickPixels.h"
+#include "MagickAbort.h"
+#include "ArenaTimer.h"
+#include "ArenaWarp.h"
 
 #define kParamOpenMP "openmp"
 #define kParamOpenMPLabel "OpenMP"
@@ -45,43 +52,61 @@ class MagickPluginHelperBase
 {
 public:
 
-    MagickPluginHelperBase(OfxImageEffectHandle handle);
+    MagickPluginHelperBase(OfxImageEffectHandle handle, const std::string &pluginID);
     virtual void changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName) OVERRIDE;
-    static OFX::PageParamDescriptor* describeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context);
+    static OFX::PageParamDescriptor* describeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context, bool supportsTiles = false);
     static void describeInContextEnd(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context, OFX::PageParamDescriptor* page);
 
+    /* How far (in pixels, at renderScale) from an output pixel the effect reads the source.
+     * Only used by tiled plugins, the render window is grown by this much before import. */
+    virtual int getSupportRadius(double /*time*/, const OfxPointD &/*renderScale*/) { return 0; }
+
+    /* Expensive effects can opt in to the result cache: add every parameter value the
+     * effect depends on at args.time to key and return true. */
+    virtual bool getCacheKey(const OFX::RenderArguments &/*args*/, MagickCacheKey &/*key*/) { return false; }
+
+    /* Return true if the effect parameters are neutral at args.time, the source is then passed through. */
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &/*args*/) { return false; }
+
+    /* Effects with a native implementation render args.renderWindow of dstImg straight from srcImg and return true,
+     * edge is the virtual pixel method. Returning false renders through ImageMagick. */
+    virtual bool renderNative(const OFX::RenderArguments &/*args*/, const OFX::Image */*srcImg*/, OFX::Image */*dstImg*/, ArenaWarpEdgeEnum /*edge*/) { return false; }
+
 protected:
     OFX::Clip *_dstClip;
     OFX::Clip *_srcClip;
     OFX::BooleanParam *_enableMP;
     OFX::BooleanParam *_matte;
     OFX::ChoiceParam *_vpixel;
+    std::string _plugin;
     int _renderscale;
 };
 
-template <int SupportsRenderScale>
+template <int SupportsRenderScale, int SupportsTiles = 0>
 class MagickPluginHelper
     : public MagickPluginHelperBase
 {
 public:
 
-    MagickPluginHelper(OfxImageEffectHandle handle)
-        : MagickPluginHelperBase(handle)
+    MagickPluginHelper(OfxImageEffectHandle handle, const std::string &pluginID)
+        : MagickPluginHelperBase(handle, pluginID)
     {
         _renderscale = SupportsRenderScale;
     }
 
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
     virtual void render(const OFX::RenderArguments &args, Magick::Image &image) = 0;
     static OFX::PageParamDescriptor* describeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context)
     {
-        return MagickPluginHelperBase::describeInContextBegin(desc, context);
+        return MagickPluginHelperBase::describeInContextBegin(desc, context, SupportsTiles);
     }
 };
 
-template <int SupportsRenderScale>
-void MagickPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments &args)
+template <int SupportsRenderScale, int SupportsTiles>
+void MagickPluginHelper<SupportsRenderScale, SupportsTiles>::render(const OFX::RenderArguments &args)
 {
     // render scale
     if (!SupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
@@ -89,6 +114,8 @@ void MagickPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments
         return;
     }
 
+    ArenaTimer timer(_plugin.c_str(), "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!_srcClip) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -133,14 +160,17 @@ void MagickPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments
 
     // get bit depth
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
+    if ((dstBitDepth != OFX::eBitDepthUByte && dstBitDepth != OFX::eBitDepthUShort &&
+         dstBitDepth != OFX::eBitDepthHalf && dstBitDepth != OFX::eBitDepthFloat) ||
+        (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
 
     // get pixel component
     OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA|| (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
+    if ((dstComponents != OFX::ePixelComponentRGBA && dstComponents != OFX::ePixelComponentRGB && dstComponents != OFX::ePixelComponentAlpha) ||
+        (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -153,9 +183,19 @@ void MagickPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments
         return;
     }
 
+    // get the area to process, tiled plugins only need the render window plus the effect support
+    OfxRectI rect = args.renderWindow;
+    if (SupportsTiles) {
+        int radius = getSupportRadius(args.time, args.renderScale);
+        rect.x1 = std::max(rect.x1 - radius, srcRod.x1);
+        rect.y1 = std::max(rect.y1 - radius, srcRod.y1);
+        rect.x2 = std::min(rect.x2 + radius, srcRod.x2);
+        rect.y2 = std::min(rect.y2 + radius, srcRod.y2);
+    }
+
     // get image size
-    int width = args.renderWindow.x2 - args.renderWindow.x1;
-    int height = args.renderWindow.y2 - args.renderWindow.y1;
+    int width = rect.x2 - rect.x1;
+    int height = rect.y2 - rect.y1;
 
     // params
     bool enableMP, matte;
@@ -164,21 +204,42 @@ void MagickPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments
     _matte->getValueAtTime(args.time, matte);
     _vpixel->getValueAtTime(args.time, vpixel);
 
-    // OpenMP
-#ifndef DISABLE_OPENMP
-    unsigned int threads = 1;
-    if (_hasMP && enableMP) {
-        threads = OFX::MultiThread::getNumCPUs();
+    // native effects skip ImageMagick, the matte option and exotic virtual pixel methods still need it
+    ArenaWarpEdgeEnum edge;
+    if (!matte && _srcClip && _srcClip->isConnected() && arenaWarpEdge(vpixel, edge)) {
+        timer.next("native");
+        if (renderNative(args, srcImg.get(), dstImg.get(), edge)) {
+            return;
+        }
     }
-    Magick::ResourceLimits::thread(threads);
-#endif
 
-    // render
-    Magick::Image image(Magick::Geometry(width, height), Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(width, height), Magick::Color("rgba(0,0,0,1)"));
+    // cached result
+    timer.next("cache");
+    MagickCacheKey key;
+    bool cacheable = getCacheKey(args, key);
+    if (cacheable) {
+        key.add(_plugin);
+        key.add(matte);
+        key.add(vpixel);
+        key.add(args.renderScale.x);
+        key.add(args.renderScale.y);
+        key.add(rect);
+        key.add(args.renderWindow);
+        key.addPixels(srcImg.get(), rect);
+        if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get())) {
+            return;
+        }
+    }
+
+    // OpenMP
+    MagickThreadBudget threads(_hasMP && enableMP);
+
+    // render, RGB images have no alpha to import so they start out opaque
+    Magick::Image image(Magick::Geometry(width, height), Magick::Color(dstComponents == OFX::ePixelComponentRGB ? "rgba(0,0,0,1)" : "rgba(0,0,0,0)"));
     if (_srcClip && _srcClip->isConnected()) {
-        image.read(width, height, "RGBA", Magick::FloatPixel, (float*)srcImg->getPixelData());
-        image.flip();
+        timer.next("import");
+        magickImportPixels(srcImg.get(), rect, image);
+        timer.next("setup");
         switch (vpixel) {
         case 0:
             image.virtualPixelMethod(Magick::UndefinedVirtualPixelMethod);
@@ -238,23 +299,25 @@ void MagickPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments
             image.matte(true);
 #endif
         }
+        timer.next("effect");
+        MagickAbortMonitor monitor(this, image);
         render(args, image);
-        image.flip();
+    }
+    if (abort()) {
+        return;
     }
     if (_dstClip && _dstClip->isConnected()) {
-        output.composite(image, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(image, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0, 0, args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1, "RGBA", Magick::FloatPixel, (float*)dstImg->getPixelData());
+        timer.next("export");
+        magickExportPixels(image, rect, args.renderWindow, dstImg.get());
+        if (cacheable) {
+            MagickResultCache::store(key, args.renderWindow, dstImg.get());
+        }
     }
 
 }
 
-template <int SupportsRenderScale>
-bool MagickPluginHelper<SupportsRenderScale>::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
+template <int SupportsRenderScale, int SupportsTiles>
+bool MagickPluginHelper<SupportsRenderScale, SupportsTiles>::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
 {
     if (!SupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -269,4 +332,39 @@ bool MagickPluginHelper<SupportsRenderScale>::getRegionOfDefinition(const OFX::R
     return true;
 }
 
+template <int SupportsRenderScale, int SupportsTiles>
+void MagickPluginHelper<SupportsRenderScale, SupportsTiles>::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+    if (!SupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
+    }
+    if (!SupportsTiles || !_srcClip || !_srcClip->isConnected()) {
+        return;
+    }
+    int radius = getSupportRadius(args.time, args.renderScale);
+    OfxRectD roi = args.regionOfInterest;
+    roi.x1 -= radius / args.renderScale.x;
+    roi.y1 -= radius / args.renderScale.y;
+    roi.x2 += radius / args.renderScale.x;
+    roi.y2 += radius / args.renderScale.y;
+    rois.setRegionOfInterest(*_srcClip, roi);
+}
+
+template <int SupportsRenderScale, int SupportsTiles>
+bool MagickPluginHelper<SupportsRenderScale, SupportsTiles>::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!SupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    bool matte = false;
+    _matte->getValueAtTime(args.time, matte);
+    if (!matte && isIdentityEffect(args)) {
+        identityClip = _srcClip;
+        return true;
+    }
+    return false;
+}
+
 #endif // MagickPlugin_h
@@ -0,0 +1,95 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#include "MagickThreads.h"
+#include "ofxsMultiThread.h"
+#include <Magick++.h>
+#include <cstdlib>
+#include <iostream>
+
+static unsigned int _activeRenders = 0;
+static unsigned int _activeMP = 0;
+
+static OFX::MultiThread::Mutex&
+governorMutex()
+{
+    static OFX::MultiThread::Mutex mutex;
+    return mutex;
+}
+
+// total core budget, the number of CPUs unless overridden
+static unsigned int
+budget()
+{
+    static unsigned int total = 0;
+    if (total == 0) {
+        const char *env = std::getenv(kMagickThreadsEnv);
+        int value = env ? std::atoi(env) : 0;
+        total = value > 0 ? (unsigned int)value : OFX::MultiThread::getNumCPUs();
+        if (total == 0) {
+            total = 1;
+        }
+    }
+    return total;
+}
+
+/* ImageMagick thread limit for the renders currently active, must be called with the mutex held.
+ * Any render with OpenMP disabled keeps the limit at one thread, otherwise the budget is split
+ * evenly between the OpenMP renders. */
+static unsigned int
+threadLimit()
+{
+    if (_activeMP == 0 || _activeMP < _activeRenders) {
+        return 1;
+    }
+    unsigned int total = budget();
+    return total <= _activeMP ? 1 : total / _activeMP;
+}
+
+// must be called with the mutex held
+static void
+applyLimit()
+{
+#ifndef DISABLE_OPENMP
+    unsigned int threads = threadLimit();
+    Magick::ResourceLimits::thread(threads);
+#ifdef DEBUG
+    std::cout << "Magick thread limit " << threads << " of " << budget() << " cores (" << _activeRenders << " active renders)" << std::endl;
+#endif
+#endif
+}
+
+MagickThreadBudget::MagickThreadBudget(bool enableMP)
+    : _mp(enableMP)
+{
+    OFX::MultiThread::AutoMutex lock(governorMutex());
+    ++_activeRenders;
+    if (_mp) {
+        ++_activeMP;
+    }
+    applyLimit();
+}
+
+MagickThreadBudget::~MagickThreadBudget()
+{
+    OFX::MultiThread::AutoMutex lock(governorMutex());
+    --_activeRenders;
+    if (_mp) {
+        --_activeMP;
+    }
+    applyLimit();
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of openfx-arena <https://github.com/olear/openfx-arena>,
+ * Copyright (C) 2016 INRIA
+ *
+ * openfx-arena is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * openfx-arena is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+*/
+
+#ifndef MagickThreads_h
+#define MagickThreads_h
+
+// Override the core budget shared by all ImageMagick renders in the bundle
+#define kMagickThreadsEnv "ARENA_MAGICK_THREADS"
+
+/* Bundle-wide thread governor for ImageMagick renders.
+ *
+ * The ImageMagick thread limit is the only thread setting ImageMagick honours and it is process-wide,
+ * so renders must not set it from their own OpenMP toggle. Instead each render holds a MagickThreadBudget
+ * for its duration and the governor sets the limit for all active renders whenever one starts or ends:
+ * one thread while any render has OpenMP disabled, else the core budget split evenly between the renders.
+ * ImageMagick reads the limit at every parallel loop, so running renders follow the change.
+ */
+class MagickThreadBudget
+{
+public:
+    explicit MagickThreadBudget(bool enableMP);
+    ~MagickThreadBudget();
+
+private:
+    MagickThreadBudget(const MagickThreadBudget&);
+    MagickThreadBudget& operator=(const MagickThreadBudget&);
+
+    bool _mp;
+};
+
+#endif // MagickThreads_h
@@ -18,14 +18,22 @@
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
+#include "ArenaTimer.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstring>
 #include <iostream>
-#include <Magick++.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define kPluginName "ModulateOFX"
 #define kPluginGrouping "Extra/Color"
 #define kPluginIdentifier "net.fxarena.openfx.Modulate"
 #define kPluginVersionMajor 1
-#define kPluginVersionMinor 2
+#define kPluginVersionMinor 3
 
 #define kParamSaturation "saturation"
 #define kParamSaturationLabel "Saturation"
@@ -42,17 +50,7 @@
 #define kParamBrightnessHint "Adjust brightness (%)"
 #define kParamBrightnessDefault 100
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault true
-
-#define kParamOpenCL "opencl"
-#define kParamOpenCLLabel "OpenCL"
-#define kParamOpenCLHint "Enable/Disable OpenCL. This will enable the plugin to use supported GPU(s) for better performance."
-#define kParamOpenCLDefault false
-
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
@@ -60,8 +58,243 @@
 
 using namespace OFX;
 
-static bool _hasOpenMP = false;
-static bool _hasOpenCL = false;
+/* The HSL modulation of ImageMagick (ModulateImage with its default HSL colorspace): the hue is rotated by
+ * (hue - 100) / 200 turns, saturation and lightness are scaled by their percentage. Values are not clamped. */
+struct ModulateValues
+{
+    float hue;        // in turns
+    float saturation;
+    float lightness;
+};
+
+static inline void
+modulatePixel(float &r, float &g, float &b, const ModulateValues &values)
+{
+    // RGB to HSL, as ConvertRGBToHSL
+    float max = std::max(r, std::max(g, b));
+    float min = std::min(r, std::min(g, b));
+    float c = max - min;
+    float l = (max + min) * 0.5f;
+    float h = 0.f;
+    float s = 0.f;
+    if (c > 0.f) {
+        if (max == r) {
+            h = (g - b) / c + (g < b ? 6.f : 0.f);
+        } else if (max == g) {
+            h = 2.f + (b - r) / c;
+        } else {
+            h = 4.f + (r - g) / c;
+        }
+        h *= 1.f / 6.f;
+        float d = l <= 0.5f ? 2.f * l : 2.f - 2.f * l;
+        s = d != 0.f ? c / d : 0.f;
+    }
+
+    h += values.hue;
+    h -= std::floor(h);
+    s *= values.saturation;
+    l *= values.lightness;
+
+    // HSL to RGB, as ConvertHSLToRGB written without its six sectors: l - a * clamp(min(k - 3, 9 - k), -1, 1)
+    float a = s * std::min(l, 1.f - l);
+    float k[3] = { 12.f * h, 12.f * h + 8.f, 12.f * h + 4.f };
+    float *out[3] = { &r, &g, &b };
+    for (int i = 0; i < 3; ++i) {
+        if (k[i] >= 12.f) {
+            k[i] -= 12.f;
+        }
+        *out[i] = l - a * std::max(-1.f, std::min(std::min(k[i] - 3.f, 9.f - k[i]), 1.f));
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128
+modulateSelect(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// floor of values well inside the int range, SSE2 has no rounding instruction
+static inline __m128
+modulateFloor(__m128 v)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.f)));
+}
+
+static inline __m128
+modulateChannel(__m128 k, __m128 l, __m128 a)
+{
+    k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpge_ps(k, _mm_set1_ps(12.f)), _mm_set1_ps(12.f)));
+    __m128 t = _mm_min_ps(_mm_sub_ps(k, _mm_set1_ps(3.f)), _mm_sub_ps(_mm_set1_ps(9.f), k));
+    t = _mm_max_ps(_mm_set1_ps(-1.f), _mm_min_ps(t, _mm_set1_ps(1.f)));
+    return _mm_sub_ps(l, _mm_mul_ps(a, t));
+}
+
+// modulatePixel on four pixels, one per lane
+static inline void
+modulatePixels(__m128 &r, __m128 &g, __m128 &b, const ModulateValues &values)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 two = _mm_set1_ps(2.f);
+    __m128 max = _mm_max_ps(r, _mm_max_ps(g, b));
+    __m128 min = _mm_min_ps(r, _mm_min_ps(g, b));
+    __m128 c = _mm_sub_ps(max, min);
+    __m128 l = _mm_mul_ps(_mm_add_ps(max, min), _mm_set1_ps(0.5f));
+    __m128 chroma = _mm_cmpgt_ps(c, zero);
+    __m128 rc = _mm_and_ps(chroma, _mm_div_ps(one, c));
+
+    __m128 isR = _mm_cmpeq_ps(max, r);
+    __m128 isG = _mm_andnot_ps(isR, _mm_cmpeq_ps(max, g));
+    __m128 hR = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(g, b), rc), _mm_and_ps(_mm_cmplt_ps(g, b), _mm_set1_ps(6.f)));
+    __m128 hG = _mm_add_ps(two, _mm_mul_ps(_mm_sub_ps(b, r), rc));
+    __m128 hB = _mm_add_ps(_mm_set1_ps(4.f), _mm_mul_ps(_mm_sub_ps(r, g), rc));
+    __m128 h = modulateSelect(isR, hR, modulateSelect(isG, hG, hB));
+    h = _mm_and_ps(chroma, _mm_mul_ps(h, _mm_set1_ps(1.f / 6.f)));
+    __m128 d = modulateSelect(_mm_cmple_ps(l, _mm_set1_ps(0.5f)), _mm_mul_ps(two, l), _mm_sub_ps(two, _mm_mul_ps(two, l)));
+    __m128 s = _mm_and_ps(_mm_cmpneq_ps(d, zero), _mm_div_ps(c, d));
+
+    h = _mm_add_ps(h, _mm_set1_ps(values.hue));
+    h = _mm_sub_ps(h, modulateFloor(h));
+    s = _mm_mul_ps(s, _mm_set1_ps(values.saturation));
+    l = _mm_mul_ps(l, _mm_set1_ps(values.lightness));
+
+    __m128 a = _mm_mul_ps(s, _mm_min_ps(l, _mm_sub_ps(one, l)));
+    __m128 k = _mm_mul_ps(h, _mm_set1_ps(12.f));
+    r = modulateChannel(k, l, a);
+    g = modulateChannel(_mm_add_ps(k, _mm_set1_ps(8.f)), l, a);
+    b = modulateChannel(_mm_add_ps(k, _mm_set1_ps(4.f)), l, a);
+}
+#endif
+
+/* Modulate count premultiplied RGBA float pixels in place, colours are unpremultiplied around the modulation.
+ * Four pixels at a time with SSE2 when available. */
+static void
+modulateRow(float *rgba, int count, const ModulateValues &values)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    for (; x + 4 <= count; x += 4, rgba += 16) {
+        __m128 r = _mm_loadu_ps(rgba);
+        __m128 g = _mm_loadu_ps(rgba + 4);
+        __m128 b = _mm_loadu_ps(rgba + 8);
+        __m128 a = _mm_loadu_ps(rgba + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        // transparent pixels are modulated as they are
+        __m128 opaque = _mm_cmpgt_ps(a, zero);
+        __m128 scale = modulateSelect(opaque, a, one);
+        __m128 inv = modulateSelect(opaque, _mm_div_ps(one, a), one);
+        r = _mm_mul_ps(r, inv);
+        g = _mm_mul_ps(g, inv);
+        b = _mm_mul_ps(b, inv);
+        modulatePixels(r, g, b, values);
+        r = _mm_mul_ps(r, scale);
+        g = _mm_mul_ps(g, scale);
+        b = _mm_mul_ps(b, scale);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(rgba, r);
+        _mm_storeu_ps(rgba + 4, g);
+        _mm_storeu_ps(rgba + 8, b);
+        _mm_storeu_ps(rgba + 12, a);
+    }
+#endif
+    for (; x < count; ++x, rgba += 4) {
+        float alpha = rgba[3];
+        float scale = alpha > 0.f ? alpha : 1.f;
+        float r = rgba[0] / scale;
+        float g = rgba[1] / scale;
+        float b = rgba[2] / scale;
+        modulatePixel(r, g, b, values);
+        rgba[0] = r * scale;
+        rgba[1] = g * scale;
+        rgba[2] = b * scale;
+    }
+}
+
+template <class PIX, int nComponents, int maxValue>
+class ModulateProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    ModulateProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg,
+                      const OfxRectI &window, const ModulateValues &values)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _values(values)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        int width = _window.x2 - _window.x1;
+        OfxRectI srcBounds = _srcImg->getBounds();
+        int x1 = std::max(_window.x1, srcBounds.x1);
+        int x2 = std::min(_window.x2, srcBounds.x2);
+        // RGBA float pixels are modulated in the output, others in a float row
+        bool direct = maxValue == 1 && nComponents == 4;
+        std::vector<float> row(direct ? 0 : width * 4);
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            PIX *dst = (PIX*)_dstImg->getPixelAddress(_window.x1, y);
+            if (y < srcBounds.y1 || y >= srcBounds.y2 || x1 >= x2) {
+                std::memset(dst, 0, width * nComponents * sizeof(PIX));
+                continue;
+            }
+            // pixels outside the source are transparent
+            std::memset(dst, 0, (x1 - _window.x1) * nComponents * sizeof(PIX));
+            std::memset(dst + (x2 - _window.x1) * nComponents, 0, (_window.x2 - x2) * nComponents * sizeof(PIX));
+            const PIX *src = (const PIX*)_srcImg->getPixelAddress(x1, y);
+            PIX *out = dst + (x1 - _window.x1) * nComponents;
+            int count = x2 - x1;
+            if (direct) {
+                std::memcpy(out, src, count * 4 * sizeof(float));
+                modulateRow((float*)out, count, _values);
+                continue;
+            }
+            for (int x = 0; x < count; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    row[x * 4 + c] = (float)src[x * nComponents + c] / maxValue;
+                }
+                row[x * 4 + 3] = nComponents == 4 ? (float)src[x * nComponents + 3] / maxValue : 1.f;
+            }
+            modulateRow(&row[0], count, _values);
+            for (int x = 0; x < count; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    out[x * nComponents + c] = convert(row[x * 4 + c]);
+                }
+                if (nComponents == 4) {
+                    out[x * nComponents + 3] = src[x * nComponents + 3];
+                }
+            }
+        }
+    }
+
+private:
+    static PIX convert(float v)
+    {
+        if (maxValue == 1) {
+            return (PIX)v;
+        }
+        return (PIX)(std::max(0.f, std::min(1.f, v)) * maxValue + 0.5f);
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    ModulateValues _values;
+};
 
 class ModulatePlugin : public OFX::ImageEffect
 {
@@ -70,40 +303,52 @@ public:
     virtual ~ModulatePlugin();
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
 private:
+    template <class PIX, int nComponents, int maxValue>
+    void modulateImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, const ModulateValues &values);
+
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
     OFX::DoubleParam *brightness_;
     OFX::DoubleParam *hue_;
     OFX::DoubleParam *saturation_;
-    OFX::BooleanParam *enableOpenMP_;
-    OFX::BooleanParam *enableOpenCL_;
 };
 
 ModulatePlugin::ModulatePlugin(OfxImageEffectHandle handle)
 : OFX::ImageEffect(handle)
 , dstClip_(NULL)
 , srcClip_(NULL)
+, brightness_(NULL)
+, hue_(NULL)
+, saturation_(NULL)
 {
-    Magick::InitializeMagick(NULL);
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB));
     srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(srcClip_ && srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(srcClip_ && (srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentRGB));
 
     brightness_ = fetchDoubleParam(kParamBrightness);
     hue_ = fetchDoubleParam(kParamHue);
     saturation_ = fetchDoubleParam(kParamSaturation);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
-    enableOpenCL_ = fetchBooleanParam(kParamOpenCL);
 
-    assert(brightness_ && hue_ && saturation_ && enableOpenMP_ && enableOpenCL_);
+    assert(brightness_ && hue_ && saturation_);
 }
 
 ModulatePlugin::~ModulatePlugin()
 {
 }
 
+template <class PIX, int nComponents, int maxValue>
+void ModulatePlugin::modulateImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, const ModulateValues &values)
+{
+    ModulateProcessor<PIX, nComponents, maxValue> processor(*this, srcImg, dstImg, window, values);
+    unsigned int nThreads = std::max(1u, std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1)));
+    processor.multiThread(nThreads);
+}
+
 void ModulatePlugin::render(const OFX::RenderArguments &args)
 {
     // render scale
@@ -112,6 +357,8 @@ void ModulatePlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!srcClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -119,10 +366,7 @@ void ModulatePlugin::render(const OFX::RenderArguments &args)
     }
     assert(srcClip_);
     OFX::auto_ptr<const OFX::Image> srcImg(srcClip_->fetchImage(args.time));
-    OfxRectI srcRod,srcBounds;
     if (srcImg.get()) {
-        srcRod = srcImg->getRegionOfDefinition();
-        srcBounds = srcImg->getBounds();
         if (srcImg->getRenderScale().x != args.renderScale.x ||
             srcImg->getRenderScale().y != args.renderScale.y ||
             srcImg->getField() != args.fieldToRender) {
@@ -132,6 +376,7 @@ void ModulatePlugin::render(const OFX::RenderArguments &args)
         }
     } else {
         OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
     }
 
     // get dest clip
@@ -153,16 +398,10 @@ void ModulatePlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get bit depth
+    // get bit depth and pixel component
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
-        OFX::throwSuiteStatusException(kOfxStatErrFormat);
-        return;
-    }
-
-    // get pixel component
-    OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA || (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
+    OFX::PixelComponentEnum dstComponents = dstImg->getPixelComponents();
+    if (dstBitDepth != srcImg->getPixelDepth() || dstComponents != srcImg->getPixelComponents()) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -177,58 +416,42 @@ void ModulatePlugin::render(const OFX::RenderArguments &args)
 
     // get params
     double brightness, hue, saturation;
-    bool enableOpenMP = false;
-    bool enableOpenCL = false;
     brightness_->getValueAtTime(args.time, brightness);
     hue_->getValueAtTime(args.time, hue);
     saturation_->getValueAtTime(args.time, saturation);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
-    enableOpenCL_->getValueAtTime(args.time, enableOpenCL);
-
-    // setup
-    int width = srcRod.x2-srcRod.x1;
-    int height = srcRod.y2-srcRod.y1;
-
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
-
-    // OpenCL
-#ifndef LEGACYIM
-    if (_hasOpenCL && enableOpenCL) {
-#if MagickLibVersion >= 0x700
-        Magick::EnableOpenCL();
-#else
-        Magick::EnableOpenCL(true);
-#endif
-    }
-    else if (_hasOpenCL && !enableOpenCL)
-        Magick::DisableOpenCL();
-#endif
-
-    // read image
-    Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,1)"));
-    if (srcClip_ && srcClip_->isConnected())
-        image.read(width,height,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
-
-    // modulate
-    image.modulate(brightness,saturation,hue);
-
-    // return image
-    if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(image, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(image, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+    ModulateValues values;
+    values.hue = (float)(std::fmod(hue - 100., 200.) / 200.);
+    values.saturation = (float)(saturation * 0.01);
+    values.lightness = (float)(brightness * 0.01);
+
+    // modulate is a point operation, only the render window is read
+    timer.next("modulate");
+    int nComponents = dstImg->getPixelComponentCount();
+    switch (dstBitDepth) {
+    case OFX::eBitDepthUByte:
+        if (nComponents == 4) {
+            modulateImage<unsigned char, 4, 255>(srcImg.get(), dstImg.get(), args.renderWindow, values);
+        } else {
+            modulateImage<unsigned char, 3, 255>(srcImg.get(), dstImg.get(), args.renderWindow, values);
+        }
+        break;
+    case OFX::eBitDepthUShort:
+        if (nComponents == 4) {
+            modulateImage<unsigned short, 4, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, values);
+        } else {
+            modulateImage<unsigned short, 3, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, values);
+        }
+        break;
+    case OFX::eBitDepthFloat:
+        if (nComponents == 4) {
+            modulateImage<float, 4, 1>(srcImg.get(), dstImg.get(), args.renderWindow, values);
+        } else {
+            modulateImage<float, 3, 1>(srcImg.get(), dstImg.get(), args.renderWindow, values);
+        }
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        return;
     }
 }
 
@@ -247,6 +470,23 @@ bool ModulatePlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArgument
     return true;
 }
 
+bool ModulatePlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!kSupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    double brightness, hue, saturation;
+    brightness_->getValueAtTime(args.time, brightness);
+    hue_->getValueAtTime(args.time, hue);
+    saturation_->getValueAtTime(args.time, saturation);
+    if (brightness == 100. && hue == 100. && saturation == 100.) {
+        identityClip = srcClip_;
+        return true;
+    }
+    return false;
+}
+
 mDeclarePluginFactory(ModulatePluginFactory, {}, {});
 
 /** @brief The basic describe function, passed a plugin descriptor */
@@ -262,6 +502,8 @@ void ModulatePluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     desc.setSupportsTiles(kSupportsTiles);
@@ -275,15 +517,10 @@ void ModulatePluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void ModulatePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-    if (features.find("OpenCL") != std::string::npos)
-        _hasOpenCL = true;
-
     // create the mandated source clip
     ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
@@ -291,6 +528,7 @@ void ModulatePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc,
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make some pages
@@ -320,28 +558,6 @@ void ModulatePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc,
         param->setRange(0, 200);
         param->setDisplayRange(0, 200);
         param->setDefault(kParamHueDefault);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
-    }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        page->addChild(*param);
-    }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenCL);
-        param->setLabel(kParamOpenCLLabel);
-        param->setHint(kParamOpenCLHint);
-        param->setDefault(kParamOpenCLDefault);
-        param->setAnimates(false);
-        if (!_hasOpenCL)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
     }
 }
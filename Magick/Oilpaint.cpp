@@ -18,35 +18,277 @@
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
-#include <Magick++.h>
-#include <iostream>
-#include <stdint.h>
+#include "MagickCache.h"
+#include "ArenaTimer.h"
+#include <algorithm>
+#include <vector>
 #include <cmath>
+#include <cstring>
+#include <iostream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define kPluginName "OilpaintOFX"
 #define kPluginGrouping "Extra/Filter"
 #define kPluginIdentifier "net.fxarena.openfx.Oilpaint"
 #define kPluginVersionMajor 2
-#define kPluginVersionMinor 1
+#define kPluginVersionMinor 2
 
 #define kParamRadius "radius"
 #define kParamRadiusLabel "Radius"
 #define kParamRadiusHint "Adjust radius"
 #define kParamRadiusDefault 1
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault false
+// intensity levels of the histogram, as NumberPaintBins in ImageMagick
+#define kOilpaintBins 256
+// output columns painted at once by a thread
+#define kOilpaintBand 256
 
 using namespace OFX;
-static bool _hasOpenMP = false;
+
+/* Oil paint as ImageMagick's OilPaintImage: every pixel takes the most common intensity level of the
+ * (2 * radius + 1)^2 square around it, here as the mean colour of the pixels at that level.
+ *
+ * The histogram of the square is kept per source column (its 2 * radius + 1 rows) and slid along:
+ * moving down a row adds one pixel to and removes one pixel from each column histogram, moving right
+ * adds one column histogram to the square and removes another. The cost per pixel does not depend on
+ * the radius. Columns also sum the colours per level (stored level by level so the columns of a level
+ * are contiguous), the colour of the current level is summed from them only when the level changes.
+ */
+
+// intensity level of a pixel, ScaleQuantumToChar(GetPixelIntensity()) with the default Rec. 709 weights
+static inline int
+oilpaintBin(const float *rgba)
+{
+    float intensity = 0.212656f * rgba[0] + 0.715158f * rgba[1] + 0.072186f * rgba[2];
+    return (int)(std::max(0.f, std::min(intensity, 1.f)) * 255.f + 0.5f);
+}
+
+// the first most common level of histogram
+static inline int
+oilpaintMode(const int *histogram)
+{
+    int mode = 0;
+    for (int i = 1; i < kOilpaintBins; ++i) {
+        if (histogram[i] > histogram[mode]) {
+            mode = i;
+        }
+    }
+    return mode;
+}
+
+// histogram += add - sub, returns the first most common level of the result
+static inline int
+oilpaintSlide(int *histogram, const int *add, const int *sub)
+{
+#ifdef __SSE2__
+    // each lane keeps its most common level, the lanes are compared at the end
+    __m128i best = _mm_set1_epi32(-1);
+    __m128i bestLevel = _mm_setzero_si128();
+    __m128i level = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i four = _mm_set1_epi32(4);
+    for (int i = 0; i < kOilpaintBins; i += 4) {
+        __m128i h = _mm_loadu_si128((const __m128i*)(histogram + i));
+        h = _mm_add_epi32(h, _mm_loadu_si128((const __m128i*)(add + i)));
+        h = _mm_sub_epi32(h, _mm_loadu_si128((const __m128i*)(sub + i)));
+        _mm_storeu_si128((__m128i*)(histogram + i), h);
+        __m128i greater = _mm_cmpgt_epi32(h, best);
+        best = _mm_or_si128(_mm_and_si128(greater, h), _mm_andnot_si128(greater, best));
+        bestLevel = _mm_or_si128(_mm_and_si128(greater, level), _mm_andnot_si128(greater, bestLevel));
+        level = _mm_add_epi32(level, four);
+    }
+    int counts[4], levels[4];
+    _mm_storeu_si128((__m128i*)counts, best);
+    _mm_storeu_si128((__m128i*)levels, bestLevel);
+    int mode = 0;
+    for (int i = 1; i < 4; ++i) {
+        if (counts[i] > counts[mode] || (counts[i] == counts[mode] && levels[i] < levels[mode])) {
+            mode = i;
+        }
+    }
+    return levels[mode];
+#else
+    int mode = 0;
+    for (int i = 0; i < kOilpaintBins; ++i) {
+        histogram[i] += add[i] - sub[i];
+        if (histogram[i] > histogram[mode]) {
+            mode = i;
+        }
+    }
+    return mode;
+#endif
+}
+
+template <class PIX, int nComponents, int maxValue>
+class OilpaintProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    OilpaintProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg,
+                      const OfxRectI &window, int radius)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _radius(radius)
+    {
+    }
+
+    // each thread paints a strip of rows, its column histograms start from the rows around the first one
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        int width = _window.x2 - _window.x1;
+        if (y1 >= y2) {
+            return;
+        }
+        OfxRectI bounds = _srcImg->getBounds();
+        if (bounds.x1 >= bounds.x2 || bounds.y1 >= bounds.y2) {
+            for (int y = y1; y < y2; ++y) {
+                std::memset(_dstImg->getPixelAddress(_window.x1, y), 0, width * nComponents * sizeof(PIX));
+            }
+            return;
+        }
+
+        // bands of columns keep the column histograms in the cache
+        int columns = std::min(width, kOilpaintBand) + 2 * _radius;
+        std::vector<int> counts((size_t)columns * kOilpaintBins);
+        std::vector<float> sums((size_t)columns * kOilpaintBins * 4);
+        std::vector<float> rgba(columns * 4);
+        std::vector<int> bins(columns);
+        for (int x1 = _window.x1; x1 < _window.x2; x1 += kOilpaintBand) {
+            int x2 = std::min(x1 + kOilpaintBand, _window.x2);
+            if (!paintBand(x1, x2, y1, y2, bounds, rgba, bins, counts, sums)) {
+                return;
+            }
+        }
+    }
+
+private:
+    // paint columns x1 to x2 of rows y1 to y2, false if the render was aborted
+    bool paintBand(int x1, int x2, int y1, int y2, const OfxRectI &bounds, std::vector<float> &rgba, std::vector<int> &bins,
+                   std::vector<int> &counts, std::vector<float> &sums)
+    {
+        int size = 2 * _radius + 1;
+        int width = x2 - x1;
+        int columns = width + 2 * _radius;
+        std::fill(counts.begin(), counts.begin() + (size_t)columns * kOilpaintBins, 0);
+        std::fill(sums.begin(), sums.begin() + (size_t)columns * kOilpaintBins * 4, 0.f);
+        int histogram[kOilpaintBins];
+
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return false;
+            }
+            if (y == y1) {
+                for (int row = y - _radius; row <= y + _radius; ++row) {
+                    addRow(row, 1, x1 - _radius, columns, bounds, rgba, bins, counts, sums);
+                }
+            } else {
+                addRow(y - _radius - 1, -1, x1 - _radius, columns, bounds, rgba, bins, counts, sums);
+                addRow(y + _radius, 1, x1 - _radius, columns, bounds, rgba, bins, counts, sums);
+            }
+
+            std::memset(histogram, 0, sizeof(histogram));
+            for (int c = 0; c < size; ++c) {
+                for (int i = 0; i < kOilpaintBins; ++i) {
+                    histogram[i] += counts[(size_t)c * kOilpaintBins + i];
+                }
+            }
+            PIX *dst = (PIX*)_dstImg->getPixelAddress(x1, y);
+            int mode = -1;
+            float colour[4] = { 0.f, 0.f, 0.f, 0.f };
+            for (int x = 0; x < width; ++x, dst += nComponents) {
+                int level;
+                if (x > 0) {
+                    level = oilpaintSlide(histogram, &counts[(size_t)(x + size - 1) * kOilpaintBins], &counts[(size_t)(x - 1) * kOilpaintBins]);
+                    if (level == mode) {
+                        const float *add = &sums[((size_t)level * columns + x + size - 1) * 4];
+                        const float *sub = &sums[((size_t)level * columns + x - 1) * 4];
+                        for (int k = 0; k < 4; ++k) {
+                            colour[k] += add[k] - sub[k];
+                        }
+                    }
+                } else {
+                    level = oilpaintMode(histogram);
+                }
+                if (level != mode) {
+                    mode = level;
+                    for (int k = 0; k < 4; ++k) {
+                        colour[k] = 0.f;
+                    }
+                    const float *sum = &sums[((size_t)level * columns + x) * 4];
+                    for (int i = 0; i < size * 4; i += 4) {
+                        for (int k = 0; k < 4; ++k) {
+                            colour[k] += sum[i + k];
+                        }
+                    }
+                }
+                float scale = 1.f / histogram[level];
+                for (int k = 0; k < nComponents; ++k) {
+                    dst[k] = convert(colour[k] * scale);
+                }
+            }
+        }
+        return true;
+    }
+
+    // add (or remove, sign -1) row of the source to the histograms of columns from x1, pixels outside the source repeat its edges
+    void addRow(int row, int sign, int x1, int columns, const OfxRectI &bounds, std::vector<float> &rgba, std::vector<int> &bins,
+                std::vector<int> &counts, std::vector<float> &sums)
+    {
+        row = std::max(bounds.y1, std::min(row, bounds.y2 - 1));
+        const PIX *src = (const PIX*)_srcImg->getPixelAddress(bounds.x1, row);
+        for (int c = 0; c < columns; ++c) {
+            int x = std::max(bounds.x1, std::min(x1 + c, bounds.x2 - 1));
+            const PIX *pix = src + (size_t)(x - bounds.x1) * nComponents;
+            float *out = &rgba[c * 4];
+            for (int k = 0; k < 3; ++k) {
+                out[k] = (float)pix[k] / maxValue;
+            }
+            out[3] = nComponents == 4 ? (float)pix[3] / maxValue : 1.f;
+            bins[c] = oilpaintBin(out);
+        }
+        for (int c = 0; c < columns; ++c) {
+            size_t bin = (size_t)c * kOilpaintBins + bins[c];
+            float *sum = &sums[((size_t)bins[c] * columns + c) * 4];
+            counts[bin] += sign;
+            if (counts[bin] == 0) {
+                // no float residue left behind in empty levels
+                sum[0] = sum[1] = sum[2] = sum[3] = 0.f;
+            } else {
+                for (int k = 0; k < 4; ++k) {
+                    sum[k] += sign * rgba[c * 4 + k];
+                }
+            }
+        }
+    }
+
+    static PIX convert(float v)
+    {
+        if (maxValue == 1) {
+            return (PIX)v;
+        }
+        return (PIX)(std::max(0.f, std::min(1.f, v)) * maxValue + 0.5f);
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    int _radius;
+};
 
 class OilpaintPlugin : public OFX::ImageEffect
 {
@@ -55,34 +297,56 @@ public:
     virtual ~OilpaintPlugin();
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
 private:
+    // radius in pixels at renderScale, as the window size given to ImageMagick was
+    int getRadius(double time, const OfxPointD &renderScale);
+    template <class PIX, int nComponents, int maxValue>
+    void paintImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, int radius);
+
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
     OFX::DoubleParam *radius_;
-    OFX::BooleanParam *enableOpenMP_;
 };
 
 OilpaintPlugin::OilpaintPlugin(OfxImageEffectHandle handle)
 : OFX::ImageEffect(handle)
 , dstClip_(NULL)
 , srcClip_(NULL)
+, radius_(NULL)
 {
-    Magick::InitializeMagick(NULL);
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB));
     srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(srcClip_ && srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(srcClip_ && (srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentRGB));
 
     radius_ = fetchDoubleParam(kParamRadius);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
 
-    assert(radius_ && enableOpenMP_);
+    assert(radius_);
 }
 
 OilpaintPlugin::~OilpaintPlugin()
 {
 }
 
+int OilpaintPlugin::getRadius(double time, const OfxPointD &renderScale)
+{
+    double radius = 0.;
+    radius_->getValueAtTime(time, radius);
+    return std::max(0, (int)std::floor(radius * renderScale.x + 0.5));
+}
+
+template <class PIX, int nComponents, int maxValue>
+void OilpaintPlugin::paintImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, int radius)
+{
+    OilpaintProcessor<PIX, nComponents, maxValue> processor(*this, srcImg, dstImg, window, radius);
+    unsigned int nThreads = std::max(1u, std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1)));
+    processor.multiThread(nThreads);
+}
+
 void OilpaintPlugin::render(const OFX::RenderArguments &args)
 {
     // render scale
@@ -91,6 +355,8 @@ void OilpaintPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!srcClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -98,10 +364,7 @@ void OilpaintPlugin::render(const OFX::RenderArguments &args)
     }
     assert(srcClip_);
     OFX::auto_ptr<const OFX::Image> srcImg(srcClip_->fetchImage(args.time));
-    OfxRectI srcRod,srcBounds;
     if (srcImg.get()) {
-        srcRod = srcImg->getRegionOfDefinition();
-        srcBounds = srcImg->getBounds();
         if (srcImg->getRenderScale().x != args.renderScale.x ||
             srcImg->getRenderScale().y != args.renderScale.y ||
             srcImg->getField() != args.fieldToRender) {
@@ -111,6 +374,7 @@ void OilpaintPlugin::render(const OFX::RenderArguments &args)
         }
     } else {
         OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
     }
 
     // get dest clip
@@ -132,16 +396,10 @@ void OilpaintPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get bit depth
+    // get bit depth and pixel component
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
-        OFX::throwSuiteStatusException(kOfxStatErrFormat);
-        return;
-    }
-
-    // get pixel component
-    OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA || (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
+    OFX::PixelComponentEnum dstComponents = dstImg->getPixelComponents();
+    if (dstBitDepth != srcImg->getPixelDepth() || dstComponents != srcImg->getPixelComponents()) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -155,44 +413,57 @@ void OilpaintPlugin::render(const OFX::RenderArguments &args)
     }
 
     // get params
-    double radius;
-    bool enableOpenMP = false;
-    radius_->getValueAtTime(args.time, radius);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
-
-    // setup
-    int width = srcRod.x2-srcRod.x1;
-    int height = srcRod.y2-srcRod.y1;
-
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
-
-    // read image
-    Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,1)"));
-    if (srcClip_ && srcClip_->isConnected())
-        image.read(width,height,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
+    int radius = getRadius(args.time, args.renderScale);
+
+    // cached result, the window depends on the source pixels within radius
+    timer.next("cache");
+    OfxRectI area = args.renderWindow;
+    area.x1 -= radius;
+    area.y1 -= radius;
+    area.x2 += radius;
+    area.y2 += radius;
+    MagickCacheKey key;
+    key.add(kPluginIdentifier);
+    key.add(radius);
+    key.add(args.renderWindow);
+    key.addPixels(srcImg.get(), area);
+    if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get()))
+        return;
 
     // oilpaint
-    if (radius>0)
-        image.oilPaint(std::floor(radius * args.renderScale.x + 0.5));
-
-    // return image
-    if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(image, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(image, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+    timer.next("oilpaint");
+    int nComponents = dstImg->getPixelComponentCount();
+    switch (dstBitDepth) {
+    case OFX::eBitDepthUByte:
+        if (nComponents == 4) {
+            paintImage<unsigned char, 4, 255>(srcImg.get(), dstImg.get(), args.renderWindow, radius);
+        } else {
+            paintImage<unsigned char, 3, 255>(srcImg.get(), dstImg.get(), args.renderWindow, radius);
+        }
+        break;
+    case OFX::eBitDepthUShort:
+        if (nComponents == 4) {
+            paintImage<unsigned short, 4, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, radius);
+        } else {
+            paintImage<unsigned short, 3, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, radius);
+        }
+        break;
+    case OFX::eBitDepthFloat:
+        if (nComponents == 4) {
+            paintImage<float, 4, 1>(srcImg.get(), dstImg.get(), args.renderWindow, radius);
+        } else {
+            paintImage<float, 3, 1>(srcImg.get(), dstImg.get(), args.renderWindow, radius);
+        }
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        return;
     }
+
+    if (abort())
+        return;
+
+    MagickResultCache::store(key, args.renderWindow, dstImg.get());
 }
 
 bool OilpaintPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
@@ -210,6 +481,34 @@ bool OilpaintPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArgument
     return true;
 }
 
+void OilpaintPlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+    if (!srcClip_ || !srcClip_->isConnected()) {
+        return;
+    }
+    // the square around every pixel of the window
+    int radius = getRadius(args.time, args.renderScale);
+    OfxRectD roi = args.regionOfInterest;
+    roi.x1 -= radius / args.renderScale.x;
+    roi.y1 -= radius / args.renderScale.y;
+    roi.x2 += radius / args.renderScale.x;
+    roi.y2 += radius / args.renderScale.y;
+    rois.setRegionOfInterest(*srcClip_, roi);
+}
+
+bool OilpaintPlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!kSupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    if (getRadius(args.time, args.renderScale) == 0) {
+        identityClip = srcClip_;
+        return true;
+    }
+    return false;
+}
+
 mDeclarePluginFactory(OilpaintPluginFactory, {}, {});
 
 /** @brief The basic describe function, passed a plugin descriptor */
@@ -225,6 +524,8 @@ void OilpaintPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     desc.setSupportsTiles(kSupportsTiles);
@@ -238,13 +539,10 @@ void OilpaintPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void OilpaintPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-
     // create the mandated source clip
     ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
@@ -252,6 +550,7 @@ void OilpaintPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc,
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make some pages
@@ -263,18 +562,6 @@ void OilpaintPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc,
         param->setRange(0, 1000);
         param->setDisplayRange(0, 50);
         param->setDefault(kParamRadiusDefault);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
-    }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
     }
 }
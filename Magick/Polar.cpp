@@ -19,9 +19,13 @@
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
 #include <Magick++.h>
+#include "MagickThreads.h"
+#include "MagickCache.h"
+#include "ArenaWarp.h"
 #include <iostream>
 #include <stdint.h>
 #include <cmath>
+#include <limits>
 
 #define kPluginName "PolarOFX"
 #define kPluginGrouping "Extra/Distort"
@@ -65,10 +69,98 @@
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 using namespace OFX;
 
 static bool _hasOpenMP = false;
 
+/* The ImageMagick Polar (best fit) or DePolar distortion followed by the rotation, scale to height,
+ * centred extent and flips of this plugin, as one map in pixels relative to the source RoD. */
+class PolarMap
+    : public ArenaWarpMap
+{
+public:
+    PolarMap(int width, int height, bool dePolar, bool flip, double rotate)
+        : _width(width)
+        , _height(height)
+        , _dePolar(dePolar)
+        , _flip(flip)
+        , _radius(std::min(width, height) / 2.)
+        , _gx(0.)
+        , _w0(width)
+        , _h0(height)
+        , _w1(width)
+        , _h1(height)
+        , _ex(0)
+        , _ey(0)
+        , _cx(0.)
+        , _cy(0.)
+        , _cos(1.)
+        , _sin(0.)
+    {
+        if (!dePolar) {
+            // best fit canvas around the polar centre, two pixels larger than the circle
+            _gx = std::floor(-_radius - 0.5);
+            _w0 = _h0 = (int)std::ceil(_radius - _gx + 0.5);
+            _w1 = _w0;
+            _h1 = _h0;
+            if (_h1 > height) {
+                _w1 = (int)std::floor((double)_w0 * height / _h0 + 0.5);
+                _h1 = height;
+            }
+            _ex = _w1 / 2 - width / 2;
+            _ey = _h1 / 2 - height / 2;
+            _cx = _w0 / 2;
+            _cy = _h0 / 2;
+            _cos = std::cos(rotate * M_PI / 180.);
+            _sin = std::sin(rotate * M_PI / 180.);
+        }
+    }
+
+    virtual void map(double x, double y, double &u, double &v) const
+    {
+        // ImageMagick is top-down
+        double px = x + _ex;
+        double py = _height - y + _ey;
+        if (px < 0. || px >= _w1 || py < 0. || py >= _h1 || _radius <= 0.) {
+            u = v = std::numeric_limits<double>::quiet_NaN();
+            return;
+        }
+        double qx = px * _w0 / _w1;
+        double qy = py * _h0 / _h1;
+        double sx, sy;
+        if (_dePolar) {
+            double angle = qx * 2. * M_PI / _width - M_PI;
+            double radius = qy * _radius / _height;
+            sx = radius * std::sin(angle) + _width / 2.;
+            sy = radius * std::cos(angle) + _height / 2.;
+        } else {
+            double dx = qx - _cx;
+            double dy = qy - _cy;
+            qx = _cos * dx + _sin * dy + _cx;
+            qy = _cos * dy - _sin * dx + _cy;
+            dx = _gx + qx;
+            dy = _gx + qy;
+            double angle = std::atan2(dx, dy) / (2. * M_PI);
+            angle -= std::floor(angle + 0.5);
+            sx = angle * _width + _width / 2.;
+            sy = std::sqrt(dx * dx + dy * dy) * _height / _radius;
+        }
+        u = sx;
+        v = _flip ? sy : _height - sy;
+    }
+
+private:
+    int _width, _height;
+    bool _dePolar, _flip;
+    double _radius, _gx;
+    int _w0, _h0, _w1, _h1, _ex, _ey;
+    double _cx, _cy, _cos, _sin;
+};
+
 class PolarPlugin : public OFX::ImageEffect
 {
 public:
@@ -201,14 +293,34 @@ void PolarPlugin::render(const OFX::RenderArguments &args)
     int width = srcRod.x2-srcRod.x1;
     int height = srcRod.y2-srcRod.y1;
 
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
+    // native, the map only depends on the frame size and params so a sequence reuses it
+    ArenaWarpEdgeEnum edge;
+    if (!matte && srcClip_ && srcClip_->isConnected() && arenaWarpEdge(vpixel, edge)) {
+        MagickCacheKey key;
+        key.add(kPluginIdentifier);
+        key.add(width);
+        key.add(height);
+        key.add(dePolar);
+        key.add(polarFlip);
+        key.add(dePolar ? 0. : polarRotate);
+        const ArenaWarpTable *table = ArenaWarpTableCache::acquire(key.value());
+        if (!table) {
+            ArenaWarpTable *newTable = new ArenaWarpTable(width, height);
+            newTable->fill(PolarMap(width, height, dePolar, polarFlip, polarRotate));
+            table = ArenaWarpTableCache::store(key.value(), newTable);
+        }
+        OfxPointI origin;
+        origin.x = srcRod.x1;
+        origin.y = srcRod.y1;
+        bool done = arenaWarp(*this, srcImg.get(), dstImg.get(), args.renderWindow, srcRod, ArenaTableMap(*table, origin), eArenaWarpFilterBilinear, edge);
+        ArenaWarpTableCache::release(table);
+        if (done) {
+            return;
+        }
+    }
 
-    Magick::ResourceLimits::thread(threads);
-#endif
+    // OpenMP
+    MagickThreadBudget threads(_hasOpenMP && enableOpenMP);
 
     // read image
     Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
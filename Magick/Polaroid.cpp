@@ -19,6 +19,9 @@
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
 #include <Magick++.h>
+#include "MagickThreads.h"
+#include "MagickCache.h"
+#include "MagickPixels.h"
 #include <iostream>
 #include <stdint.h>
 #include <cmath>
@@ -212,7 +215,7 @@ void PolaroidPlugin::render(const OFX::RenderArguments &args)
 
     // get bit depth
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
+    if (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth())) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -257,20 +260,28 @@ void PolaroidPlugin::render(const OFX::RenderArguments &args)
     int width = srcRod.x2-srcRod.x1;
     int height = srcRod.y2-srcRod.y1;
 
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
+    // cached result
+    MagickCacheKey key;
+    key.add(kPluginIdentifier);
+    key.add(text);
+    key.add(angle);
+    key.add(fontSize);
+    key.add(fontName);
+    key.add((int)dstBitDepth);
+    key.add(args.renderScale.x);
+    key.add(args.renderScale.y);
+    key.add(args.renderWindow);
+    key.addPixels(srcImg.get(), srcRod);
+    if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get()))
+        return;
 
-    Magick::ResourceLimits::thread(threads);
-#endif
+    // OpenMP
+    MagickThreadBudget threads(_hasOpenMP && enableOpenMP);
 
     // read image
     Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,1)"));
     if (srcClip_ && srcClip_->isConnected())
-        image.read(width,height,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
+        magickImportPixels(srcImg.get(), srcRod, image);
     //if (!image.alpha())
         //image.alpha(true);
 
@@ -281,7 +292,6 @@ void PolaroidPlugin::render(const OFX::RenderArguments &args)
     }
 
     // polaroid
-    image.flip();
     image.fontPointsize(std::floor(fontSize * args.renderScale.x + 0.5));
     image.borderColor("white"); // TODO param
     image.backgroundColor("black"); // TODO param
@@ -292,7 +302,6 @@ void PolaroidPlugin::render(const OFX::RenderArguments &args)
     image.polaroid(text,angle);
 #endif
     image.backgroundColor("none");
-    image.flip();
     std::ostringstream scaleW;
     scaleW << width << "x";
     std::ostringstream scaleH;
@@ -307,13 +316,8 @@ void PolaroidPlugin::render(const OFX::RenderArguments &args)
 
     // return image
     if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(image, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(image, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+        magickExportPixels(image, srcRod, args.renderWindow, dstImg.get());
+        MagickResultCache::store(key, args.renderWindow, dstImg.get());
     }
 }
 
@@ -367,6 +371,9 @@ void PolaroidPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     desc.setSupportsTiles(kSupportsTiles);
@@ -18,16 +18,18 @@
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
-#include <Magick++.h>
-#include <stdint.h>
+#include "ArenaTimer.h"
+#include <algorithm>
+#include <vector>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
 #define kPluginName "ReflectionOFX"
 #define kPluginGrouping "Extra/Transform"
 #define kPluginIdentifier "net.fxarena.openfx.Reflection"
 #define kPluginVersionMajor 3
-#define kPluginVersionMinor 2
+#define kPluginVersionMinor 3
 
 #define kParamSpace "spacing"
 #define kParamSpaceLabel "Reflection spacing"
@@ -54,19 +56,221 @@
 #define kParamMirrorHint "Select mirror type"
 #define kParamMirrorDefault 0
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault false
-
 using namespace OFX;
-static bool _hasOpenMP = false;
+
+/* Every mirror mode maps the columns and the rows independently, so the whole effect is a
+ * source column for each output column and a source row for each output row (-1 is transparent).
+ * Indices are relative to the source RoD, row 0 is the first row of the OFX image as it was
+ * for the ImageMagick version of the plugin, which read the buffer without flipping it. */
+enum ReflectionAxisEnum
+{
+    eReflectionAxisIdentity = 0,
+    eReflectionAxisFlip,
+    eReflectionAxisKeepLow,  // low half kept, flipped image in the high half
+    eReflectionAxisKeepHigh, // high half kept, flipped image in the low half
+    eReflectionAxisFoldLow,  // low half kept and folded over the high half
+    eReflectionAxisFoldHigh  // high half kept and folded over the low half
+};
+
+// source index of i for an axis of n pixels
+static int
+reflectionAxisIndex(int i, int n, ReflectionAxisEnum axis)
+{
+    int half = n / 2;
+    if (i < 0 || i >= n) {
+        return -1;
+    }
+    switch (axis) {
+    case eReflectionAxisIdentity:
+        return i;
+    case eReflectionAxisFlip:
+        return n - 1 - i;
+    case eReflectionAxisKeepLow:
+        return i < half ? i : i < 2 * half ? n - 1 - i : -1;
+    case eReflectionAxisKeepHigh:
+        return i < half ? n - 1 - i : i < 2 * half ? i : -1;
+    case eReflectionAxisFoldLow:
+        return i < half ? i : i < 2 * half ? 2 * half - 1 - i : -1;
+    case eReflectionAxisFoldHigh:
+        return i < half ? 2 * half - 1 - i : i < 2 * half ? i : -1;
+    }
+    return -1;
+}
+
+// column and row mapping of the Mirror choice
+static void
+reflectionMirrorAxes(int mirror, ReflectionAxisEnum &x, ReflectionAxisEnum &y)
+{
+    x = y = eReflectionAxisIdentity;
+    switch (mirror) {
+    case 1: // North
+        y = eReflectionAxisKeepHigh;
+        break;
+    case 2: // South
+        y = eReflectionAxisKeepLow;
+        break;
+    case 3: // East
+        x = eReflectionAxisKeepHigh;
+        break;
+    case 4: // West
+        x = eReflectionAxisKeepLow;
+        break;
+    case 5: // NorthWest
+        x = eReflectionAxisFoldLow;
+        y = eReflectionAxisFoldHigh;
+        break;
+    case 6: // NorthEast
+        x = eReflectionAxisFoldHigh;
+        y = eReflectionAxisFoldHigh;
+        break;
+    case 7: // SouthWest
+        x = eReflectionAxisFoldLow;
+        y = eReflectionAxisFoldLow;
+        break;
+    case 8: // SouthEast
+        x = eReflectionAxisFoldHigh;
+        y = eReflectionAxisFoldLow;
+        break;
+    case 9: // flip
+        y = eReflectionAxisFlip;
+        break;
+    case 10: // flop
+        x = eReflectionAxisFlip;
+        break;
+    case 11: // flip+flop
+        x = y = eReflectionAxisFlip;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Row of the mirrored image shown at row i of the reflection: the upper half (from half - offset)
+ * is the image, the lower half its flipped copy, spacing pixels lower. */
+static int
+reflectionRowIndex(int i, int n, int offset, int spacing)
+{
+    int half = n / 2;
+    if (offset >= half) {
+        offset = half - 1;
+    }
+    if (offset < 0 && -offset >= half) {
+        offset = -half + 1;
+    }
+    if (i < 0 || i >= 2 * half) {
+        return -1;
+    }
+    if (i >= half - offset) {
+        return offset < 0 ? i + 2 * offset : i;
+    }
+    if (i < half - offset - spacing) {
+        return n - 1 - (i + spacing + (offset > 0 ? 2 * offset : 0));
+    }
+    return -1;
+}
+
+template <class PIX, int nComponents>
+class ReflectionProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    ReflectionProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg,
+                        const OfxRectI &window, const std::vector<int> &cols, const std::vector<int> &rows,
+                        bool matte, PIX opaque)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _cols(cols)
+        , _rows(rows)
+        , _matte(matte)
+        , _opaque(opaque)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        int width = _window.x2 - _window.x1;
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            PIX *dst = (PIX*)_dstImg->getPixelAddress(_window.x1, y);
+            int row = _rows[y - _window.y1];
+            if (row == kOfxFlagInfiniteMin) {
+                std::memset(dst, 0, width * nComponents * sizeof(PIX));
+                continue;
+            }
+            int x = 0;
+            while (x < width) {
+                // runs of consecutive source pixels are copied at once
+                int col = _cols[x];
+                int run = 1;
+                if (col == kOfxFlagInfiniteMin) {
+                    while (x + run < width && _cols[x + run] == kOfxFlagInfiniteMin) {
+                        ++run;
+                    }
+                    std::memset(dst, 0, run * nComponents * sizeof(PIX));
+                } else if (x + 1 < width && _cols[x + 1] == col + 1) {
+                    while (x + run < width && _cols[x + run] == col + run) {
+                        ++run;
+                    }
+                    const PIX *src = (const PIX*)_srcImg->getPixelAddress(col, row);
+                    if (src && _srcImg->getPixelAddress(col + run - 1, row)) {
+                        std::memcpy(dst, src, run * nComponents * sizeof(PIX));
+                    } else {
+                        copyPixels(dst, col, row, run, 1);
+                    }
+                } else {
+                    while (x + run < width && _cols[x + run] == col - run) {
+                        ++run;
+                    }
+                    copyPixels(dst, col, row, run, -1);
+                }
+                if (_matte && nComponents == 4) {
+                    for (int i = 0; i < run; ++i) {
+                        if (_cols[x + i] != kOfxFlagInfiniteMin) {
+                            dst[i * nComponents + 3] = _opaque;
+                        }
+                    }
+                }
+                dst += run * nComponents;
+                x += run;
+            }
+        }
+    }
+
+private:
+    // copy run pixels of row starting at col in direction step, pixels outside the source bounds are transparent
+    void copyPixels(PIX *dst, int col, int row, int run, int step)
+    {
+        for (int i = 0; i < run; ++i, col += step, dst += nComponents) {
+            const PIX *src = (const PIX*)_srcImg->getPixelAddress(col, row);
+            for (int c = 0; c < nComponents; ++c) {
+                dst[c] = src ? src[c] : PIX();
+            }
+        }
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    const std::vector<int> &_cols;
+    const std::vector<int> &_rows;
+    bool _matte;
+    PIX _opaque;
+};
 
 class ReflectionPlugin : public OFX::ImageEffect
 {
@@ -75,7 +279,16 @@ public:
     virtual ~ReflectionPlugin();
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
 private:
+    // source pixel of every column and row of window (at renderScale) inside srcRod, kOfxFlagInfiniteMin where transparent
+    void getIndices(double time, const OfxPointD &renderScale, const OfxRectI &srcRod, const OfxRectI &window,
+                    std::vector<int> &cols, std::vector<int> &rows);
+    template <class PIX, int nComponents>
+    void copyPixels(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window,
+                    const std::vector<int> &cols, const std::vector<int> &rows, bool matte, PIX opaque);
+
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
     OFX::IntParam *spacing_;
@@ -83,7 +296,6 @@ private:
     OFX::BooleanParam *matte_;
     OFX::BooleanParam *reflection_;
     OFX::ChoiceParam *mirror_;
-    OFX::BooleanParam *enableOpenMP_;
 };
 
 ReflectionPlugin::ReflectionPlugin(OfxImageEffectHandle handle)
@@ -95,28 +307,73 @@ ReflectionPlugin::ReflectionPlugin(OfxImageEffectHandle handle)
 , matte_(NULL)
 , reflection_(NULL)
 , mirror_(NULL)
-, enableOpenMP_(NULL)
 {
-    Magick::InitializeMagick(NULL);
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentAlpha));
     srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(srcClip_ && srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(srcClip_ && (srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentAlpha));
 
     spacing_ = fetchIntParam(kParamSpace);
     offset_ = fetchIntParam(kParamOffset);
     matte_ = fetchBooleanParam(kParamMatte);
     reflection_ = fetchBooleanParam(kParamReflection);
     mirror_ = fetchChoiceParam(kParamMirror);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
 
-    assert(spacing_ && offset_ && matte_ && mirror_ && reflection_ && enableOpenMP_);
+    assert(spacing_ && offset_ && matte_ && mirror_ && reflection_);
 }
 
 ReflectionPlugin::~ReflectionPlugin()
 {
 }
 
+void ReflectionPlugin::getIndices(double time, const OfxPointD &renderScale, const OfxRectI &srcRod, const OfxRectI &window,
+                                  std::vector<int> &cols, std::vector<int> &rows)
+{
+    int spacing = 0;
+    int offset = 0;
+    int mirror = 0;
+    bool reflection = false;
+    mirror_->getValueAtTime(time, mirror);
+    spacing_->getValueAtTime(time, spacing);
+    offset_->getValueAtTime(time, offset);
+    reflection_->getValueAtTime(time, reflection);
+    spacing = std::floor(spacing * renderScale.x + 0.5);
+    offset = std::floor(offset * renderScale.x + 0.5);
+
+    ReflectionAxisEnum axisX, axisY;
+    reflectionMirrorAxes(mirror, axisX, axisY);
+    int width = srcRod.x2 - srcRod.x1;
+    int height = srcRod.y2 - srcRod.y1;
+
+    cols.resize(std::max(0, window.x2 - window.x1));
+    for (int x = window.x1; x < window.x2; ++x) {
+        int i = reflectionAxisIndex(x - srcRod.x1, width, axisX);
+        cols[x - window.x1] = i < 0 ? kOfxFlagInfiniteMin : srcRod.x1 + i;
+    }
+    rows.resize(std::max(0, window.y2 - window.y1));
+    for (int y = window.y1; y < window.y2; ++y) {
+        int i = y - srcRod.y1;
+        if (reflection) {
+            i = reflectionRowIndex(i, height, offset, spacing);
+        }
+        i = reflectionAxisIndex(i, height, axisY);
+        rows[y - window.y1] = i < 0 ? kOfxFlagInfiniteMin : srcRod.y1 + i;
+    }
+}
+
+template <class PIX, int nComponents>
+void ReflectionPlugin::copyPixels(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window,
+                                  const std::vector<int> &cols, const std::vector<int> &rows, bool matte, PIX opaque)
+{
+    ReflectionProcessor<PIX, nComponents> processor(*this, srcImg, dstImg, window, cols, rows, matte, opaque);
+    unsigned int nThreads = std::max(1u, std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1)));
+    processor.multiThread(nThreads);
+}
+
 void ReflectionPlugin::render(const OFX::RenderArguments &args)
 {
     // render scale
@@ -125,6 +382,8 @@ void ReflectionPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!srcClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -132,10 +391,9 @@ void ReflectionPlugin::render(const OFX::RenderArguments &args)
     }
     assert(srcClip_);
     OFX::auto_ptr<const OFX::Image> srcImg(srcClip_->fetchImage(args.time));
-    OfxRectI srcRod,srcBounds;
+    OfxRectI srcRod;
     if (srcImg.get()) {
         srcRod = srcImg->getRegionOfDefinition();
-        srcBounds = srcImg->getBounds();
         if (srcImg->getRenderScale().x != args.renderScale.x ||
             srcImg->getRenderScale().y != args.renderScale.y ||
             srcImg->getField() != args.fieldToRender) {
@@ -145,6 +403,7 @@ void ReflectionPlugin::render(const OFX::RenderArguments &args)
         }
     } else {
         OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
     }
 
     // get dest clip
@@ -166,16 +425,10 @@ void ReflectionPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get bit depth
+    // get bit depth and pixel component
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
-        OFX::throwSuiteStatusException(kOfxStatErrFormat);
-        return;
-    }
-
-    // get pixel component
-    OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA || (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
+    OFX::PixelComponentEnum dstComponents = dstImg->getPixelComponents();
+    if (dstBitDepth != srcImg->getPixelDepth() || dstComponents != srcImg->getPixelComponents()) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -189,203 +442,48 @@ void ReflectionPlugin::render(const OFX::RenderArguments &args)
     }
 
     // get params
-    int spacing = 0;
-    int offset = 0;
-    int mirror = 0;
     bool matte = false;
-    bool reflection = false;
-    bool enableOpenMP = false;
-    mirror_->getValueAtTime(args.time, mirror);
-    spacing_->getValueAtTime(args.time, spacing);
-    offset_->getValueAtTime(args.time, offset);
     matte_->getValueAtTime(args.time, matte);
-    reflection_->getValueAtTime(args.time, reflection);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
-
-    // setup
-    int srcWidth = srcRod.x2-srcRod.x1;
-    int srcHeight = srcRod.y2-srcRod.y1;
-    int mirrorWidth = srcWidth/2;
-    int mirrorHeight = srcHeight/2;
-    Magick::Image image;
-    Magick::Image image0;
-    Magick::Image image1;
-    Magick::Image image2;
-    Magick::Image image3;
-    Magick::Image image4;
-
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
-
-    // read source image
-    Magick::Image container(Magick::Geometry(srcWidth,srcHeight),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(srcWidth,srcHeight),Magick::Color("rgba(0,0,0,1)"));
-    if (srcClip_ && srcClip_->isConnected())
-        image.read(srcWidth,srcHeight,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
-
-    if (matte) {
-#if MagickLibVersion >= 0x700
-        image.alpha(false);
-        image.alpha(true);
-#else
-        image.matte(false);
-        image.matte(true);
-#endif
-    }
-
-    // proc mirror
-    Magick::Image mirrorContainer(Magick::Geometry(srcWidth,srcHeight),Magick::Color("rgba(0,0,0,0)"));
-    switch(mirror) {
-    case 1: // North
-        image1 = image;
-        image1.flip();
-        image.crop(Magick::Geometry(srcWidth,mirrorHeight,0,mirrorHeight));
-        image1.crop(Magick::Geometry(srcWidth,mirrorHeight,0,0));
-        mirrorContainer.composite(image,0,mirrorHeight,Magick::OverCompositeOp);
-        mirrorContainer.composite(image1,0,0,Magick::OverCompositeOp);
-        break;
-    case 2: // South
-        image1 = image;
-        image.flip();
-        image.crop(Magick::Geometry(srcWidth,mirrorHeight,0,mirrorHeight));
-        image1.crop(Magick::Geometry(srcWidth,mirrorHeight,0,0));
-        mirrorContainer.composite(image,0,mirrorHeight,Magick::OverCompositeOp);
-        mirrorContainer.composite(image1,0,0,Magick::OverCompositeOp);
-        break;
-    case 3: // East
-        image1 = image;
-        image1.flop();
-        image.crop(Magick::Geometry(mirrorWidth,srcHeight,mirrorWidth,0));
-        image1.crop(Magick::Geometry(mirrorWidth,srcHeight,0,0));
-        mirrorContainer.composite(image,mirrorWidth,0,Magick::OverCompositeOp);
-        mirrorContainer.composite(image1,0,0,Magick::OverCompositeOp);
-        break;
-    case 4: // West
-        image1 = image;
-        image.flop();
-        image.crop(Magick::Geometry(mirrorWidth,srcHeight,mirrorWidth,0));
-        image1.crop(Magick::Geometry(mirrorWidth,srcHeight,0,0));
-        mirrorContainer.composite(image,mirrorWidth,0,Magick::OverCompositeOp);
-        mirrorContainer.composite(image1,0,0,Magick::OverCompositeOp);
-        break;
-    case 5: // NorthWest
-        image1 = image;
-        image1.crop(Magick::Geometry(mirrorWidth,mirrorHeight,0,mirrorHeight));
-        image2 = image1;
-        image2.flop();
-        image3 = image2;
-        image3.flip();
-        image4 = image3;
-        image4.flop();
-        break;
-    case 6: // NorthEast
-        image1 = image;
-        image1.crop(Magick::Geometry(mirrorWidth,mirrorHeight,mirrorWidth,mirrorHeight));
-        image1.flop();
-        image2 = image1;
-        image2.flop();
-        image3 = image2;
-        image3.flip();
-        image4 = image3;
-        image4.flop();
-        break;
-    case 7: // SouthWest
-        image1 = image;
-        image1.crop(Magick::Geometry(mirrorWidth,mirrorHeight,0,0));
-        image1.flip();
-        image2 = image1;
-        image2.flop();
-        image3 = image2;
-        image3.flip();
-        image4 = image3;
-        image4.flop();
-        break;
-    case 8: // SouthEast
-        image1 = image;
-        image1.crop(Magick::Geometry(mirrorWidth,mirrorHeight,mirrorWidth,0));
-        image1.flop();
-        image1.flip();
-        image2 = image1;
-        image2.flop();
-        image3 = image2;
-        image3.flip();
-        image4 = image3;
-        image4.flop();
-        break;
-    case 9: // flip
-        image.flip();
-        break;
-    case 10: // flop
-        image.flop();
-        break;
-    case 11: //flip+flop
-        image.flip();
-        image.flop();
+    std::vector<int> cols, rows;
+    getIndices(args.time, args.renderScale, srcRod, args.renderWindow, cols, rows);
+
+    // copy every pixel from its mirrored source position
+    timer.next("copy");
+    int nComponents = dstImg->getPixelComponentCount();
+    switch (dstBitDepth) {
+    case OFX::eBitDepthUByte:
+        if (nComponents == 4) {
+            copyPixels<unsigned char, 4>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, 255);
+        } else if (nComponents == 3) {
+            copyPixels<unsigned char, 3>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, 255);
+        } else {
+            copyPixels<unsigned char, 1>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, 255);
+        }
         break;
-    default:
-        // none
+    case OFX::eBitDepthUShort:
+    case OFX::eBitDepthHalf: {
+        unsigned short opaque = dstBitDepth == OFX::eBitDepthHalf ? 0x3c00 : 65535; // half 1.0
+        if (nComponents == 4) {
+            copyPixels<unsigned short, 4>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, opaque);
+        } else if (nComponents == 3) {
+            copyPixels<unsigned short, 3>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, opaque);
+        } else {
+            copyPixels<unsigned short, 1>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, opaque);
+        }
         break;
     }
-    if (mirror>4&&mirror<9) {
-        mirrorContainer.composite(image1,0,mirrorHeight,Magick::OverCompositeOp);
-        mirrorContainer.composite(image2,mirrorWidth,mirrorHeight,Magick::OverCompositeOp);
-        mirrorContainer.composite(image3,mirrorWidth,0,Magick::OverCompositeOp);
-        mirrorContainer.composite(image4,0,0,Magick::OverCompositeOp);
-    }
-    if (mirror>0&&mirror<9)
-        image=mirrorContainer;
-    if (reflection) {
-        image0 = image;
-        image0.flip();
-        spacing = std::floor(spacing * args.renderScale.x + 0.5);
-        offset = std::floor(offset * args.renderScale.x + 0.5);
-        if (offset>=mirrorHeight)
-            offset=mirrorHeight-1;
-        if (offset<0) {
-            if ((offset-offset*2)>=mirrorHeight)
-                offset = (mirrorHeight*-1)+1;
-            image0.crop(Magick::Geometry(srcWidth,mirrorHeight-offset,0,offset-offset));
-            image.crop(Magick::Geometry(srcWidth,mirrorHeight+offset,0,mirrorHeight+offset));
-        }
-        else {
-            image0.crop(Magick::Geometry(srcWidth,mirrorHeight-offset,0,offset+offset));
-            image.crop(Magick::Geometry(srcWidth,mirrorHeight+offset,0,mirrorHeight-offset));
+    case OFX::eBitDepthFloat:
+        if (nComponents == 4) {
+            copyPixels<float, 4>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, 1.f);
+        } else if (nComponents == 3) {
+            copyPixels<float, 3>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, 1.f);
+        } else {
+            copyPixels<float, 1>(srcImg.get(), dstImg.get(), args.renderWindow, cols, rows, matte, 1.f);
         }
-        /*if (maskImg.get()) {
-            int maskWidth = maskRod.x2-maskRod.x1;
-            int maskHeight = maskRod.y2-maskRod.y1;
-            if (maskWidth>0&&maskHeight>0) {
-                Magick::Image mask(maskWidth,maskHeight,"A",Magick::FloatPixel,(float*)maskImg->getPixelData());
-                int offsetX = 0;
-                int offsetY = 0;
-                if (maskRod.x1!=0)
-                    offsetX = maskRod.x1;
-                if (maskRod.y1!=0)
-                    offsetY = maskRod.y1;
-                image0.composite(mask,offsetX,offsetY,Magick::CopyOpacityCompositeOp);
-            }
-        }*/
-        container.composite(image0,0,-spacing,Magick::OverCompositeOp);
-        container.composite(image,0,mirrorHeight-offset,Magick::OverCompositeOp);
-    }
-    else
-        container=image;
-
-    // return image
-    if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(container, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(container, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(container, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        return;
     }
 }
 
@@ -404,6 +502,67 @@ bool ReflectionPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArgume
     return true;
 }
 
+void ReflectionPlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+    if (!srcClip_ || !srcClip_->isConnected()) {
+        return;
+    }
+    // the source pixels the mirrored window reads from
+    OfxRectD srcRodD = srcClip_->getRegionOfDefinition(args.time);
+    OfxRectI srcRod, window;
+    srcRod.x1 = (int)std::floor(srcRodD.x1 * args.renderScale.x);
+    srcRod.y1 = (int)std::floor(srcRodD.y1 * args.renderScale.y);
+    srcRod.x2 = (int)std::ceil(srcRodD.x2 * args.renderScale.x);
+    srcRod.y2 = (int)std::ceil(srcRodD.y2 * args.renderScale.y);
+    window.x1 = std::max(srcRod.x1, (int)std::floor(args.regionOfInterest.x1 * args.renderScale.x));
+    window.y1 = std::max(srcRod.y1, (int)std::floor(args.regionOfInterest.y1 * args.renderScale.y));
+    window.x2 = std::min(srcRod.x2, (int)std::ceil(args.regionOfInterest.x2 * args.renderScale.x));
+    window.y2 = std::min(srcRod.y2, (int)std::ceil(args.regionOfInterest.y2 * args.renderScale.y));
+    std::vector<int> cols, rows;
+    getIndices(args.time, args.renderScale, srcRod, window, cols, rows);
+    OfxRectI pixels = { kOfxFlagInfiniteMax, kOfxFlagInfiniteMax, kOfxFlagInfiniteMin, kOfxFlagInfiniteMin };
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (cols[i] != kOfxFlagInfiniteMin) {
+            pixels.x1 = std::min(pixels.x1, cols[i]);
+            pixels.x2 = std::max(pixels.x2, cols[i] + 1);
+        }
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (rows[i] != kOfxFlagInfiniteMin) {
+            pixels.y1 = std::min(pixels.y1, rows[i]);
+            pixels.y2 = std::max(pixels.y2, rows[i] + 1);
+        }
+    }
+    if (pixels.x1 >= pixels.x2 || pixels.y1 >= pixels.y2) {
+        return;
+    }
+    OfxRectD roi;
+    roi.x1 = pixels.x1 / args.renderScale.x;
+    roi.y1 = pixels.y1 / args.renderScale.y;
+    roi.x2 = pixels.x2 / args.renderScale.x;
+    roi.y2 = pixels.y2 / args.renderScale.y;
+    rois.setRegionOfInterest(*srcClip_, roi);
+}
+
+bool ReflectionPlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!kSupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    int mirror;
+    bool matte = false;
+    bool reflection = false;
+    mirror_->getValueAtTime(args.time, mirror);
+    matte_->getValueAtTime(args.time, matte);
+    reflection_->getValueAtTime(args.time, reflection);
+    if (mirror == 0 && !reflection && !matte) {
+        identityClip = srcClip_;
+        return true;
+    }
+    return false;
+}
+
 mDeclarePluginFactory(ReflectionPluginFactory, {}, {});
 
 /** @brief The basic describe function, passed a plugin descriptor */
@@ -419,6 +578,9 @@ void ReflectionPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     // other
@@ -433,13 +595,11 @@ void ReflectionPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void ReflectionPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-
     // create the mandated source clip
     ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
+    srcClip->addSupportedComponent(ePixelComponentAlpha);
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
@@ -447,6 +607,8 @@ void ReflectionPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
+    dstClip->addSupportedComponent(ePixelComponentAlpha);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make pages and params
@@ -506,17 +668,6 @@ void ReflectionPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc
         param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
     }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
-    }
 }
 
 /** @brief The create instance function, the plugin must return an object derived from the \ref OFX::ImageEffect class */
@@ -15,8 +15,12 @@
  * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
 */
 
-#include "MagickPlugin.h"
+#include "ofxsImageEffect.h"
+#include "ofxsMacros.h"
+#include "ArenaTimer.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 using namespace OFX;
 OFXS_NAMESPACE_ANONYMOUS_ENTER
@@ -24,11 +28,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginName "RollOFX"
 #define kPluginGrouping "Extra/Transform"
 #define kPluginIdentifier "net.fxarena.openfx.Roll"
-#define kPluginDescription "Roll effect using ImageMagick."
+#define kPluginDescription "Roll (circular translation) effect."
 #define kPluginVersionMajor 2
-#define kPluginVersionMinor 9
+#define kPluginVersionMinor 10
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
@@ -46,32 +50,267 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kParamRollYHint "Adjust roll Y"
 #define kParamRollYDefault 0
 
+#define kParamMatte "matte"
+#define kParamMatteLabel "Matte"
+#define kParamMatteHint "Merge Alpha before applying effect."
+#define kParamMatteDefault false
+
+// i modulo n, in [0,n[
+static int
+wrapIndex(int i, int n)
+{
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+// source range of [a1,a2] rolled by offset inside [r1,r2], all of it when the range wraps
+static void
+rollRange(double a1, double a2, double offset, double r1, double r2, double &s1, double &s2)
+{
+    double n = r2 - r1;
+    s1 = r1;
+    s2 = r2;
+    if (n <= 0. || a2 - a1 >= n) {
+        return;
+    }
+    double start = std::fmod(a1 - offset - r1, n);
+    if (start < 0.) {
+        start += n;
+    }
+    start += r1;
+    if (start + (a2 - a1) <= r2) {
+        s1 = start;
+        s2 = start + (a2 - a1);
+    }
+}
+
 class RollPlugin
-    : public MagickPluginHelper<kSupportsRenderScale>
+    : public OFX::ImageEffect
 {
 public:
     RollPlugin(OfxImageEffectHandle handle)
-        : MagickPluginHelper<kSupportsRenderScale>(handle)
+        : OFX::ImageEffect(handle)
+        , _dstClip(NULL)
+        , _srcClip(NULL)
         , _x(NULL)
         , _y(NULL)
+        , _matte(NULL)
     {
+        _dstClip = fetchClip(kOfxImageEffectOutputClipName);
+        assert(_dstClip && (_dstClip->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                            _dstClip->getPixelComponents() == OFX::ePixelComponentRGB ||
+                            _dstClip->getPixelComponents() == OFX::ePixelComponentAlpha));
+        _srcClip = fetchClip(kOfxImageEffectSimpleSourceClipName);
+        assert(_srcClip && (_srcClip->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                            _srcClip->getPixelComponents() == OFX::ePixelComponentRGB ||
+                            _srcClip->getPixelComponents() == OFX::ePixelComponentAlpha));
         _x = fetchDoubleParam(kParamRollX);
         _y = fetchDoubleParam(kParamRollY);
-        assert(_x && _y);
+        _matte = fetchBooleanParam(kParamMatte);
+        assert(_x && _y && _matte);
     }
 
-    virtual void render(const OFX::RenderArguments &args, Magick::Image &image) OVERRIDE FINAL
+    virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
+    virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
+
+private:
+    // roll in pixels at renderScale, ImageMagick rolls down for positive y so y is flipped for the bottom-up OFX frame
+    void getRoll(double time, const OfxPointD &renderScale, int &x, int &y)
     {
-        double x,y;
-        _x->getValueAtTime(args.time, x);
-        _y->getValueAtTime(args.time, y);
-        image.roll(std::floor(x * args.renderScale.x + 0.5), std::floor(y * args.renderScale.x + 0.5));
+        double rollX, rollY;
+        _x->getValueAtTime(time, rollX);
+        _y->getValueAtTime(time, rollY);
+        x = (int)std::floor(rollX * renderScale.x + 0.5);
+        y = -(int)std::floor(rollY * renderScale.x + 0.5);
     }
-private:
+
+    OFX::Clip *_dstClip;
+    OFX::Clip *_srcClip;
     DoubleParam *_x;
     DoubleParam *_y;
+    BooleanParam *_matte;
 };
 
+// set the alpha of window to one
+static void
+setOpaque(OFX::Image *dstImg, const OfxRectI &window)
+{
+    OFX::BitDepthEnum depth = dstImg->getPixelDepth();
+    for (int y = window.y1; y < window.y2; ++y) {
+        char *dst = (char*)dstImg->getPixelAddress(window.x1, y);
+        for (int x = window.x1; x < window.x2; ++x) {
+            switch (depth) {
+            case OFX::eBitDepthUByte:
+                ((unsigned char*)dst)[4 * (x - window.x1) + 3] = 255;
+                break;
+            case OFX::eBitDepthUShort:
+                ((unsigned short*)dst)[4 * (x - window.x1) + 3] = 65535;
+                break;
+            case OFX::eBitDepthHalf:
+                ((unsigned short*)dst)[4 * (x - window.x1) + 3] = 0x3c00; // 1.0
+                break;
+            case OFX::eBitDepthFloat:
+                ((float*)dst)[4 * (x - window.x1) + 3] = 1.f;
+                break;
+            default:
+                return;
+            }
+        }
+    }
+}
+
+void
+RollPlugin::render(const OFX::RenderArguments &args)
+{
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
+    // get src clip
+    if (!_srcClip) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
+    }
+    assert(_srcClip);
+    OFX::auto_ptr<const OFX::Image> srcImg(_srcClip->fetchImage(args.time));
+    OfxRectI srcRod;
+    if (srcImg.get()) {
+        srcRod = srcImg->getRegionOfDefinition();
+        if (srcImg->getRenderScale().x != args.renderScale.x ||
+            srcImg->getRenderScale().y != args.renderScale.y ||
+            srcImg->getField() != args.fieldToRender) {
+            setPersistentMessage(OFX::Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+            OFX::throwSuiteStatusException(kOfxStatFailed);
+            return;
+        }
+    } else {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
+    }
+
+    // get dest clip
+    if (!_dstClip) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
+    }
+    assert(_dstClip);
+    OFX::auto_ptr<OFX::Image> dstImg(_dstClip->fetchImage(args.time));
+    if (!dstImg.get()) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
+    }
+    if (dstImg->getRenderScale().x != args.renderScale.x ||
+        dstImg->getRenderScale().y != args.renderScale.y ||
+        dstImg->getField() != args.fieldToRender) {
+        setPersistentMessage(OFX::Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
+    }
+
+    // get bit depth and pixel component
+    if (dstImg->getPixelDepth() != srcImg->getPixelDepth() ||
+        dstImg->getPixelComponents() != srcImg->getPixelComponents()) {
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        return;
+    }
+
+    // are we in the image bounds?
+    OfxRectI dstBounds = dstImg->getBounds();
+    if(args.renderWindow.x1 < dstBounds.x1 || args.renderWindow.x1 >= dstBounds.x2 || args.renderWindow.y1 < dstBounds.y1 || args.renderWindow.y1 >= dstBounds.y2 ||
+       args.renderWindow.x2 <= dstBounds.x1 || args.renderWindow.x2 > dstBounds.x2 || args.renderWindow.y2 <= dstBounds.y1 || args.renderWindow.y2 > dstBounds.y2) {
+        OFX::throwSuiteStatusException(kOfxStatErrValue);
+        return;
+    }
+
+    // params
+    int rollX, rollY;
+    bool matte = false;
+    getRoll(args.time, args.renderScale, rollX, rollY);
+    _matte->getValueAtTime(args.time, matte);
+
+    // every row is at most two runs of the (wrapped) source row, pixels the host did not give are transparent
+    timer.next("copy");
+    int width = srcRod.x2 - srcRod.x1;
+    int height = srcRod.y2 - srcRod.y1;
+    size_t pixelBytes = dstImg->getPixelComponentCount() * (size_t)(dstImg->getPixelDepth() == OFX::eBitDepthUByte ? 1 :
+                                                                    dstImg->getPixelDepth() == OFX::eBitDepthFloat ? 4 : 2);
+    OfxRectI srcBounds = srcImg->getBounds();
+    for (int y = args.renderWindow.y1; y < args.renderWindow.y2; ++y) {
+        char *dst = (char*)dstImg->getPixelAddress(args.renderWindow.x1, y);
+        if (width <= 0 || height <= 0) {
+            std::memset(dst, 0, (args.renderWindow.x2 - args.renderWindow.x1) * pixelBytes);
+            continue;
+        }
+        int srcY = srcRod.y1 + wrapIndex(y - rollY - srcRod.y1, height);
+        int x = args.renderWindow.x1;
+        while (x < args.renderWindow.x2) {
+            int srcX = srcRod.x1 + wrapIndex(x - rollX - srcRod.x1, width);
+            int run = std::min(args.renderWindow.x2 - x, srcRod.x2 - srcX);
+            // part of the run inside the fetched source
+            int a = std::max(srcX, std::min(srcBounds.x1, srcX + run));
+            int b = std::max(a, std::min(srcBounds.x2, srcX + run));
+            if (srcY < srcBounds.y1 || srcY >= srcBounds.y2) {
+                a = b = srcX + run;
+            }
+            std::memset(dst, 0, (a - srcX) * pixelBytes);
+            if (a < b) {
+                std::memcpy(dst + (a - srcX) * pixelBytes, srcImg->getPixelAddress(a, srcY), (b - a) * pixelBytes);
+            }
+            std::memset(dst + (b - srcX) * pixelBytes, 0, (srcX + run - b) * pixelBytes);
+            dst += run * pixelBytes;
+            x += run;
+        }
+    }
+
+    if (matte && dstImg->getPixelComponents() == OFX::ePixelComponentRGBA) {
+        setOpaque(dstImg.get(), args.renderWindow);
+    }
+}
+
+bool
+RollPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
+{
+    if (_srcClip && _srcClip->isConnected()) {
+        rod = _srcClip->getRegionOfDefinition(args.time);
+    } else {
+        rod.x1 = rod.y1 = kOfxFlagInfiniteMin;
+        rod.x2 = rod.y2 = kOfxFlagInfiniteMax;
+    }
+    return true;
+}
+
+void
+RollPlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+    if (!_srcClip || !_srcClip->isConnected()) {
+        return;
+    }
+    OfxRectD srcRod = _srcClip->getRegionOfDefinition(args.time);
+    int rollX, rollY;
+    getRoll(args.time, args.renderScale, rollX, rollY);
+    // one pixel of slack for the canonical to pixel rounding
+    double padX = 1. / args.renderScale.x;
+    double padY = 1. / args.renderScale.y;
+    OfxRectD roi;
+    rollRange(args.regionOfInterest.x1 - padX, args.regionOfInterest.x2 + padX, rollX / args.renderScale.x, srcRod.x1, srcRod.x2, roi.x1, roi.x2);
+    rollRange(args.regionOfInterest.y1 - padY, args.regionOfInterest.y2 + padY, rollY / args.renderScale.y, srcRod.y1, srcRod.y2, roi.y1, roi.y2);
+    rois.setRegionOfInterest(*_srcClip, roi);
+}
+
+bool
+RollPlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    int rollX, rollY;
+    bool matte = false;
+    getRoll(args.time, args.renderScale, rollX, rollY);
+    _matte->getValueAtTime(args.time, matte);
+    if (!matte && rollX == 0 && rollY == 0) {
+        identityClip = _srcClip;
+        return true;
+    }
+    return false;
+}
+
 mDeclarePluginFactory(RollPluginFactory, {}, {});
 
 void RollPluginFactory::describe(ImageEffectDescriptor &desc)
@@ -81,6 +320,9 @@ void RollPluginFactory::describe(ImageEffectDescriptor &desc)
     desc.setPluginDescription(kPluginDescription);
     desc.addSupportedContext(eContextGeneral);
     desc.addSupportedContext(eContextFilter);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
     desc.setSupportsTiles(kSupportsTiles);
     desc.setSupportsMultiResolution(kSupportsMultiResolution);
@@ -90,9 +332,33 @@ void RollPluginFactory::describe(ImageEffectDescriptor &desc)
     desc.setHostMixingEnabled(kHostMixing);
 }
 
-void RollPluginFactory::describeInContext(ImageEffectDescriptor &desc, ContextEnum context)
+void RollPluginFactory::describeInContext(ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    OFX::PageParamDescriptor *page = RollPlugin::describeInContextBegin(desc, context);
+    ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
+    srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
+    srcClip->addSupportedComponent(ePixelComponentAlpha);
+    srcClip->setTemporalClipAccess(false);
+    srcClip->setSupportsTiles(kSupportsTiles);
+    srcClip->setIsMask(false);
+
+    ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
+    dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
+    dstClip->addSupportedComponent(ePixelComponentAlpha);
+    dstClip->setSupportsTiles(kSupportsTiles);
+
+    PageParamDescriptor *page = desc.definePageParam("Controls");
+    {
+        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamMatte);
+        param->setLabel(kParamMatteLabel);
+        param->setHint(kParamMatteHint);
+        param->setDefault(kParamMatteDefault);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
     {
         DoubleParamDescriptor *param = desc.defineDoubleParam(kParamRollX);
         param->setLabel(kParamRollXLabel);
@@ -116,7 +382,6 @@ void RollPluginFactory::describeInContext(ImageEffectDescriptor &desc, ContextEn
             page->addChild(*param);
         }
     }
-    RollPlugin::describeInContextEnd(desc, context, page);
 }
 
 OFX::ImageEffect*
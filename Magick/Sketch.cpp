@@ -18,16 +18,23 @@
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
-#include <Magick++.h>
-#include <iostream>
-#include <stdint.h>
+#include "MagickCache.h"
+#include "ArenaTimer.h"
+#include "ArenaEdge.h"
+#include <algorithm>
 #include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 #define kPluginName "SketchOFX"
 #define kPluginGrouping "Extra/Filter"
 #define kPluginIdentifier "net.fxarena.openfx.Sketch"
-#define kPluginVersionMajor 2
-#define kPluginVersionMinor 2
+#define kPluginVersionMajor 3
+#define kPluginVersionMinor 0
 
 #define kParamRadius "radius"
 #define kParamRadiusLabel "Radius"
@@ -44,19 +51,219 @@
 #define kParamAngleHint "Adjust angle"
 #define kParamAngleDefault 0
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 1
 #define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault false
-
 using namespace OFX;
-static bool _hasOpenMP = false;
+
+/* The sketch of ImageMagick (SketchImage) draws pencil strokes from noise at twice the resolution:
+ * motion blur along angle, edge, normalize, negate and halve, then color dodges the image with them
+ * and blends 20% of the image back. The strokes only depend on the position and the parameters,
+ * so here the noise is a hash of the position, the stroke stages run fused on strips of rows
+ * (SketchStrokeFilter) and their levels come from a fixed patch of strokes, the same for every tile and frame.
+ */
+
+// side of the patch of strokes (at twice the resolution) the levels are taken from
+#define kSketchLevelsPatch 512
+
+// uniform noise in [0,1[ of position (x,y)
+static inline float
+sketchNoise(int x, int y)
+{
+    unsigned int h = ((unsigned int)x * 0x8da6b343u) ^ ((unsigned int)y * 0xd8163841u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (h >> 8) * (1.f / 16777216.f);
+}
+
+// stroke stages for the radius and sigma (in pixels at render scale) and the angle of the sketch
+struct SketchStrokes
+{
+    SketchStrokes(double radius, double sigma, double angle)
+        : edgeSize(arenaKernelWidth(radius, 0.5))
+        , black(0.f)
+        , white(1.f)
+    {
+        int width = arenaKernelWidth(radius, sigma);
+        arenaGaussianKernel(width, sigma, false, motion);
+        // taps along angle, rows go up in OFX and down in ImageMagick
+        double a = angle * M_PI / 180.;
+        for (int i = 0; i < width; ++i) {
+            dx.push_back((int)std::floor(i * std::cos(a) + 0.5));
+            dy.push_back(-(int)std::floor(i * std::sin(a) + 0.5));
+        }
+    }
+
+    int edgeSize;
+    std::vector<float> motion;
+    std::vector<int> dx;
+    std::vector<int> dy;
+    float black;
+    float white;
+};
+
+/* Rows of the edges of the motion blurred noise (before normalization), at twice the resolution,
+ * for columns from x1, from row y1 down. */
+class SketchStrokeFilter
+{
+public:
+    SketchStrokeFilter(const SketchStrokes &strokes, int x1, int columns, int y1)
+        : _strokes(strokes)
+        , _dxMin(*std::min_element(strokes.dx.begin(), strokes.dx.end()))
+        , _dyMin(*std::min_element(strokes.dy.begin(), strokes.dy.end()))
+        , _dyMax(*std::max_element(strokes.dy.begin(), strokes.dy.end()))
+        , _x1(x1 - strokes.edgeSize / 2)
+        , _columns(columns + strokes.edgeSize - 1)
+        , _noiseColumns(_columns + *std::max_element(strokes.dx.begin(), strokes.dx.end()) - _dxMin)
+        , _noise(_dyMax - _dyMin + 1, _noiseColumns)
+        , _edge(strokes.edgeSize, columns)
+        , _row(y1 - strokes.edgeSize / 2)
+        , _noiseRow(_row + _dyMin)
+        , _output(columns)
+    {
+    }
+
+    // next row of edges
+    const float *next()
+    {
+        for (;;) {
+            // noise rows the taps of this row reach
+            while (_noiseRow <= _row + _dyMax) {
+                float *noise = _noise.push();
+                int x = _x1 + _dxMin;
+                for (int c = 0; c < _noiseColumns; ++c) {
+                    noise[c] = sketchNoise(x + c, _noiseRow);
+                }
+                ++_noiseRow;
+            }
+            float *blurred = _edge.input();
+            std::fill(blurred, blurred + _columns, 0.f);
+            for (size_t i = 0; i < _strokes.motion.size(); ++i) {
+                float k = _strokes.motion[i];
+                if (k == 0.f) {
+                    continue;
+                }
+                const float *noise = _noise.row(_strokes.dy[i] - _dyMin) + _strokes.dx[i] - _dxMin;
+                for (int c = 0; c < _columns; ++c) {
+                    blurred[c] += k * noise[c];
+                }
+            }
+            ++_row;
+            if (_edge.push()) {
+                _edge.apply(&_output[0]);
+                return &_output[0];
+            }
+        }
+    }
+
+private:
+    const SketchStrokes &_strokes;
+    int _dxMin;
+    int _dyMin;
+    int _dyMax;
+    int _x1;            // first column of the motion blurred rows
+    int _columns;       // columns of the motion blurred rows
+    int _noiseColumns;
+    ArenaRowWindow _noise;
+    ArenaEdgeFilter _edge;
+    int _row;           // next motion blurred row
+    int _noiseRow;      // next noise row
+    std::vector<float> _output;
+};
+
+template <class PIX, int nComponents, int maxValue>
+class SketchProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    SketchProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window,
+                    const SketchStrokes &strokes)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _strokes(strokes)
+    {
+    }
+
+    // each thread draws the strokes of a strip of rows and dodges the image with them
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        if (y1 >= y2) {
+            return;
+        }
+        int width = _window.x2 - _window.x1;
+        SketchStrokeFilter strokes(_strokes, 2 * _window.x1, 2 * width, 2 * y1);
+        std::vector<float> first(2 * width);
+        std::vector<float> dodge(width);
+        float black = _strokes.black;
+        float scale = _strokes.white > black ? 1.f / (_strokes.white - black) : 1e30f;
+
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            // halve the negated normalized strokes of the two rows at twice the resolution
+            const float *row = strokes.next();
+            std::copy(row, row + 2 * width, first.begin());
+            row = strokes.next();
+            for (int x = 0; x < width; ++x) {
+                float sum = 0.f;
+                for (int i = 0; i < 2; ++i) {
+                    sum += std::max(0.f, std::min((first[2 * x + i] - black) * scale, 1.f));
+                    sum += std::max(0.f, std::min((row[2 * x + i] - black) * scale, 1.f));
+                }
+                dodge[x] = 1.f - 0.25f * sum;
+            }
+
+            const PIX *src = (const PIX*)_srcImg->getPixelAddress(_window.x1, y);
+            PIX *dst = (PIX*)_dstImg->getPixelAddress(_window.x1, y);
+            for (int x = 0; x < width; ++x, dst += nComponents) {
+                const PIX *pix = src ? src + (size_t)x * nComponents : (const PIX*)_srcImg->getPixelAddress(_window.x1 + x, y);
+                if (!pix) {
+                    std::fill(dst, dst + nComponents, PIX(0));
+                    continue;
+                }
+                // unpremultiplied color dodge, 20% of the image blended back, alpha kept
+                float alpha = nComponents == 4 ? (float)pix[3] / maxValue : 1.f;
+                float s = dodge[x];
+                for (int k = 0; k < 3; ++k) {
+                    float c = alpha > 0.f ? (float)pix[k] / maxValue / alpha : 0.f;
+                    float d = (s + c >= 1.f || s >= 1.f) ? 1.f : c / (1.f - s);
+                    dst[k] = convert((0.8f * d + 0.2f * c) * alpha);
+                }
+                if (nComponents == 4) {
+                    dst[3] = pix[3];
+                }
+            }
+        }
+    }
+
+private:
+    static PIX convert(float v)
+    {
+        if (maxValue == 1) {
+            return PIX(v);
+        }
+        return PIX(std::max(0.f, std::min(v, 1.f)) * maxValue + 0.5f);
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    const SketchStrokes &_strokes;
+};
 
 class SketchPlugin : public OFX::ImageEffect
 {
@@ -66,12 +273,22 @@ public:
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
 private:
+    // levels of the strokes, from a patch of them
+    void getLevels(SketchStrokes &strokes, double radius, double sigma, double angle);
+    template <class PIX, int nComponents, int maxValue>
+    void sketchImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, const SketchStrokes &strokes);
+
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
     OFX::DoubleParam *radius_;
     OFX::DoubleParam *sigma_;
     OFX::DoubleParam *angle_;
-    OFX::BooleanParam *enableOpenMP_;
+
+    // levels of the last strokes
+    OFX::MultiThread::Mutex levelsMutex_;
+    unsigned long long levelsKey_;
+    float black_;
+    float white_;
 };
 
 SketchPlugin::SketchPlugin(OfxImageEffectHandle handle)
@@ -81,26 +298,60 @@ SketchPlugin::SketchPlugin(OfxImageEffectHandle handle)
 , radius_(NULL)
 , sigma_(NULL)
 , angle_(NULL)
-, enableOpenMP_(NULL)
+, levelsKey_(0)
+, black_(0.f)
+, white_(1.f)
 {
-    Magick::InitializeMagick(NULL);
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB));
     srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(srcClip_ && srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(srcClip_ && (srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentRGB));
 
     radius_ = fetchDoubleParam(kParamRadius);
     sigma_ = fetchDoubleParam(kParamSigma);
     angle_ = fetchDoubleParam(kParamAngle);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
 
-    assert(radius_ && sigma_ && angle_ && enableOpenMP_);
+    assert(radius_ && sigma_ && angle_);
 }
 
 SketchPlugin::~SketchPlugin()
 {
 }
 
+void SketchPlugin::getLevels(SketchStrokes &strokes, double radius, double sigma, double angle)
+{
+    MagickCacheKey key;
+    key.add(radius);
+    key.add(sigma);
+    key.add(angle);
+
+    OFX::MultiThread::AutoMutex lock(levelsMutex_);
+    if (levelsKey_ != key.value()) {
+        std::vector<unsigned int> histogram(kArenaLevelBins, 0);
+        SketchStrokeFilter filter(strokes, 0, kSketchLevelsPatch, 0);
+        for (int y = 0; y < kSketchLevelsPatch; ++y) {
+            arenaAddLevels(filter.next(), kSketchLevelsPatch, &histogram[0]);
+        }
+        arenaNormalizeLevels(&histogram[0], black_, white_);
+        levelsKey_ = key.value();
+#ifdef DEBUG
+        std::cout << kPluginIdentifier << " levels " << black_ << " " << white_ << std::endl;
+#endif
+    }
+    strokes.black = black_;
+    strokes.white = white_;
+}
+
+template <class PIX, int nComponents, int maxValue>
+void SketchPlugin::sketchImage(const OFX::Image *srcImg, OFX::Image *dstImg, const OfxRectI &window, const SketchStrokes &strokes)
+{
+    SketchProcessor<PIX, nComponents, maxValue> processor(*this, srcImg, dstImg, window, strokes);
+    unsigned int nThreads = std::max(1u, std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1)));
+    processor.multiThread(nThreads);
+}
+
 void SketchPlugin::render(const OFX::RenderArguments &args)
 {
     // render scale
@@ -109,6 +360,8 @@ void SketchPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!srcClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -116,10 +369,7 @@ void SketchPlugin::render(const OFX::RenderArguments &args)
     }
     assert(srcClip_);
     OFX::auto_ptr<const OFX::Image> srcImg(srcClip_->fetchImage(args.time));
-    OfxRectI srcRod,srcBounds;
     if (srcImg.get()) {
-        srcRod = srcImg->getRegionOfDefinition();
-        srcBounds = srcImg->getBounds();
         if (srcImg->getRenderScale().x != args.renderScale.x ||
             srcImg->getRenderScale().y != args.renderScale.y ||
             srcImg->getField() != args.fieldToRender) {
@@ -129,6 +379,7 @@ void SketchPlugin::render(const OFX::RenderArguments &args)
         }
     } else {
         OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
     }
 
     // get dest clip
@@ -150,16 +401,10 @@ void SketchPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get bit depth
+    // get bit depth and pixel component
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
-        OFX::throwSuiteStatusException(kOfxStatErrFormat);
-        return;
-    }
-
-    // get pixel component
-    OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA) {
+    OFX::PixelComponentEnum dstComponents = dstImg->getPixelComponents();
+    if (dstBitDepth != srcImg->getPixelDepth() || dstComponents != srcImg->getPixelComponents()) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -172,46 +417,64 @@ void SketchPlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get params
+    // get params, radius and sigma in pixels at render scale
     double radius, sigma, angle;
-    bool enableOpenMP = false;
     radius_->getValueAtTime(args.time, radius);
     sigma_->getValueAtTime(args.time, sigma);
     angle_->getValueAtTime(args.time, angle);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
-
-    // setup
-    int width = srcRod.x2-srcRod.x1;
-    int height = srcRod.y2-srcRod.y1;
-
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
+    radius = std::floor(radius * args.renderScale.x + 0.5);
+    sigma = std::floor(sigma * args.renderScale.x + 0.5);
+
+    // cached result, each pixel only depends on the source pixel below it
+    timer.next("cache");
+    MagickCacheKey key;
+    key.add(kPluginIdentifier);
+    key.add(radius);
+    key.add(sigma);
+    key.add(angle);
+    key.add(args.renderWindow);
+    key.addPixels(srcImg.get(), args.renderWindow);
+    if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get()))
+        return;
 
-    // read image
-    Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,1)"));
-    if (srcClip_ && srcClip_->isConnected())
-        image.read(width,height,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
+    timer.next("levels");
+    SketchStrokes strokes(radius, sigma, angle);
+    getLevels(strokes, radius, sigma, angle);
 
     // sketch
-    image.sketch(std::floor(radius * args.renderScale.x + 0.5),std::floor(sigma * args.renderScale.x + 0.5),angle);
-
-    // return image
-    if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(image, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(image, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(image, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+    timer.next("sketch");
+    int nComponents = dstImg->getPixelComponentCount();
+    switch (dstBitDepth) {
+    case OFX::eBitDepthUByte:
+        if (nComponents == 4) {
+            sketchImage<unsigned char, 4, 255>(srcImg.get(), dstImg.get(), args.renderWindow, strokes);
+        } else {
+            sketchImage<unsigned char, 3, 255>(srcImg.get(), dstImg.get(), args.renderWindow, strokes);
+        }
+        break;
+    case OFX::eBitDepthUShort:
+        if (nComponents == 4) {
+            sketchImage<unsigned short, 4, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, strokes);
+        } else {
+            sketchImage<unsigned short, 3, 65535>(srcImg.get(), dstImg.get(), args.renderWindow, strokes);
+        }
+        break;
+    case OFX::eBitDepthFloat:
+        if (nComponents == 4) {
+            sketchImage<float, 4, 1>(srcImg.get(), dstImg.get(), args.renderWindow, strokes);
+        } else {
+            sketchImage<float, 3, 1>(srcImg.get(), dstImg.get(), args.renderWindow, strokes);
+        }
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        return;
     }
+
+    if (abort())
+        return;
+
+    MagickResultCache::store(key, args.renderWindow, dstImg.get());
 }
 
 bool SketchPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
@@ -244,6 +507,8 @@ void SketchPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     desc.setSupportsTiles(kSupportsTiles);
@@ -257,13 +522,10 @@ void SketchPluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void SketchPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-
     // create the mandated source clip
     ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
@@ -271,6 +533,7 @@ void SketchPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, Co
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make some pages
@@ -303,17 +566,6 @@ void SketchPluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, Co
         param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
     }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
-    }
 }
 
 /** @brief The create instance function, the plugin must return an object derived from the \ref OFX::ImageEffect class */
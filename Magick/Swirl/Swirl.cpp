@@ -45,7 +45,7 @@ class SwirlPlugin
 {
 public:
     SwirlPlugin(OfxImageEffectHandle handle)
-        : MagickPluginHelper<kSupportsRenderScale>(handle)
+        : MagickPluginHelper<kSupportsRenderScale>(handle, kPluginIdentifier)
         , _swirl(NULL)
     {
         _swirl = fetchDoubleParam(kParamSwirl);
@@ -58,6 +58,31 @@ public:
         _swirl->getValueAtTime(args.time, amount);
         image.swirl(amount);
     }
+
+    virtual bool renderNative(const OFX::RenderArguments &args, const OFX::Image *srcImg, OFX::Image *dstImg, ArenaWarpEdgeEnum edge) OVERRIDE FINAL
+    {
+        double amount;
+        _swirl->getValueAtTime(args.time, amount);
+        OfxRectI srcRod = srcImg->getRegionOfDefinition();
+        ArenaSwirlMap swirl(srcRod, amount);
+        return arenaWarp(*this, srcImg, dstImg, args.renderWindow, srcRod, swirl, eArenaWarpFilterBilinear, edge);
+    }
+
+    // the ImageMagick swirl is slow, cache its result
+    virtual bool getCacheKey(const OFX::RenderArguments &args, MagickCacheKey &key) OVERRIDE FINAL
+    {
+        double amount;
+        _swirl->getValueAtTime(args.time, amount);
+        key.add(amount);
+        return true;
+    }
+
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &args) OVERRIDE FINAL
+    {
+        double amount;
+        _swirl->getValueAtTime(args.time, amount);
+        return amount == 0.;
+    }
 private:
     DoubleParam *_swirl;
 };
@@ -71,6 +96,9 @@ void SwirlPluginFactory::describe(ImageEffectDescriptor &desc)
     desc.setPluginDescription(kPluginDescription);
     desc.addSupportedContext(eContextGeneral);
     desc.addSupportedContext(eContextFilter);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
     desc.setSupportsTiles(kSupportsTiles);
     desc.setSupportsMultiResolution(kSupportsMultiResolution);
@@ -21,6 +21,7 @@
 #include "ofxsImageEffect.h"
 #include "ofxNatron.h"
 #include <Magick++.h>
+#include "MagickThreads.h"
 #include <sstream>
 #include <iostream>
 #include <stdint.h>
@@ -405,13 +406,7 @@ void TextPlugin::render(const OFX::RenderArguments &args)
         fontName=fontOverride;
 
     // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
+    MagickThreadBudget threads(_hasOpenMP && enableOpenMP);
 
     // Generate empty image
     int width = dstRod.x2-dstRod.x1;
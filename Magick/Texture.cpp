@@ -20,17 +20,27 @@
 #include "ofxsImageEffect.h"
 #include "ofxNatron.h"
 #include <Magick++.h>
+#include "ArenaTimer.h"
+#include "MagickCache.h"
+#include "MagickPixels.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 #define kPluginName "TextureOFX"
 #define kPluginGrouping "Extra/Draw"
 #define kPluginIdentifier "net.fxarena.openfx.Texture"
-#define kPluginVersionMajor 3
-#define kPluginVersionMinor 7
+#define kPluginVersionMajor 4
+#define kPluginVersionMinor 0
 
-#define kSupportsTiles 0
-#define kSupportsMultiResolution 0
-#define kSupportsRenderScale 0
+#define kSupportsTiles 1
+#define kSupportsMultiResolution 1
+#define kSupportsRenderScale 1
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
@@ -62,14 +72,8 @@
 #define kParamToColorLabel "Color to"
 #define kParamToColorHint "Set end color, you must set a start color for this to work. Valid values are : none (transparent), color name (red, blue etc) or hex colors"
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault false
-
 using namespace OFX;
 static bool gHostIsNatron = false;
-static bool _hasOpenMP = false;
 
 static unsigned int hash(unsigned int a)
 {
@@ -81,6 +85,542 @@ static unsigned int hash(unsigned int a)
     return a;
 }
 
+/* Every generator is a pure function of (seed, frame, x, y): random numbers come from hashing
+ * these counters instead of a shared generator, so any tile can be rendered on its own, in any
+ * order and from any thread, and gives the same pixels as a full frame render.
+ * Positions are full resolution pixels from the first pixel of the canvas, lower render scales
+ * sample the same texture. Lattice noise wraps around the canvas so the textures tile. */
+
+// random stream of a frame, one per channel and octave
+static unsigned int
+textureKey(int seed, int frame, int stream)
+{
+    return hash(hash(hash((unsigned int)seed) ^ (unsigned int)frame) ^ (unsigned int)stream);
+}
+
+// uniform random number in ]0,1] at the integer position (x,y) of stream key, rowHash is hash(y)
+static inline double
+textureUniform(unsigned int key, int x, unsigned int rowHash)
+{
+    unsigned int h = hash(key ^ hash((unsigned int)x ^ rowHash));
+    return ((h >> 8) + 1) * (1. / 16777216.);
+}
+
+static inline int
+textureWrap(int i, int n)
+{
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+static inline double
+textureClamp(double v)
+{
+    return v < 0. ? 0. : v > 1. ? 1. : v;
+}
+
+static inline double
+textureFade(double t)
+{
+    return t * t * t * (t * (t * 6. - 15.) + 10.);
+}
+
+static inline double
+textureFadeDerivative(double t)
+{
+    return 30. * t * t * (t * (t - 2.) + 1.);
+}
+
+/* Adds amplitude times the smooth value noise in [0,1] at the count positions x of row y to sum,
+ * and its gradient in full resolution pixels to gradX and gradY if they are not NULL.
+ * The lattice has periodX x periodY cells stretched over the canvas and wraps around it,
+ * corner values are only hashed when the positions enter a new cell. */
+static void
+textureValueNoiseRow(unsigned int key, const double *x, int count, double y, double width, double height,
+                     int periodX, int periodY, double amplitude, double *sum, double *gradX, double *gradY)
+{
+    double scaleX = periodX / width;
+    double scaleY = periodY / height;
+    double v = y * scaleY;
+    double fv = std::floor(v);
+    int j0 = textureWrap((int)fv, periodY);
+    int j1 = j0 + 1 < periodY ? j0 + 1 : 0;
+    unsigned int h0 = hash((unsigned int)j0);
+    unsigned int h1 = hash((unsigned int)j1);
+    double sv = textureFade(v - fv);
+    double dsv = textureFadeDerivative(v - fv);
+    bool haveCell = false;
+    int cell = 0;
+    double a = 0., b = 0., c = 0., d = 0.;
+
+    for (int k = 0; k < count; ++k) {
+        double u = x[k] * scaleX;
+        double fu = std::floor(u);
+        int i = (int)fu;
+        if (!haveCell || i != cell) {
+            int i1 = textureWrap(i + 1, periodX);
+            if (haveCell && i == cell + 1) {
+                a = b;
+                c = d;
+            } else {
+                int i0 = textureWrap(i, periodX);
+                a = textureUniform(key, i0, h0);
+                c = textureUniform(key, i0, h1);
+            }
+            b = textureUniform(key, i1, h0);
+            d = textureUniform(key, i1, h1);
+            cell = i;
+            haveCell = true;
+        }
+        double su = textureFade(u - fu);
+        double low = a + (b - a) * su;
+        double high = c + (d - c) * su;
+        sum[k] += amplitude * (low + (high - low) * sv);
+        if (gradX) {
+            gradX[k] += amplitude * textureFadeDerivative(u - fu) * ((b - a) + ((d - c) - (b - a)) * sv) * scaleX;
+            gradY[k] += amplitude * dsv * (high - low) * scaleY;
+        }
+    }
+}
+
+// inverse of the standard normal distribution function (Acklam's approximation)
+static double
+textureInverseNormal(double p)
+{
+    static const double a[6] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+    static const double b[5] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                 6.680131188771972e+01, -1.328068155288572e+01 };
+    static const double c[6] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                 -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+    static const double d[4] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                 3.754408661907416e+00 };
+
+    if ( (p > 0.02425) && (p < 0.97575) ) {
+        double q = p - 0.5;
+        double r = q * q;
+
+        return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+               (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.);
+    }
+    double q = std::sqrt( -2. * std::log(p < 0.5 ? p : 1. - p) );
+    double x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.);
+
+    return p < 0.5 ? x : -x;
+}
+
+enum TextureNoiseEnum
+{
+    eTextureNoiseGaussian = 0,
+    eTextureNoiseImpulse,
+    eTextureNoiseLaplacian
+};
+
+#define kTextureNoiseBits 12
+
+/* Noise added to black, with the spread of the ImageMagick noise types, tabulated over the
+ * top kTextureNoiseBits bits of a uniform random number. */
+static void
+textureNoiseTable(TextureNoiseEnum type, std::vector<float> &table)
+{
+    table.resize(1 << kTextureNoiseBits);
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        double p = (i + 0.5) / table.size();
+        double v = 0.;
+        switch (type) {
+        case eTextureNoiseGaussian:
+            v = 0.078125 * textureInverseNormal(p);
+            break;
+        case eTextureNoiseImpulse:
+            v = p >= 0.95 ? 1. : 0.;
+            break;
+        case eTextureNoiseLaplacian:
+            v = p <= 0.5 ? 0. : -0.0390625 * std::log(2. * (1. - p));
+            break;
+        }
+        table[i] = (float)textureClamp(v);
+    }
+}
+
+// one random number per channel of the pixel (x,y) of stream key, rowHash is hash(y)
+static inline unsigned int
+textureChannelHash(unsigned int key, int x, unsigned int rowHash, int c)
+{
+    return hash(hash(key ^ hash((unsigned int)x ^ rowHash)) ^ ((unsigned int)(c + 1) * 0x9e3779b9u));
+}
+
+class TextureGenerator
+{
+public:
+    TextureGenerator(int seed, int frame, double width, double height)
+        : _seed(seed)
+        , _frame(frame)
+        , _width(width)
+        , _height(height)
+    {
+    }
+    virtual ~TextureGenerator() {}
+    // unpremultiplied colors of the count full resolution positions x of row y of the canvas
+    virtual void row(const double *x, int count, double y, float *rgba) const = 0;
+protected:
+    int _seed;
+    int _frame;
+    double _width, _height;
+};
+
+class TextureNoise
+    : public TextureGenerator
+{
+public:
+    TextureNoise(int seed, int frame, double width, double height, TextureNoiseEnum type)
+        : TextureGenerator(seed, frame, width, height)
+        , _key(textureKey(seed, frame, 0))
+    {
+        textureNoiseTable(type, _table);
+    }
+    virtual void row(const double *x, int count, double y, float *rgba) const OVERRIDE FINAL
+    {
+        unsigned int rowHash = hash((unsigned int)(int)std::floor(y));
+        for (int k = 0; k < count; ++k, rgba += 4) {
+            int i = (int)std::floor(x[k]);
+            for (int c = 0; c < 3; ++c) {
+                rgba[c] = _table[textureChannelHash(_key, i, rowHash, c) >> (32 - kTextureNoiseBits)];
+            }
+            rgba[3] = 1.f;
+        }
+    }
+private:
+    unsigned int _key;
+    std::vector<float> _table;
+};
+
+// negated green noise of one row stretched over the canvas
+class TextureStripes
+    : public TextureGenerator
+{
+public:
+    TextureStripes(int seed, int frame, double width, double height)
+        : TextureGenerator(seed, frame, width, height)
+        , _key(textureKey(seed, frame, 0))
+    {
+        textureNoiseTable(eTextureNoiseGaussian, _table);
+    }
+    virtual void row(const double *x, int count, double /*y*/, float *rgba) const OVERRIDE FINAL
+    {
+        unsigned int rowHash = hash(0);
+        for (int k = 0; k < count; ++k, rgba += 4) {
+            float v = 1.f - _table[textureChannelHash(_key, (int)std::floor(x[k]), rowHash, 1) >> (32 - kTextureNoiseBits)];
+            rgba[0] = rgba[1] = rgba[2] = v;
+            rgba[3] = 1.f;
+        }
+    }
+private:
+    unsigned int _key;
+    std::vector<float> _table;
+};
+
+#define kTextureOctavesMax 10
+
+// fractal clouds, either one cloud per channel or a blend between two colors
+class TexturePlasma
+    : public TextureGenerator
+{
+public:
+    TexturePlasma(int seed, int frame, double width, double height, bool fractal, bool blend, const float from[4], const float to[4])
+        : TextureGenerator(seed, frame, width, height)
+        , _blend(blend)
+        , _octaves(0)
+        , _weight(0.)
+    {
+        for (int c = 0; c < 4; ++c) {
+            _from[c] = from[c];
+            _to[c] = to[c];
+        }
+        // octaves of value noise, the first one with cells of about cell pixels, each next one halving them down to two pixels
+        double cell = std::min(width, height) / (fractal ? 4. : 2.);
+        double persistence = fractal ? 0.7 : 0.5;
+        double amplitude = 1.;
+        for (; _octaves < kTextureOctavesMax && (_octaves == 0 || cell >= 2.); ++_octaves, cell *= 0.5, amplitude *= persistence) {
+            _periodX[_octaves] = std::max(1, (int)std::floor(width / cell + 0.5));
+            _periodY[_octaves] = std::max(1, (int)std::floor(height / cell + 0.5));
+            _amplitude[_octaves] = amplitude;
+            _weight += amplitude;
+            for (int c = 0; c < 3; ++c) {
+                _keys[c][_octaves] = textureKey(seed, frame, c * 16 + _octaves);
+            }
+        }
+    }
+    virtual void row(const double *x, int count, double y, float *rgba) const OVERRIDE FINAL
+    {
+        std::vector<double> sum(count);
+        for (int c = 0; c < (_blend ? 1 : 3); ++c) {
+            std::fill(sum.begin(), sum.end(), 0.);
+            for (int octave = 0; octave < _octaves; ++octave) {
+                textureValueNoiseRow(_keys[c][octave], x, count, y, _width, _height, _periodX[octave], _periodY[octave],
+                                     _amplitude[octave], &sum[0], NULL, NULL);
+            }
+            for (int k = 0; k < count; ++k) {
+                rgba[k * 4 + c] = (float)textureClamp(0.5 + (sum[k] / _weight - 0.5) * 2.5);
+            }
+        }
+        for (int k = 0; k < count; ++k, rgba += 4) {
+            if (_blend) {
+                float t = rgba[0];
+                for (int c = 0; c < 4; ++c) {
+                    rgba[c] = _from[c] + (_to[c] - _from[c]) * t;
+                }
+            } else {
+                rgba[3] = 1.f;
+            }
+        }
+    }
+private:
+    bool _blend;
+    float _from[4], _to[4];
+    int _octaves;
+    int _periodX[kTextureOctavesMax], _periodY[kTextureOctavesMax];
+    double _amplitude[kTextureOctavesMax];
+    double _weight;
+    unsigned int _keys[3][kTextureOctavesMax];
+};
+
+// the ImageMagick checkerboard pattern, 15 pixel squares
+class TextureCheckerboard
+    : public TextureGenerator
+{
+public:
+    TextureCheckerboard(double width, double height)
+        : TextureGenerator(0, 0, width, height)
+    {
+    }
+    virtual void row(const double *x, int count, double y, float *rgba) const OVERRIDE FINAL
+    {
+        int j = (int)std::floor(y / 15.);
+        for (int k = 0; k < count; ++k, rgba += 4) {
+            int i = (int)std::floor(x[k] / 15.);
+            float v = ((i + j) & 1) ? 0.4f : 0.6f;
+            rgba[0] = rgba[1] = rgba[2] = v;
+            rgba[3] = 1.f;
+        }
+    }
+};
+
+// linear gradient from the first to the last row, or radial from the centre to the corners
+class TextureGradient
+    : public TextureGenerator
+{
+public:
+    TextureGradient(double width, double height, bool radial, const float from[4], const float to[4])
+        : TextureGenerator(0, 0, width, height)
+        , _radial(radial)
+    {
+        for (int c = 0; c < 4; ++c) {
+            _from[c] = from[c];
+            _to[c] = to[c];
+        }
+    }
+    virtual void row(const double *x, int count, double y, float *rgba) const OVERRIDE FINAL
+    {
+        double radius = 0.5 * std::sqrt(_width * _width + _height * _height);
+        double dy = y - 0.5 * _height;
+        for (int k = 0; k < count; ++k, rgba += 4) {
+            double t;
+            if (_radial) {
+                double dx = x[k] - 0.5 * _width;
+                t = std::sqrt(dx * dx + dy * dy) / radius;
+            } else {
+                t = _height > 1. ? (y - 0.5) / (_height - 1.) : 0.;
+            }
+            t = textureClamp(t);
+            for (int c = 0; c < 4; ++c) {
+                rgba[c] = (float)(_from[c] + (_to[c] - _from[c]) * t);
+            }
+        }
+    }
+private:
+    bool _radial;
+    float _from[4], _to[4];
+};
+
+/* Soft lines along the contours of smooth noise, one set per channel. The ImageMagick version
+ * blurred, normalized and banded noise and blurred its edges, the noise type set the size of
+ * the loops. */
+class TextureLoops
+    : public TextureGenerator
+{
+public:
+    TextureLoops(int seed, int frame, double width, double height, TextureNoiseEnum type)
+        : TextureGenerator(seed, frame, width, height)
+        , _octaves(type == eTextureNoiseLaplacian ? 2 : 1)
+    {
+        double cell = type == eTextureNoiseGaussian ? 24. : type == eTextureNoiseImpulse ? 40. : 32.;
+        _periodX = std::max(1, (int)std::floor(width / cell + 0.5));
+        _periodY = std::max(1, (int)std::floor(height / cell + 0.5));
+        for (int c = 0; c < 3; ++c) {
+            _keys[c] = textureKey(seed, frame, c);
+        }
+    }
+    virtual void row(const double *x, int count, double y, float *rgba) const OVERRIDE FINAL
+    {
+        std::vector<double> n(count), gradX(count), gradY(count);
+        double weight = _octaves == 1 ? 1. : 1.5;
+        for (int c = 0; c < 3; ++c) {
+            std::fill(n.begin(), n.end(), 0.);
+            std::fill(gradX.begin(), gradX.end(), 0.);
+            std::fill(gradY.begin(), gradY.end(), 0.);
+            for (int octave = 0; octave < _octaves; ++octave) {
+                textureValueNoiseRow(_keys[c] + octave, x, count, y, _width, _height, _periodX << octave, _periodY << octave,
+                                     1. / (1 << octave), &n[0], &gradX[0], &gradY[0]);
+            }
+            for (int k = 0; k < count; ++k) {
+                // contrast stretched noise, flat where it saturates
+                double v = 0.5 + (n[k] / weight - 0.5) * 2.;
+                double value = 0.;
+                if ( (v > 0.) && (v < 1.) ) {
+                    // distance in pixels to the nearest band edge of sin(4 pi v)
+                    double slope = 4. * M_PI * 2. / weight * std::sqrt(gradX[k] * gradX[k] + gradY[k] * gradY[k]);
+                    double d = slope > 1e-9 ? std::fabs( std::sin(4. * M_PI * v) ) / slope : 1e9;
+                    if (d < 12.) {
+                        value = std::exp(-0.5 * d * d / 4.);
+                    }
+                }
+                rgba[k * 4 + c] = (float)value;
+            }
+        }
+        for (int k = 0; k < count; ++k) {
+            rgba[k * 4 + 3] = 1.f;
+        }
+    }
+private:
+    int _octaves;
+    int _periodX, _periodY;
+    unsigned int _keys[3];
+};
+
+template <class PIX, int nComponents>
+class TextureProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    TextureProcessor(OFX::ImageEffect &effect, OFX::Image *dstImg, const OfxRectI &window, const TextureGenerator &generator,
+                     const OfxPointD &scale, const OfxPointD &origin)
+        : _effect(effect)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _generator(generator)
+        , _scale(scale)
+        , _origin(origin)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        int width = _window.x2 - _window.x1;
+        if ( (y1 >= y2) || (width <= 0) ) {
+            return;
+        }
+        std::vector<double> u(width);
+        std::vector<float> rgba(width * 4);
+        for (int x = 0; x < width; ++x) {
+            u[x] = (_window.x1 + x + 0.5) * _scale.x - _origin.x;
+        }
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            _generator.row(&u[0], width, (y + 0.5) * _scale.y - _origin.y, &rgba[0]);
+            PIX *dst = (PIX*)_dstImg->getPixelAddress(_window.x1, y);
+            const float *src = &rgba[0];
+            for (int x = 0; x < width; ++x, dst += nComponents, src += 4) {
+                if (nComponents == 1) {
+                    dst[0] = convert(src[3]);
+                } else {
+                    float alpha = nComponents == 4 ? src[3] : 1.f;
+                    for (int c = 0; c < 3; ++c) {
+                        dst[c] = convert(src[c] * alpha);
+                    }
+                    if (nComponents == 4) {
+                        dst[3] = convert(alpha);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static PIX convert(float v)
+    {
+        return MagickPixelTraits<PIX>::fromFloat(v);
+    }
+
+    OFX::ImageEffect &_effect;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    const TextureGenerator &_generator;
+    OfxPointD _scale;
+    OfxPointD _origin;
+};
+
+template <class PIX, int nComponents>
+static void
+generateImage(OFX::ImageEffect &effect, OFX::Image *dstImg, const OfxRectI &window, const TextureGenerator &generator,
+              const OfxPointD &scale, const OfxPointD &origin)
+{
+    TextureProcessor<PIX, nComponents> processor(effect, dstImg, window, generator, scale, origin);
+    unsigned int nThreads = std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(window.y2 - window.y1));
+    processor.multiThread(std::max(1u, nThreads));
+}
+
+template <class PIX>
+static void
+generateComponents(OFX::ImageEffect &effect, OFX::Image *dstImg, const OfxRectI &window, const TextureGenerator &generator,
+                   const OfxPointD &scale, const OfxPointD &origin)
+{
+    switch (dstImg->getPixelComponentCount()) {
+    case 4:
+        generateImage<PIX, 4>(effect, dstImg, window, generator, scale, origin);
+        break;
+    case 3:
+        generateImage<PIX, 3>(effect, dstImg, window, generator, scale, origin);
+        break;
+    case 1:
+        generateImage<PIX, 1>(effect, dstImg, window, generator, scale, origin);
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        break;
+    }
+}
+
+// checkerboard and gradients do not depend on the seed or the frame
+static bool
+textureIsStatic(int effect)
+{
+    return effect == 5 || effect == 7 || effect == 8;
+}
+
+// unpremultiplied RGBA of an ImageMagick color string, false if it can not be parsed
+static bool
+textureColor(const std::string &color, float rgba[4])
+{
+    try {
+        Magick::Image pixel(Magick::Geometry(1, 1), Magick::Color(color));
+        pixel.write(0, 0, 1, 1, "RGBA", Magick::FloatPixel, rgba);
+    }
+    catch (Magick::Exception &e) {
+        #ifdef DEBUG
+        std::cout << e.what() << std::endl;
+        #endif
+        return false;
+    }
+    return true;
+}
+
 class TexturePlugin : public OFX::ImageEffect
 {
 public:
@@ -90,6 +630,9 @@ public:
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
     virtual void getClipPreferences(OFX::ClipPreferencesSetter &clipPreferences) OVERRIDE FINAL;
 private:
+    // canonical rectangle the textures are laid out on
+    OfxRectD getCanvas();
+
     OFX::Clip *dstClip_;
     OFX::ChoiceParam *effect_;
     OFX::IntParam *seed_;
@@ -97,7 +640,6 @@ private:
     OFX::IntParam *height_;
     OFX::StringParam *fromColor_;
     OFX::StringParam *toColor_;
-    OFX::BooleanParam *enableOpenMP_;
 };
 
 TexturePlugin::TexturePlugin(OfxImageEffectHandle handle)
@@ -109,12 +651,13 @@ TexturePlugin::TexturePlugin(OfxImageEffectHandle handle)
 , height_(NULL)
 , fromColor_(NULL)
 , toColor_(NULL)
-, enableOpenMP_(NULL)
 {
     Magick::InitializeMagick(NULL);
 
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA || dstClip_->getPixelComponents() == OFX::ePixelComponentRGB));
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentAlpha));
 
     effect_ = fetchChoiceParam(kParamEffect);
     seed_ = fetchIntParam(kParamSeed);
@@ -122,19 +665,46 @@ TexturePlugin::TexturePlugin(OfxImageEffectHandle handle)
     height_ = fetchIntParam(kParamHeight);
     fromColor_ = fetchStringParam(kParamFromColor);
     toColor_ = fetchStringParam(kParamToColor);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
 
-    assert(effect_ && seed_ && width_ && height_ && fromColor_ && toColor_ && enableOpenMP_);
+    assert(effect_ && seed_ && width_ && height_ && fromColor_ && toColor_);
 }
 
 TexturePlugin::~TexturePlugin()
 {
 }
 
-/* set the frame varying flag */
+/* Random backgrounds change on every frame, the others only when their parameters are animated */
 void TexturePlugin::getClipPreferences(OFX::ClipPreferencesSetter &clipPreferences)
 {
-    clipPreferences.setOutputFrameVarying(true);
+    int effect;
+    effect_->getValue(effect);
+    bool varying = !textureIsStatic(effect) || effect_->getNumKeys() > 0 ||
+                   width_->getNumKeys() > 0 || height_->getNumKeys() > 0;
+    if (effect != 5) {
+        varying = varying || fromColor_->getNumKeys() > 0 || toColor_->getNumKeys() > 0;
+    }
+    clipPreferences.setOutputFrameVarying(varying);
+}
+
+OfxRectD TexturePlugin::getCanvas()
+{
+    int width, height;
+    width_->getValue(width);
+    height_->getValue(height);
+    OfxRectD canvas;
+    if (width > 0 && height > 0) {
+        canvas.x1 = canvas.y1 = 0.;
+        canvas.x2 = width;
+        canvas.y2 = height;
+    } else {
+        OfxPointD offset = getProjectOffset();
+        OfxPointD size = getProjectSize();
+        canvas.x1 = offset.x;
+        canvas.y1 = offset.y;
+        canvas.x2 = offset.x + size.x;
+        canvas.y2 = offset.y + size.y;
+    }
+    return canvas;
 }
 
 /* Override the render */
@@ -145,6 +715,8 @@ void TexturePlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     if (!dstClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
         return;
@@ -166,7 +738,7 @@ void TexturePlugin::render(const OFX::RenderArguments &args)
     }
 
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat && dstBitDepth != OFX::eBitDepthUShort && dstBitDepth != OFX::eBitDepthUByte) {
+    if (dstBitDepth != OFX::eBitDepthFloat && dstBitDepth != OFX::eBitDepthHalf && dstBitDepth != OFX::eBitDepthUShort && dstBitDepth != OFX::eBitDepthUByte) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -179,7 +751,6 @@ void TexturePlugin::render(const OFX::RenderArguments &args)
 
     // are we in the image bounds
     OfxRectI dstBounds = dstImg->getBounds();
-    OfxRectI dstRod = dstImg->getRegionOfDefinition();
     if(args.renderWindow.x1 < dstBounds.x1 || args.renderWindow.x1 >= dstBounds.x2 || args.renderWindow.y1 < dstBounds.y1 || args.renderWindow.y1 >= dstBounds.y2 ||
        args.renderWindow.x2 <= dstBounds.x1 || args.renderWindow.x2 > dstBounds.x2 || args.renderWindow.y2 <= dstBounds.y1 || args.renderWindow.y2 > dstBounds.y2) {
         OFX::throwSuiteStatusException(kOfxStatErrValue);
@@ -188,113 +759,126 @@ void TexturePlugin::render(const OFX::RenderArguments &args)
 
     // Get params
     int effect,seed;
-    bool enableOpenMP = false;
     std::string fromColor, toColor;
     effect_->getValueAtTime(args.time, effect);
     seed_->getValueAtTime(args.time, seed);
     fromColor_->getValueAtTime(args.time, fromColor);
     toColor_->getValueAtTime(args.time, toColor);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
 
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
-
-    // Generate empty image
-    int width = dstRod.x2-dstRod.x1;
-    int height = dstRod.y2-dstRod.y1;
-    Magick::Image image(Magick::Geometry(width,height),Magick::Color("rgba(0,0,0,0)"));
+    // colors, both have to be set
+    float from[4] = {1.f, 1.f, 1.f, 1.f};
+    float to[4] = {0.f, 0.f, 0.f, 1.f};
+    bool blend = !fromColor.empty() && !toColor.empty() && textureColor(fromColor, from) && textureColor(toColor, to);
+    if (!blend) {
+        from[0] = from[1] = from[2] = 1.f;
+        from[3] = to[3] = 1.f;
+        to[0] = to[1] = to[2] = 0.f;
+    }
 
-    // Set seed
-#ifndef NOMAGICKSEED
-    Magick::SetRandomSeed(hash((unsigned)(args.time)^seed));
-#endif
+    // canvas in full resolution pixels, the texture of a frame does not depend on the render window or scale
+    double par = dstImg->getPixelAspectRatio();
+    OfxRectD canvas = getCanvas();
+    double width = (canvas.x2 - canvas.x1) / par;
+    double height = canvas.y2 - canvas.y1;
+    if (width < 1. || height < 1.) {
+        width = std::max(1., width);
+        height = std::max(1., height);
+    }
+    OfxPointD scale, origin;
+    scale.x = 1. / args.renderScale.x;
+    scale.y = 1. / args.renderScale.y;
+    origin.x = canvas.x1 / par;
+    origin.y = canvas.y1;
+    int frame = (int)std::floor(args.time);
 
-    // generate background
-    try {
-        switch (effect) {
-        case 0: // Plasma
-            if (fromColor.empty() && toColor.empty())
-                image.read("plasma:");
-            else
-                image.read("plasma:"+fromColor+"-"+toColor);
-            break;
-        case 1: // Plasma Fractal
-            image.read("plasma:fractal");
-            break;
-        case 2: // GaussianNoise
-            image.addNoise(Magick::GaussianNoise);
-            break;
-        case 3: // ImpulseNoise
-            image.addNoise(Magick::ImpulseNoise);
-            break;
-        case 4: // LaplacianNoise
-            image.addNoise(Magick::LaplacianNoise);
-            break;
-        case 5: // checkerboard
-            image.read("pattern:checkerboard");
-            break;
-        case 6: // stripes
-            image.extent(Magick::Geometry(width,1));
-            image.addNoise(Magick::GaussianNoise);
-            image.channel(Magick::GreenChannel);
-            image.negate();
-            image.scale(Magick::Geometry(width,height));
-            break;
-        case 7: // gradient
-            if (fromColor.empty() && toColor.empty())
-                image.read("gradient:");
-            else
-                image.read("gradient:"+fromColor+"-"+toColor);
-            break;
-        case 8: // radial-gradient
-            if (fromColor.empty() && toColor.empty())
-                image.read("radial-gradient:");
-            else
-                image.read("radial-gradient:"+fromColor+"-"+toColor);
-            break;
-        case 9: // loops1
-            image.addNoise(Magick::GaussianNoise);
-            break;
-        case 10: // loops2
-            image.addNoise(Magick::ImpulseNoise);
-            break;
-        case 11: // loops3
-            image.addNoise(Magick::LaplacianNoise);
-            break;
+    // static backgrounds are the same on every frame, serve the last render of the same window
+    bool isStatic = textureIsStatic(effect);
+    MagickCacheKey key;
+    if (isStatic) {
+        key.add(kPluginIdentifier);
+        key.add(effect);
+        key.add(width);
+        key.add(height);
+        key.add(origin.x);
+        key.add(origin.y);
+        for (int c = 0; c < 4; ++c) {
+            key.add((double)from[c]);
+            key.add((double)to[c]);
         }
-        if (effect>8 && effect<12) { // loops 1 2 3
-#if MagickLibVersion >= 0x700
-            image.alpha(false);
-#else
-            image.matte(false);
-#endif
-            image.blur(0,10);
-            image.normalize();
-            image.fx("sin(u*4*pi)*100");
-            image.edge(1);
-            image.blur(0,10);
-#if MagickLibVersion >= 0x700
-            image.alpha(true);
-#else
-            image.matte(true);
-#endif
+        key.add(args.renderScale.x);
+        key.add(args.renderScale.y);
+        key.add(args.renderWindow);
+        key.add((int)dstBitDepth);
+        key.add((int)dstComponents);
+        if (MagickResultCache::fetch(key, args.renderWindow, dstImg.get())) {
+            return;
         }
     }
-    catch(Magick::Warning &warning) { // ignore since warns interupt render
-        #ifdef DEBUG
-        std::cout << warning.what() << std::endl;
-        #endif
+
+    // generate background
+    TextureGenerator *generator = NULL;
+    switch (effect) {
+    case 0: // Plasma
+        generator = new TexturePlasma(seed, frame, width, height, false, blend, from, to);
+        break;
+    case 1: // Plasma Fractal
+        generator = new TexturePlasma(seed, frame, width, height, true, false, from, to);
+        break;
+    case 2: // GaussianNoise
+        generator = new TextureNoise(seed, frame, width, height, eTextureNoiseGaussian);
+        break;
+    case 3: // ImpulseNoise
+        generator = new TextureNoise(seed, frame, width, height, eTextureNoiseImpulse);
+        break;
+    case 4: // LaplacianNoise
+        generator = new TextureNoise(seed, frame, width, height, eTextureNoiseLaplacian);
+        break;
+    case 5: // checkerboard
+        generator = new TextureCheckerboard(width, height);
+        break;
+    case 6: // stripes
+        generator = new TextureStripes(seed, frame, width, height);
+        break;
+    case 7: // gradient
+        generator = new TextureGradient(width, height, false, from, to);
+        break;
+    case 8: // radial-gradient
+        generator = new TextureGradient(width, height, true, from, to);
+        break;
+    case 9: // loops1
+        generator = new TextureLoops(seed, frame, width, height, eTextureNoiseGaussian);
+        break;
+    case 10: // loops2
+        generator = new TextureLoops(seed, frame, width, height, eTextureNoiseImpulse);
+        break;
+    case 11: // loops3
+        generator = new TextureLoops(seed, frame, width, height, eTextureNoiseLaplacian);
+        break;
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrValue);
+        return;
+    }
+    OFX::auto_ptr<TextureGenerator> generatorOwner(generator);
+
+    timer.next("generate");
+    switch (dstBitDepth) {
+    case OFX::eBitDepthUByte:
+        generateComponents<unsigned char>(*this, dstImg.get(), args.renderWindow, *generator, scale, origin);
+        break;
+    case OFX::eBitDepthUShort:
+        generateComponents<unsigned short>(*this, dstImg.get(), args.renderWindow, *generator, scale, origin);
+        break;
+    case OFX::eBitDepthHalf:
+        generateComponents<MagickHalf>(*this, dstImg.get(), args.renderWindow, *generator, scale, origin);
+        break;
+    default:
+        generateComponents<float>(*this, dstImg.get(), args.renderWindow, *generator, scale, origin);
+        break;
     }
 
-    // return image
-    if (dstClip_ && dstClip_->isConnected())
-        image.write(0,0,width,height,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
+    if (isStatic && !abort()) {
+        MagickResultCache::store(key, args.renderWindow, dstImg.get());
+    }
 }
 
 bool TexturePlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
@@ -336,6 +920,9 @@ void TexturePluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextGenerator);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     desc.setSupportsTiles(kSupportsTiles);
@@ -347,10 +934,6 @@ void TexturePluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {   
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-
     gHostIsNatron = (OFX::getImageEffectHostDescription()->isNatron);
 
     // there has to be an input clip, even for generators
@@ -362,6 +945,8 @@ void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, C
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
+    dstClip->addSupportedComponent(ePixelComponentAlpha);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make some pages
@@ -406,6 +991,7 @@ void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, C
         }
         param->setDefault(kParamEffectDefault);
         param->setAnimates(true);
+        desc.addClipPreferencesSlaveParam(*param);
         page->addChild(*param);
     }
     {
@@ -425,6 +1011,7 @@ void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, C
         param->setDisplayRange(0, 4000);
         param->setDefault(kParamWidthDefault);
         param->setParent(*groupCanvas);
+        desc.addClipPreferencesSlaveParam(*param);
     }
     {
         IntParamDescriptor* param = desc.defineIntParam(kParamHeight);
@@ -434,6 +1021,7 @@ void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, C
         param->setDisplayRange(0, 4000);
         param->setDefault(kParamHeightDefault);
         param->setParent(*groupCanvas);
+        desc.addClipPreferencesSlaveParam(*param);
     }
     {
         StringParamDescriptor* param = desc.defineStringParam(kParamFromColor);
@@ -442,6 +1030,7 @@ void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, C
         param->setStringType(eStringTypeSingleLine);
         param->setAnimates(true);
         page->addChild(*param);
+        desc.addClipPreferencesSlaveParam(*param);
     }
     {
         StringParamDescriptor* param = desc.defineStringParam(kParamToColor);
@@ -451,17 +1040,7 @@ void TexturePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, C
         param->setAnimates(true);
         param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
-    }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
+        desc.addClipPreferencesSlaveParam(*param);
     }
 }
 
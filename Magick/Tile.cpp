@@ -18,14 +18,19 @@
 #include "ofxsMacros.h"
 #include "ofxsMultiThread.h"
 #include "ofxsImageEffect.h"
-#include <Magick++.h>
+#include "ArenaTimer.h"
+#include "MagickPixels.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 #define kPluginName "TileOFX"
 #define kPluginGrouping "Extra/Transform"
 #define kPluginIdentifier "net.fxarena.openfx.Tile"
 #define kPluginVersionMajor 3
-#define kPluginVersionMinor 2
+#define kPluginVersionMinor 3
 
 #define kParamRows "rows"
 #define kParamRowsLabel "Rows"
@@ -58,13 +63,256 @@
 #define kRenderThreadSafety eRenderFullySafe
 #define kHostFrameThreading false
 
-#define kParamOpenMP "openmp"
-#define kParamOpenMPLabel "OpenMP"
-#define kParamOpenMPHint "Enable/Disable OpenMP support. This will enable the plugin to use as many threads as allowed by host."
-#define kParamOpenMPDefault false
-
 using namespace OFX;
-static bool _hasOpenMP = false;
+
+/* The grid is laid out as the ImageMagick montage of the previous versions did it: the tile
+ * geometry was rows x cols, so rows thumbnails go across and cols go down. Every cell is
+ * srcWidth/rows x srcHeight/cols and holds its frame scaled to fit and centred, cells are
+ * filled in reading order starting from the first row of the image. */
+
+// a frame reduced to fit a cell
+struct TileThumbnail
+{
+    TileThumbnail() : width(0), height(0) {}
+    int width, height;
+    std::vector<unsigned char> pixels; // rows of width pixels in the image format
+};
+
+// area average of rect of srcImg into thumb, the thumbnail rows are spread over the threads
+template <class PIX, int nComponents>
+class TileReduceProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    TileReduceProcessor(OFX::ImageEffect &effect, const OFX::Image *srcImg, const OfxRectI &rect, bool matte, TileThumbnail &thumb)
+        : _effect(effect)
+        , _srcImg(srcImg)
+        , _rect(rect)
+        , _matte(matte)
+        , _thumb(thumb)
+        , _fx((double)(rect.x2 - rect.x1) / thumb.width)
+        , _fy((double)(rect.y2 - rect.y1) / thumb.height)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int chunk = (_thumb.height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _thumb.height);
+        int size = _thumb.width * nComponents;
+        std::vector<float> line(size), sum(size);
+        OfxRectI bounds = _srcImg->getBounds();
+        float norm = (float)(1. / (_fx * _fy));
+        for (int ty = y1; ty < y2; ++ty) {
+            if (_effect.abort()) {
+                return;
+            }
+            std::fill(sum.begin(), sum.end(), 0.f);
+            double v1 = ty * _fy;
+            double v2 = (ty + 1) * _fy;
+            for (int sy = (int)v1; sy < v2; ++sy) {
+                int y = _rect.y1 + sy;
+                if (y < bounds.y1 || y >= bounds.y2) {
+                    continue; // transparent
+                }
+                float wy = (float)(std::min(v2, sy + 1.) - std::max(v1, (double)sy));
+                reduceRow((const PIX*)_srcImg->getPixelAddress(bounds.x1, y), bounds, &line[0]);
+                for (int i = 0; i < size; ++i) {
+                    sum[i] += wy * line[i];
+                }
+            }
+            PIX *dst = (PIX*)&_thumb.pixels[(size_t)ty * size * sizeof(PIX)];
+            for (int i = 0; i < size; ++i) {
+                dst[i] = Traits::fromFloat(sum[i] * norm);
+            }
+            if (_matte && nComponents == 4) {
+                for (int x = 0; x < _thumb.width; ++x) {
+                    dst[x * nComponents + 3] = Traits::fromFloat(1.f);
+                }
+            }
+        }
+    }
+
+private:
+    typedef MagickPixelTraits<PIX> Traits;
+
+    // horizontal area average of the source row starting at pixel bounds.x1
+    void reduceRow(const PIX *row, const OfxRectI &bounds, float *line)
+    {
+        for (int tx = 0; tx < _thumb.width; ++tx, line += nComponents) {
+            float acc[nComponents];
+            for (int c = 0; c < nComponents; ++c) {
+                acc[c] = 0.f;
+            }
+            double u1 = tx * _fx;
+            double u2 = (tx + 1) * _fx;
+            for (int sx = (int)u1; sx < u2; ++sx) {
+                int x = _rect.x1 + sx;
+                if (x < bounds.x1 || x >= bounds.x2) {
+                    continue;
+                }
+                float wx = (float)(std::min(u2, sx + 1.) - std::max(u1, (double)sx));
+                const PIX *p = row + (x - bounds.x1) * nComponents;
+                for (int c = 0; c < nComponents; ++c) {
+                    acc[c] += wx * Traits::toFloat(p[c]);
+                }
+            }
+            for (int c = 0; c < nComponents; ++c) {
+                line[c] = acc[c];
+            }
+        }
+    }
+
+    OFX::ImageEffect &_effect;
+    const OFX::Image *_srcImg;
+    OfxRectI _rect;
+    bool _matte;
+    TileThumbnail &_thumb;
+    double _fx, _fy;
+};
+
+// copy the thumbnails of the grid into window, everything else is transparent
+class TileBlitProcessor
+    : public OFX::MultiThread::Processor
+{
+public:
+    TileBlitProcessor(OFX::ImageEffect &effect, OFX::Image *dstImg, const OfxRectI &window, const OfxRectI &rod,
+                      int across, int down, const std::vector<const TileThumbnail*> &grid, size_t pixelBytes)
+        : _effect(effect)
+        , _dstImg(dstImg)
+        , _window(window)
+        , _rod(rod)
+        , _across(across)
+        , _down(down)
+        , _cellWidth((rod.x2 - rod.x1) / across)
+        , _cellHeight((rod.y2 - rod.y1) / down)
+        , _grid(grid)
+        , _pixelBytes(pixelBytes)
+    {
+    }
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) OVERRIDE FINAL
+    {
+        int height = _window.y2 - _window.y1;
+        int chunk = (height + (int)nThreads - 1) / (int)nThreads;
+        int y1 = _window.y1 + (int)threadId * chunk;
+        int y2 = std::min(y1 + chunk, _window.y2);
+        for (int y = y1; y < y2; ++y) {
+            if (_effect.abort()) {
+                return;
+            }
+            char *dst = (char*)_dstImg->getPixelAddress(_window.x1, y);
+            std::memset(dst, 0, (_window.x2 - _window.x1) * _pixelBytes);
+            int cy = y - _rod.y1;
+            if (cy < 0 || _cellHeight <= 0 || cy / _cellHeight >= _down) {
+                continue;
+            }
+            int j = cy / _cellHeight;
+            for (int i = 0; i < _across; ++i) {
+                const TileThumbnail *thumb = _grid[j * _across + i];
+                if (!thumb || thumb->width <= 0 || thumb->height <= 0) {
+                    continue;
+                }
+                int ty = cy - j * _cellHeight - (_cellHeight - thumb->height) / 2;
+                if (ty < 0 || ty >= thumb->height) {
+                    continue;
+                }
+                int x1 = _rod.x1 + i * _cellWidth + (_cellWidth - thumb->width) / 2;
+                int a = std::max(x1, _window.x1);
+                int b = std::min(x1 + thumb->width, _window.x2);
+                if (a < b) {
+                    std::memcpy(dst + (a - _window.x1) * _pixelBytes,
+                                &thumb->pixels[((size_t)ty * thumb->width + (a - x1)) * _pixelBytes],
+                                (b - a) * _pixelBytes);
+                }
+            }
+        }
+    }
+
+private:
+    OFX::ImageEffect &_effect;
+    OFX::Image *_dstImg;
+    OfxRectI _window;
+    OfxRectI _rod;
+    int _across, _down;
+    int _cellWidth, _cellHeight;
+    const std::vector<const TileThumbnail*> &_grid;
+    size_t _pixelBytes;
+};
+
+template <class PIX, int nComponents>
+static void
+reduceImage(OFX::ImageEffect &effect, const OFX::Image *srcImg, const OfxRectI &rect, bool matte, TileThumbnail &thumb)
+{
+    thumb.pixels.resize((size_t)thumb.width * thumb.height * nComponents * sizeof(PIX));
+    TileReduceProcessor<PIX, nComponents> processor(effect, srcImg, rect, matte, thumb);
+    unsigned int nThreads = std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)thumb.height);
+    processor.multiThread(std::max(1u, nThreads));
+}
+
+template <class PIX>
+static void
+reduceComponents(OFX::ImageEffect &effect, const OFX::Image *srcImg, const OfxRectI &rect, bool matte, TileThumbnail &thumb)
+{
+    switch (srcImg->getPixelComponentCount()) {
+    case 4:
+        reduceImage<PIX, 4>(effect, srcImg, rect, matte, thumb);
+        break;
+    case 3:
+        reduceImage<PIX, 3>(effect, srcImg, rect, matte, thumb);
+        break;
+    case 1:
+        reduceImage<PIX, 1>(effect, srcImg, rect, matte, thumb);
+        break;
+    default:
+        thumb.width = thumb.height = 0;
+        break;
+    }
+}
+
+// srcImg scaled to fit a cellWidth x cellHeight cell, keeping its aspect
+static void
+reduceFrame(OFX::ImageEffect &effect, const OFX::Image *srcImg, int cellWidth, int cellHeight, bool matte, TileThumbnail &thumb)
+{
+    OfxRectI rect = srcImg->getRegionOfDefinition();
+    int width = rect.x2 - rect.x1;
+    int height = rect.y2 - rect.y1;
+    thumb.width = thumb.height = 0;
+    if (width <= 0 || height <= 0 || cellWidth <= 0 || cellHeight <= 0) {
+        return;
+    }
+    double scale = std::min((double)cellWidth / width, (double)cellHeight / height);
+    thumb.width = std::max(1, std::min(cellWidth, (int)std::floor(width * scale + 0.5)));
+    thumb.height = std::max(1, std::min(cellHeight, (int)std::floor(height * scale + 0.5)));
+    switch (srcImg->getPixelDepth()) {
+    case OFX::eBitDepthUByte:
+        reduceComponents<unsigned char>(effect, srcImg, rect, matte, thumb);
+        break;
+    case OFX::eBitDepthUShort:
+        reduceComponents<unsigned short>(effect, srcImg, rect, matte, thumb);
+        break;
+    case OFX::eBitDepthHalf:
+        reduceComponents<MagickHalf>(effect, srcImg, rect, matte, thumb);
+        break;
+    case OFX::eBitDepthFloat:
+        reduceComponents<float>(effect, srcImg, rect, matte, thumb);
+        break;
+    default:
+        thumb.width = thumb.height = 0;
+        break;
+    }
+}
+
+// frame shown in cell k, with a time offset the cells step through the frames following time
+static double
+tileCellTime(double time, int k, int offset, bool firstFrame)
+{
+    if (offset == 0 || (firstFrame && k == 0)) {
+        return time;
+    }
+    return time + offset + k - (firstFrame ? 1 : 0);
+}
 
 class TilePlugin : public OFX::ImageEffect
 {
@@ -73,6 +321,9 @@ public:
     virtual ~TilePlugin();
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois) OVERRIDE FINAL;
+    virtual void getFramesNeeded(const OFX::FramesNeededArguments &args, OFX::FramesNeededSetter &frames) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
 private:
     OFX::Clip *dstClip_;
     OFX::Clip *srcClip_;
@@ -81,7 +332,6 @@ private:
     OFX::IntParam *offset_;
     OFX::BooleanParam *firstFrame_;
     OFX::BooleanParam *matte_;
-    OFX::BooleanParam *enableOpenMP_;
 };
 
 TilePlugin::TilePlugin(OfxImageEffectHandle handle)
@@ -89,20 +339,22 @@ TilePlugin::TilePlugin(OfxImageEffectHandle handle)
 , dstClip_(NULL)
 , srcClip_(NULL)
 {
-    Magick::InitializeMagick(NULL);
     dstClip_ = fetchClip(kOfxImageEffectOutputClipName);
-    assert(dstClip_ && dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(dstClip_ && (dstClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        dstClip_->getPixelComponents() == OFX::ePixelComponentAlpha));
     srcClip_ = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(srcClip_ && srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(srcClip_ && (srcClip_->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        srcClip_->getPixelComponents() == OFX::ePixelComponentAlpha));
 
     rows_ = fetchIntParam(kParamRows);
     cols_ = fetchIntParam(kParamCols);
     offset_ = fetchIntParam(kParamTileTimeOffset);
     firstFrame_ = fetchBooleanParam(kParamTileTimeOffsetFirst);
     matte_ = fetchBooleanParam(kParamMatte);
-    enableOpenMP_ = fetchBooleanParam(kParamOpenMP);
 
-    assert(rows_ && cols_ && offset_ && firstFrame_ && matte_ && enableOpenMP_);
+    assert(rows_ && cols_ && offset_ && firstFrame_ && matte_);
 }
 
 TilePlugin::~TilePlugin()
@@ -117,6 +369,8 @@ void TilePlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
+    ArenaTimer timer(kPluginIdentifier, "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!srcClip_) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -124,10 +378,9 @@ void TilePlugin::render(const OFX::RenderArguments &args)
     }
     assert(srcClip_);
     OFX::auto_ptr<const OFX::Image> srcImg(srcClip_->fetchImage(args.time));
-    OfxRectI srcRod,srcBounds;
+    OfxRectI srcRod;
     if (srcImg.get()) {
         srcRod = srcImg->getRegionOfDefinition();
-        srcBounds = srcImg->getBounds();
         if (srcImg->getRenderScale().x != args.renderScale.x ||
             srcImg->getRenderScale().y != args.renderScale.y ||
             srcImg->getField() != args.fieldToRender) {
@@ -137,6 +390,7 @@ void TilePlugin::render(const OFX::RenderArguments &args)
         }
     } else {
         OFX::throwSuiteStatusException(kOfxStatFailed);
+        return;
     }
 
     // get dest clip
@@ -158,16 +412,10 @@ void TilePlugin::render(const OFX::RenderArguments &args)
         return;
     }
 
-    // get bit depth
+    // get bit depth and pixel component
     OFX::BitDepthEnum dstBitDepth = dstImg->getPixelDepth();
-    if (dstBitDepth != OFX::eBitDepthFloat || (srcImg.get() && (dstBitDepth != srcImg->getPixelDepth()))) {
-        OFX::throwSuiteStatusException(kOfxStatErrFormat);
-        return;
-    }
-
-    // get pixel component
-    OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA || (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
+    OFX::PixelComponentEnum dstComponents = dstImg->getPixelComponents();
+    if (dstBitDepth != srcImg->getPixelDepth() || dstComponents != srcImg->getPixelComponents()) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -186,125 +434,62 @@ void TilePlugin::render(const OFX::RenderArguments &args)
     int offset = 0;
     bool firstFrame = false;
     bool matte = false;
-    bool enableOpenMP = false;
     rows_->getValueAtTime(args.time, rows);
     cols_->getValueAtTime(args.time, cols);
     offset_->getValueAtTime(args.time, offset);
     firstFrame_->getValueAtTime(args.time, firstFrame);
     matte_->getValueAtTime(args.time, matte);
-    enableOpenMP_->getValueAtTime(args.time, enableOpenMP);
+    rows = std::max(1, rows);
+    cols = std::max(1, cols);
 
     // setup
-    int srcWidth = srcRod.x2-srcRod.x1;
-    int srcHeight = srcRod.y2-srcRod.y1;
-    int tileWidth = srcWidth/rows;
-    int tileHeight = srcHeight/cols;
-    int thumbs = rows*cols;
-    std::string thumb;
-    std::ostringstream makeThumb;
-    makeThumb << tileWidth << "x" << tileHeight << "-0-0";
-    thumb = makeThumb.str();
-    std::string grid;
-    std::ostringstream makeGrid;
-    makeGrid << rows << "x" << cols;
-    grid = makeGrid.str();
-    std::list<Magick::Image> montagelist;
-    std::list<Magick::Image> imageList;
-    Magick::Image image;
-    Magick::Montage montage;
-
-    // OpenMP
-#ifndef LEGACYIM
-    unsigned int threads = 1;
-    if (_hasOpenMP && enableOpenMP)
-        threads = OFX::MultiThread::getNumCPUs();
-
-    Magick::ResourceLimits::thread(threads);
-#endif
-
-    // read source image
-    Magick::Image container(Magick::Geometry(srcWidth,srcHeight),Magick::Color("rgba(0,0,0,0)"));
-    Magick::Image output(Magick::Geometry(srcWidth,srcHeight),Magick::Color("rgba(0,0,0,1)"));
-    if (srcClip_ && srcClip_->isConnected())
-        image.read(srcWidth,srcHeight,"RGBA",Magick::FloatPixel,(float*)srcImg->getPixelData());
-
-    // setup montage
-    std::string fontFile;
-    char **fonts;
-    std::size_t fontList;
-    fonts=MagickCore::MagickQueryFonts("*",&fontList);
-    fontFile = fonts[0];
-    for (size_t i = 0; i < fontList; i++)
-        free(fonts[i]);
-
-    if (!fontFile.empty())
-        montage.font(fontFile); // avoid warn, set default font
-    else // broken installation
-        setPersistentMessage(OFX::Message::eMessageError, "", "No fonts found, please check installation");
-    montage.shadow(false);
-    montage.backgroundColor(Magick::Color("rgba(0,0,0,0)"));
-    montage.geometry(thumb);
-    montage.tile(grid);
-
-    if (matte) {
-#if MagickLibVersion >= 0x700
-        image.alpha(false);
-        image.alpha(true);
-#else
-        image.matte(false);
-        image.matte(true);
-#endif
+    int cellWidth = (srcRod.x2 - srcRod.x1) / rows;
+    int cellHeight = (srcRod.y2 - srcRod.y1) / cols;
+    int cells = rows * cols;
+    size_t pixelBytes = dstImg->getPixelComponentCount() * (size_t)(dstBitDepth == OFX::eBitDepthUByte ? 1 :
+                                                                    dstBitDepth == OFX::eBitDepthFloat ? 4 : 2);
+
+    // reduce every frame once, without a time offset all cells show the current frame,
+    // the other frames were announced in getFramesNeeded and are released as soon as they are reduced
+    timer.next("reduce");
+    std::vector<TileThumbnail> thumbs(offset == 0 ? 1 : cells);
+    std::vector<const TileThumbnail*> grid(cells, (const TileThumbnail*)NULL);
+    if (offset == 0) {
+        reduceFrame(*this, srcImg.get(), cellWidth, cellHeight, matte, thumbs[0]);
     }
-
-    // add images
-    if (offset==0) {
-        for(int y = 0; y < thumbs; y++)
-            imageList.push_back(image);
-    }
-    else { // time offset
-        int counter;
-        if (firstFrame) {
-            imageList.push_back(image);
-            counter=thumbs-1;
+    for (int k = 0; k < cells; ++k) {
+        // only the cells crossing the render window
+        int x1 = srcRod.x1 + (k % rows) * cellWidth;
+        int y1 = srcRod.y1 + (k / rows) * cellHeight;
+        if (x1 >= args.renderWindow.x2 || x1 + cellWidth <= args.renderWindow.x1 ||
+            y1 >= args.renderWindow.y2 || y1 + cellHeight <= args.renderWindow.y1) {
+            continue;
         }
-        else
-            counter=thumbs;
-        int frame = args.time+offset;
-        for(int y = 0; y < counter; y++) {
+        if (offset == 0) {
+            grid[k] = &thumbs[0];
+        } else if (firstFrame && k == 0) {
+            reduceFrame(*this, srcImg.get(), cellWidth, cellHeight, matte, thumbs[k]);
+            grid[k] = &thumbs[k];
+        } else {
+            double frame = tileCellTime(args.time, k, offset, firstFrame);
             OFX::auto_ptr<const OFX::Image> tileImg(srcClip_->fetchImage(frame));
-            if (tileImg.get()) {
-                OfxRectI tileRod;
-                tileRod = tileImg->getRegionOfDefinition();
-                int tileWidth = tileRod.x2-tileRod.x1;
-                int tileHeight = tileRod.y2-tileRod.y1;
-                if (tileWidth>0&&tileHeight>0) {
-                    Magick::Image tmpTile(tileWidth,tileHeight,"RGBA",Magick::FloatPixel,(float*)tileImg->getPixelData());
-                    std::size_t tileColumns = tileWidth;
-                    std::size_t tileRows = tileHeight;
-                    if (tmpTile.columns()==tileColumns && tmpTile.rows()==tileRows)
-                        imageList.push_back(tmpTile);
-                }
+            if (tileImg.get() &&
+                tileImg->getPixelDepth() == dstBitDepth &&
+                tileImg->getPixelComponents() == dstComponents) {
+                reduceFrame(*this, tileImg.get(), cellWidth, cellHeight, matte, thumbs[k]);
+                grid[k] = &thumbs[k];
             }
-            frame++;
+        }
+        if (abort()) {
+            return;
         }
     }
 
-    // do a montage
-    Magick::montageImages(&montagelist,imageList.begin(),imageList.end(),montage);
-
-    // append images to container
-    Magick::appendImages(&container,montagelist.begin(),montagelist.end());
-
-    // return image
-    if (dstClip_ && dstClip_->isConnected()) {
-        output.composite(container, 0, 0, Magick::OverCompositeOp);
-#if MagickLibVersion >= 0x700
-        output.composite(container, 0, 0, Magick::CopyAlphaCompositeOp);
-#else
-        output.composite(container, 0, 0, Magick::CopyOpacityCompositeOp);
-#endif
-        output.write(0,0,args.renderWindow.x2 - args.renderWindow.x1,args.renderWindow.y2 - args.renderWindow.y1,"RGBA",Magick::FloatPixel,(float*)dstImg->getPixelData());
-    }
+    // copy the thumbnails into the grid
+    timer.next("blit");
+    TileBlitProcessor processor(*this, dstImg.get(), args.renderWindow, srcRod, rows, cols, grid, pixelBytes);
+    unsigned int nThreads = std::min(OFX::MultiThread::getNumCPUs(), (unsigned int)(args.renderWindow.y2 - args.renderWindow.y1));
+    processor.multiThread(std::max(1u, nThreads));
 }
 
 bool TilePlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
@@ -322,6 +507,61 @@ bool TilePlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &a
     return true;
 }
 
+void TilePlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+    if (!srcClip_ || !srcClip_->isConnected()) {
+        return;
+    }
+    // every thumbnail is reduced from the whole frame
+    rois.setRegionOfInterest(*srcClip_, srcClip_->getRegionOfDefinition(args.time));
+}
+
+void TilePlugin::getFramesNeeded(const OFX::FramesNeededArguments &args, OFX::FramesNeededSetter &frames)
+{
+    if (!srcClip_) {
+        return;
+    }
+    int rows = 0;
+    int cols = 0;
+    int offset = 0;
+    bool firstFrame = false;
+    rows_->getValueAtTime(args.time, rows);
+    cols_->getValueAtTime(args.time, cols);
+    offset_->getValueAtTime(args.time, offset);
+    firstFrame_->getValueAtTime(args.time, firstFrame);
+
+    // the current frame is always fetched, then one frame per cell showing an offset frame
+    OfxRangeD range;
+    range.min = range.max = args.time;
+    frames.setFramesNeeded(*srcClip_, range);
+    int cells = std::max(1, rows) * std::max(1, cols);
+    int first = firstFrame ? 1 : 0;
+    if (offset != 0 && cells > first) {
+        range.min = tileCellTime(args.time, first, offset, firstFrame);
+        range.max = tileCellTime(args.time, cells - 1, offset, firstFrame);
+        frames.setFramesNeeded(*srcClip_, range);
+    }
+}
+
+bool TilePlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!kSupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    int rows, cols, offset;
+    bool matte = false;
+    rows_->getValueAtTime(args.time, rows);
+    cols_->getValueAtTime(args.time, cols);
+    offset_->getValueAtTime(args.time, offset);
+    matte_->getValueAtTime(args.time, matte);
+    if (rows == 1 && cols == 1 && offset == 0 && !matte) {
+        identityClip = srcClip_;
+        return true;
+    }
+    return false;
+}
+
 mDeclarePluginFactory(TilePluginFactory, {}, {});
 
 /** @brief The basic describe function, passed a plugin descriptor */
@@ -337,10 +577,14 @@ void TilePluginFactory::describe(OFX::ImageEffectDescriptor &desc)
     desc.addSupportedContext(eContextFilter);
 
     // add supported pixel depths
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
 
     // other
     desc.setSupportsTiles(kSupportsTiles);
+    desc.setTemporalClipAccess(true);
     desc.setSupportsMultiResolution(kSupportsMultiResolution);
     desc.setRenderThreadSafety(kRenderThreadSafety);
     desc.setHostFrameThreading(kHostFrameThreading);
@@ -351,20 +595,20 @@ void TilePluginFactory::describe(OFX::ImageEffectDescriptor &desc)
 /** @brief The describe in context function, passed a plugin descriptor and a context */
 void TilePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, ContextEnum /*context*/)
 {
-    std::string features = MagickCore::GetMagickFeatures();
-    if (features.find("OpenMP") != std::string::npos)
-        _hasOpenMP = true;
-
     // create the mandated source clip
     ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(ePixelComponentRGBA);
-    srcClip->setTemporalClipAccess(false);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
+    srcClip->addSupportedComponent(ePixelComponentAlpha);
+    srcClip->setTemporalClipAccess(true);
     srcClip->setSupportsTiles(kSupportsTiles);
     srcClip->setIsMask(false);
 
     // create the mandated output clip
     ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
+    dstClip->addSupportedComponent(ePixelComponentAlpha);
     dstClip->setSupportsTiles(kSupportsTiles);
 
     // make pages and params
@@ -413,17 +657,6 @@ void TilePluginFactory::describeInContext(OFX::ImageEffectDescriptor &desc, Cont
         param->setLayoutHint(OFX::eLayoutHintDivider);
         page->addChild(*param);
     }
-    {
-        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamOpenMP);
-        param->setLabel(kParamOpenMPLabel);
-        param->setHint(kParamOpenMPHint);
-        param->setDefault(kParamOpenMPDefault);
-        param->setAnimates(false);
-        if (!_hasOpenMP)
-            param->setEnabled(false);
-        param->setLayoutHint(OFX::eLayoutHintDivider);
-        page->addChild(*param);
-    }
 }
 
 /** @brief The create instance function, the plugin must return an object derived from the \ref OFX::ImageEffect class */
@@ -51,7 +51,7 @@ class WavePlugin
 {
 public:
     WavePlugin(OfxImageEffectHandle handle)
-        : MagickPluginHelper<kSupportsRenderScale>(handle)
+        : MagickPluginHelper<kSupportsRenderScale>(handle, kPluginIdentifier)
         , _amp(NULL)
         , _length(NULL)
     {
@@ -68,6 +68,35 @@ public:
         image.backgroundColor(Magick::Color("rgba(0,0,0,0)"));
         image.wave(std::floor(waveAmp * args.renderScale.x + 0.5),std::floor(waveLength * args.renderScale.x + 0.5));
     }
+
+    // WaveImage always uses the Background virtual pixel method, with the transparent background set in render
+    virtual bool renderNative(const OFX::RenderArguments &args, const OFX::Image *srcImg, OFX::Image *dstImg, ArenaWarpEdgeEnum /*edge*/) OVERRIDE FINAL
+    {
+        double waveAmp, waveLength;
+        _amp->getValueAtTime(args.time, waveAmp);
+        _length->getValueAtTime(args.time, waveLength);
+        OfxRectI srcRod = srcImg->getRegionOfDefinition();
+        ArenaWaveMap wave(srcRod, std::floor(waveAmp * args.renderScale.x + 0.5), std::floor(waveLength * args.renderScale.x + 0.5));
+        return arenaWarp(*this, srcImg, dstImg, args.renderWindow, srcRod, wave, eArenaWarpFilterBilinear, eArenaWarpEdgeTransparent);
+    }
+
+    // the ImageMagick wave is slow, cache its result
+    virtual bool getCacheKey(const OFX::RenderArguments &args, MagickCacheKey &key) OVERRIDE FINAL
+    {
+        double waveAmp, waveLength;
+        _amp->getValueAtTime(args.time, waveAmp);
+        _length->getValueAtTime(args.time, waveLength);
+        key.add(waveAmp);
+        key.add(waveLength);
+        return true;
+    }
+
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &args) OVERRIDE FINAL
+    {
+        double waveAmp;
+        _amp->getValueAtTime(args.time, waveAmp);
+        return std::floor(waveAmp * args.renderScale.x + 0.5) == 0.;
+    }
 private:
     DoubleParam *_amp;
     DoubleParam *_length;
@@ -82,6 +111,9 @@ void WavePluginFactory::describe(ImageEffectDescriptor &desc)
     desc.setPluginDescription(kPluginDescription);
     desc.addSupportedContext(eContextGeneral);
     desc.addSupportedContext(eContextFilter);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthHalf);
     desc.addSupportedBitDepth(eBitDepthFloat);
     desc.setSupportsTiles(kSupportsTiles);
     desc.setSupportsMultiResolution(kSupportsMultiResolution);
@@ -57,24 +57,57 @@ public:
 
     virtual void render(const OFX::RenderArguments &args, cl::Kernel kernel) OVERRIDE FINAL
     {
-        double x, y, r, rX, rY, s;
-        _position->getValueAtTime(args.time, x, y);
+        OfxPointD centre;
+        double size, strength;
+        getBulge(args.time, args.renderScale, centre, size, strength);
+        kernel.setArg(2, (float)args.renderWindow.x1);
+        kernel.setArg(3, (float)args.renderWindow.y1);
+        kernel.setArg(4, (float)centre.x);
+        kernel.setArg(5, (float)centre.y);
+        kernel.setArg(6, (float)size);
+        kernel.setArg(7, (float)strength);
+    }
+
+    virtual bool renderCPU(const OFX::RenderArguments &args, const OFX::Image *srcImg, OFX::Image *dstImg) OVERRIDE FINAL
+    {
+        OfxPointD centre;
+        double size, strength;
+        getBulge(args.time, args.renderScale, centre, size, strength);
+        ArenaBulgeMap bulge(centre, size, strength);
+        return arenaWarp(*this, srcImg, dstImg, args.renderWindow, srcImg->getRegionOfDefinition(), bulge, eArenaWarpFilterBilinear, eArenaWarpEdgeClamp);
+    }
+
+    virtual bool getEffectBounds(double time, const OfxPointD &renderScale, OfxRectI &rect) OVERRIDE FINAL
+    {
+        OfxPointD centre;
+        double size, strength;
+        getBulge(time, renderScale, centre, size, strength);
+        ArenaBulgeMap bulge(centre, size, strength);
+        return arenaWarpBounds(bulge, rect);
+    }
+
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &args) OVERRIDE FINAL
+    {
+        double rX, rY, s;
         _radius->getValueAtTime(args.time, rX, rY);
         _strength->getValueAtTime(args.time, s);
-        double ypos = y*args.renderScale.y;
-        double xpos = x*args.renderScale.x;
-        r = (rX*100)*args.renderScale.x;
-        if (s!=0) {
-            s = s/10;
-        }
-        kernel.setArg(2, xpos);
-        kernel.setArg(3, ypos);
-        kernel.setArg(4, r);
-        kernel.setArg(5, s);
+        return s == 0. || rX <= 0.;
     }
     virtual void changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
     void resetCenter(double time);
 private:
+    void getBulge(double time, const OfxPointD &renderScale, OfxPointD &centre, double &size, double &strength)
+    {
+        double x, y, rX, rY, s;
+        _position->getValueAtTime(time, x, y);
+        _radius->getValueAtTime(time, rX, rY);
+        _strength->getValueAtTime(time, s);
+        centre.x = x*renderScale.x;
+        centre.y = y*renderScale.y;
+        size = (rX*100)*renderScale.x;
+        strength = s/10;
+    }
+
     Double2DParam *_position;
     Double2DParam *_radius;
     DoubleParam *_strength;
@@ -15,25 +15,44 @@
  * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
 */
 
-const sampler_t sampler = CLK_FILTER_NEAREST | CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE;
-kernel void filter(__read_only image2d_t input, __write_only image2d_t output, double centerX, double centerY, double r, double effect) {
-   const int2 size = get_image_dim(input);
-   int2 coord = (int2)(get_global_id(0),get_global_id(1));
-   int2 center = (int2)((int)centerX,(int)centerY);
-   float2 coord_center = convert_float2(coord - center);
-   float radius = r / 2.0f;
-   float strength = (float)effect;
-   float dist = length(convert_float2(coord_center));
+// Same map and filter as the CPU fallback (ArenaWarp), positions are pixel centres in canvas coordinates,
+// origin is the canvas position of the first image pixel.
 
-   if (dist < radius) {
-         float percent = dist / radius;
-         if (strength > 0.0f) {
-              coord_center *= mix(1.0f, smoothstep(0.0f, radius / dist, percent), strength * 0.75f);
-         } else {
-              coord_center *= mix(1.0f, pow(percent, 1.0f + strength * 0.75f) * radius / dist, 1.0f - percent);
-         }
+const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+float4 bilinear(read_only image2d_t in, float u, float v) {
+    float fx = u - 0.5f;
+    float fy = v - 0.5f;
+    float floorX = floor(fx);
+    float floorY = floor(fy);
+    int x0 = (int)floorX;
+    int y0 = (int)floorY;
+    float ax = fx - floorX;
+    float ay = fy - floorY;
+    return read_imagef(in, sampler, (int2)(x0, y0)) * ((1.f - ax) * (1.f - ay))
+         + read_imagef(in, sampler, (int2)(x0 + 1, y0)) * (ax * (1.f - ay))
+         + read_imagef(in, sampler, (int2)(x0, y0 + 1)) * ((1.f - ax) * ay)
+         + read_imagef(in, sampler, (int2)(x0 + 1, y0 + 1)) * (ax * ay);
+}
+
+kernel void filter(read_only image2d_t input, write_only image2d_t output, float originX, float originY, float centerX, float centerY, float size, float strength) {
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+    float dx = originX + (float)coord.x + 0.5f - centerX;
+    float dy = originY + (float)coord.y + 0.5f - centerY;
+    float radius = size / 2.0f;
+    float dist = sqrt(dx * dx + dy * dy);
+
+    if (dist < radius && dist > 0.f) {
+        float percent = dist / radius;
+        float k;
+        if (strength > 0.0f) {
+            float t = percent * percent;
+            k = 1.f + (t * t * (3.f - 2.f * t) - 1.f) * strength * 0.75f;
+        } else {
+            k = 1.f + (pow(percent, 1.0f + strength * 0.75f) * radius / dist - 1.f) * (1.f - percent);
+        }
+        dx *= k;
+        dy *= k;
     }
-    coord_center += convert_float2(center);
-    float4 color = read_imagef(input,sampler,convert_int2(coord_center));
-    write_imagef(output,convert_int2(coord),color);
+    write_imagef(output, coord, bilinear(input, dx + centerX - originX, dy + centerY - originY));
 }
@@ -28,9 +28,13 @@ OCLPluginHelperBase::OCLPluginHelperBase(OfxImageEffectHandle handle, const std:
     , _renderscale(0)
 {
     _dstClip = fetchClip(kOfxImageEffectOutputClipName);
-    assert(_dstClip && _dstClip->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(_dstClip && (_dstClip->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        _dstClip->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        _dstClip->getPixelComponents() == OFX::ePixelComponentAlpha));
     _srcClip = fetchClip(kOfxImageEffectSimpleSourceClipName);
-    assert(_srcClip && _srcClip->getPixelComponents() == OFX::ePixelComponentRGBA);
+    assert(_srcClip && (_srcClip->getPixelComponents() == OFX::ePixelComponentRGBA ||
+                        _srcClip->getPixelComponents() == OFX::ePixelComponentRGB ||
+                        _srcClip->getPixelComponents() == OFX::ePixelComponentAlpha));
 
     _device = fetchChoiceParam(kParamOCLDevice);
     _source = kernelSource;
@@ -111,6 +115,25 @@ OCLPluginHelperBase::getDevices()
     return devices;
 }
 
+bool
+OCLPluginHelperBase::hasImageFormat(const cl::ImageFormat &format)
+{
+    const cl_mem_flags flags[2] = { CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY };
+    for (int f = 0; f < 2; f++) {
+        std::vector<cl::ImageFormat> formats;
+        _context.getSupportedImageFormats(flags[f], CL_MEM_OBJECT_IMAGE2D, &formats);
+        bool found = false;
+        for (size_t i = 0; i < formats.size() && !found; i++) {
+            found = formats[i].image_channel_order == format.image_channel_order &&
+                    formats[i].image_channel_data_type == format.image_channel_data_type;
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void
 OCLPluginHelperBase::changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName)
 {
@@ -129,12 +152,16 @@ OCLPluginHelperBase::describeInContextBegin(OFX::ImageEffectDescriptor &desc, OF
 {
     OFX::ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
     srcClip->addSupportedComponent(OFX::ePixelComponentRGBA);
+    srcClip->addSupportedComponent(OFX::ePixelComponentRGB);
+    srcClip->addSupportedComponent(OFX::ePixelComponentAlpha);
     srcClip->setTemporalClipAccess(false);
     srcClip->setSupportsTiles(false);
     srcClip->setIsMask(false);
 
     OFX::ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
     dstClip->addSupportedComponent(OFX::ePixelComponentRGBA);
+    dstClip->addSupportedComponent(OFX::ePixelComponentRGB);
+    dstClip->addSupportedComponent(OFX::ePixelComponentAlpha);
     dstClip->setSupportsTiles(false);
 
     OFX::PageParamDescriptor *page = desc.definePageParam("Controls");
@@ -20,6 +20,10 @@
 
 #include "ofxsImageEffect.h"
 #include "ofxsMacros.h"
+#include "ArenaTimer.h"
+#include "ArenaWarp.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
 #if defined(__APPLE__) || defined(__MACOSX)
@@ -43,6 +47,19 @@ public:
     static void describeInContextEnd(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context, OFX::PageParamDescriptor* page);
     void setupContext(bool context, std::string kernelString);
     static std::vector<cl::Device> getDevices();
+    // true if images of format can be read and written by kernels of the context
+    bool hasImageFormat(const cl::ImageFormat &format);
+
+    /* Return true if the effect parameters are neutral at args.time, the source is then passed through. */
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &/*args*/) { return false; }
+
+    /* CPU fallback used when no OpenCL device or kernel is available (or ARENA_NO_OPENCL is set):
+     * render args.renderWindow of dstImg from srcImg and return true, false means the effect needs OpenCL. */
+    virtual bool renderCPU(const OFX::RenderArguments &/*args*/, const OFX::Image */*srcImg*/, OFX::Image */*dstImg*/) { return false; }
+
+    /* Effects that only change pixels inside rect (at renderScale) return true, the kernel then only runs
+     * over rect and render windows outside of it are passed through. */
+    virtual bool getEffectBounds(double /*time*/, const OfxPointD &/*renderScale*/, OfxRectI &/*rect*/) { return false; }
 
 protected:
     OFX::Clip *_dstClip;
@@ -69,6 +86,7 @@ public:
 
     virtual void render(const OFX::RenderArguments &args) OVERRIDE FINAL;
     virtual bool getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual bool isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &identityTime) OVERRIDE FINAL;
     virtual void render(const OFX::RenderArguments &args, cl::Kernel kernel) = 0;
     static OFX::PageParamDescriptor* describeInContextBegin(OFX::ImageEffectDescriptor &desc, OFX::ContextEnum context)
     {
@@ -85,6 +103,8 @@ void OCLPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments &ar
         return;
     }
 
+    ArenaTimer timer(_plugin.c_str(), "fetch", (double)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1));
+
     // get src clip
     if (!_srcClip) {
         OFX::throwSuiteStatusException(kOfxStatFailed);
@@ -136,7 +156,8 @@ void OCLPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments &ar
 
     // get pixel component
     OFX::PixelComponentEnum dstComponents  = dstImg->getPixelComponents();
-    if (dstComponents != OFX::ePixelComponentRGBA|| (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
+    if ((dstComponents != OFX::ePixelComponentRGBA && dstComponents != OFX::ePixelComponentRGB && dstComponents != OFX::ePixelComponentAlpha) ||
+        (srcImg.get() && (dstComponents != srcImg->getPixelComponents()))) {
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
         return;
     }
@@ -154,17 +175,58 @@ void OCLPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments &ar
     int height = args.renderWindow.y2 - args.renderWindow.y1;
 
     // get device
+    timer.next("context");
     int device = 0;
     _device->getValue(device);
     std::vector<cl::Device> devices = getDevices();
 
+    // CPU fallback
+    if (device < 0 || device >= (int)devices.size() || _program() == NULL ||
+        _program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(devices[device]) != CL_BUILD_SUCCESS ||
+        std::getenv("ARENA_NO_OPENCL")) {
+        timer.next("cpu");
+        if (!renderCPU(args, srcImg.get(), dstImg.get())) {
+            setPersistentMessage(OFX::Message::eMessageError, "", "No OpenCL device available");
+            OFX::throwSuiteStatusException(kOfxStatFailed);
+        }
+        return;
+    }
+
 #ifdef DEBUG
     std::cout << "rendering using OpenCL device: " << devices[device].getInfo<CL_DEVICE_NAME>() << std::endl;
 #endif
 
+    timer.next("upload");
+
+    // image format, Alpha goes through a CL_A image so kernels see it in .w as they do for RGBA,
+    // RGB through CL_RGB. Devices without those float formats get RGBA padded on the host.
+    int nComponents = dstImg->getPixelComponentCount();
+    cl::ImageFormat format(nComponents == 1 ? CL_A : nComponents == 3 ? CL_RGB : CL_RGBA, CL_FLOAT);
+    if (nComponents != 4 && !hasImageFormat(format)) {
+        format = cl::ImageFormat(CL_RGBA, CL_FLOAT);
+    }
+    int clComponents = format.image_channel_order == CL_RGBA ? 4 : nComponents;
+    // first RGBA channel of the image components, padding is black and opaque
+    int first = nComponents == 1 ? 3 : 0;
+    float *srcPixels = (float*)srcImg->getPixelData();
+    float *dstPixels = (float*)dstImg->getPixelData();
+    std::vector<float> srcPadded, dstPadded;
+    if (clComponents != nComponents) {
+        size_t count = (size_t)width * height;
+        srcPadded.assign(count * clComponents, 0.f);
+        dstPadded.resize(count * clComponents);
+        for (size_t i = 0; i < count; ++i) {
+            srcPadded[i * clComponents + 3] = 1.f;
+            for (int c = 0; c < nComponents; ++c) {
+                srcPadded[i * clComponents + first + c] = srcPixels[i * nComponents + c];
+            }
+        }
+        srcPixels = &srcPadded[0];
+        dstPixels = &dstPadded[0];
+    }
+
     // render
-    cl::ImageFormat format(CL_RGBA, CL_FLOAT);
-    cl::Image2D in(_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, format, width, height, 0, (float*)srcImg->getPixelData());
+    cl::Image2D in(_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, format, width, height, 0, srcPixels);
     cl::Image2D out(_context, CL_MEM_WRITE_ONLY, format, width, height, 0, NULL);
 
     cl::Kernel kernel(_program, "filter");
@@ -172,7 +234,7 @@ void OCLPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments &ar
     kernel.setArg(1, out);
     render(args, kernel);
 
-    cl::Event timer;
+    cl::Event kernelDone;
     cl::size_t<3> origin;
     cl::size_t<3> size;
     origin[0] = 0;
@@ -182,11 +244,41 @@ void OCLPluginHelper<SupportsRenderScale>::render(const OFX::RenderArguments &ar
     size[1] = height;
     size[2] = 1;
 
+    // bounded effects copy the image and only run the kernel over the affected rect
+    OfxRectI effect = args.renderWindow;
+    bool bounded = getEffectBounds(args.time, args.renderScale, effect);
+    if (bounded) {
+        effect.x1 = std::max(effect.x1, args.renderWindow.x1);
+        effect.y1 = std::max(effect.y1, args.renderWindow.y1);
+        effect.x2 = std::min(effect.x2, args.renderWindow.x2);
+        effect.y2 = std::min(effect.y2, args.renderWindow.y2);
+    }
+
     cl::CommandQueue queue = cl::CommandQueue(_context, devices[device]);
-    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange, NULL, &timer);
-    timer.wait();
-    queue.enqueueReadImage(out, CL_TRUE, origin, size, 0, 0, (float*)dstImg->getPixelData());
+    if (bounded) {
+        queue.enqueueCopyImage(in, out, origin, origin, size);
+    }
+    timer.next("kernel");
+    if (effect.x1 < effect.x2 && effect.y1 < effect.y2) {
+        queue.enqueueNDRangeKernel(kernel,
+                                   bounded ? cl::NDRange(effect.x1 - args.renderWindow.x1, effect.y1 - args.renderWindow.y1) : cl::NullRange,
+                                   cl::NDRange(effect.x2 - effect.x1, effect.y2 - effect.y1),
+                                   cl::NullRange, NULL, &kernelDone);
+        kernelDone.wait();
+    }
+    timer.next("readback");
+    queue.enqueueReadImage(out, CL_TRUE, origin, size, 0, 0, dstPixels);
     queue.finish();
+
+    if (clComponents != nComponents) {
+        float *dst = (float*)dstImg->getPixelData();
+        size_t count = (size_t)width * height;
+        for (size_t i = 0; i < count; ++i) {
+            for (int c = 0; c < nComponents; ++c) {
+                dst[i * nComponents + c] = dstPadded[i * clComponents + first + c];
+            }
+        }
+    }
 }
 
 template <int SupportsRenderScale>
@@ -205,4 +297,25 @@ bool OCLPluginHelper<SupportsRenderScale>::getRegionOfDefinition(const OFX::Regi
     return true;
 }
 
+template <int SupportsRenderScale>
+bool OCLPluginHelper<SupportsRenderScale>::isIdentity(const OFX::IsIdentityArguments &args, OFX::Clip * &identityClip, double &/*identityTime*/)
+{
+    if (!SupportsRenderScale && (args.renderScale.x != 1. || args.renderScale.y != 1.)) {
+        OFX::throwSuiteStatusException(kOfxStatFailed);
+        return false;
+    }
+    if (isIdentityEffect(args)) {
+        identityClip = _srcClip;
+        return true;
+    }
+    OfxRectI effect;
+    if (getEffectBounds(args.time, args.renderScale, effect) &&
+        (effect.x2 <= args.renderWindow.x1 || effect.x1 >= args.renderWindow.x2 ||
+         effect.y2 <= args.renderWindow.y1 || effect.y1 >= args.renderWindow.y2)) {
+        identityClip = _srcClip;
+        return true;
+    }
+    return false;
+}
+
 #endif // OCLPlugin_h
@@ -65,8 +65,17 @@ public:
         double waveAmp, waveLength;
         _waveAmp->getValueAtTime(args.time, waveAmp);
         _waveLength->getValueAtTime(args.time, waveLength);
-        kernel.setArg(2, std::floor(waveAmp * args.renderScale.x + 0.5));
-        kernel.setArg(3, std::floor(waveLength * args.renderScale.x + 0.5));
+        kernel.setArg(2, (float)std::floor(waveAmp * args.renderScale.x + 0.5));
+        kernel.setArg(3, (float)std::floor(waveLength * args.renderScale.x + 0.5));
+    }
+
+    virtual bool renderCPU(const OFX::RenderArguments &args, const OFX::Image *srcImg, OFX::Image *dstImg) OVERRIDE FINAL
+    {
+        double waveAmp, waveLength;
+        _waveAmp->getValueAtTime(args.time, waveAmp);
+        _waveLength->getValueAtTime(args.time, waveLength);
+        ArenaRippleMap ripple(args.renderWindow, std::floor(waveAmp * args.renderScale.x + 0.5), std::floor(waveLength * args.renderScale.x + 0.5));
+        return arenaWarp(*this, srcImg, dstImg, args.renderWindow, srcImg->getRegionOfDefinition(), ripple, eArenaWarpFilterBilinear, eArenaWarpEdgeClamp, true);
     }
 private:
     DoubleParam *_waveAmp;
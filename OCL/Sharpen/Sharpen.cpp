@@ -58,6 +58,13 @@ public:
         _factor->getValueAtTime(args.time, factor);
         kernel.setArg(2, factor);
     }
+
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &args) OVERRIDE FINAL
+    {
+        double factor = 0.0;
+        _factor->getValueAtTime(args.time, factor);
+        return factor == 0.;
+    }
 private:
     DoubleParam *_factor;
 };
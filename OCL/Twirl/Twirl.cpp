@@ -58,24 +58,56 @@ public:
 
     virtual void render(const OFX::RenderArguments &args, cl::Kernel kernel) OVERRIDE FINAL
     {
-        double x, y, r, rX, rY, s;
-        _position->getValueAtTime(args.time, x, y);
-        _radius->getValueAtTime(args.time, rX, rY);
+        OfxPointD centre;
+        double amount, radius;
+        getTwirl(args.time, args.renderScale, centre, amount, radius);
+        kernel.setArg(2, (float)args.renderWindow.x1);
+        kernel.setArg(3, (float)args.renderWindow.y1);
+        kernel.setArg(4, (float)centre.x);
+        kernel.setArg(5, (float)centre.y);
+        kernel.setArg(6, (float)amount);
+        kernel.setArg(7, (float)radius);
+    }
+
+    virtual bool renderCPU(const OFX::RenderArguments &args, const OFX::Image *srcImg, OFX::Image *dstImg) OVERRIDE FINAL
+    {
+        OfxPointD centre;
+        double amount, radius;
+        getTwirl(args.time, args.renderScale, centre, amount, radius);
+        ArenaTwirlMap twirl(centre, amount, radius);
+        return arenaWarp(*this, srcImg, dstImg, args.renderWindow, srcImg->getRegionOfDefinition(), twirl, eArenaWarpFilterBicubic, eArenaWarpEdgeClamp, true);
+    }
+
+    virtual bool getEffectBounds(double time, const OfxPointD &renderScale, OfxRectI &rect) OVERRIDE FINAL
+    {
+        OfxPointD centre;
+        double amount, radius;
+        getTwirl(time, renderScale, centre, amount, radius);
+        ArenaTwirlMap twirl(centre, amount, radius);
+        return arenaWarpBounds(twirl, rect);
+    }
+
+    virtual bool isIdentityEffect(const OFX::IsIdentityArguments &args) OVERRIDE FINAL
+    {
+        double s;
         _strength->getValueAtTime(args.time, s);
-        double ypos = y*args.renderScale.y;
-        double xpos = x*args.renderScale.x;
-        r = (rX*100)*args.renderScale.x;
-        if (s != 0) {
-            s = s/10;
-        }
-        kernel.setArg(2, xpos);
-        kernel.setArg(3, ypos);
-        kernel.setArg(4, s);
-        kernel.setArg(5, r);
+        return s == 0.;
     }
     virtual void changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
     void resetCenter(double time);
 private:
+    void getTwirl(double time, const OfxPointD &renderScale, OfxPointD &centre, double &amount, double &radius)
+    {
+        double x, y, rX, rY, s;
+        _position->getValueAtTime(time, x, y);
+        _radius->getValueAtTime(time, rX, rY);
+        _strength->getValueAtTime(time, s);
+        centre.x = x*renderScale.x;
+        centre.y = y*renderScale.y;
+        amount = s/10;
+        radius = (rX*100)*renderScale.x;
+    }
+
     Double2DParam *_position;
     Double2DParam *_radius;
     DoubleParam *_strength;
@@ -16,69 +16,48 @@
  * along with openfx-arena.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
 */
 
-#ifdef cl_khr_fp64
-#pragma OPENCL EXTENSION cl_khr_fp64 : enable
-#elif defined(cl_amd_fp64)
-#pragma OPENCL EXTENSION cl_amd_fp64 : enable
-#endif
+// Same map and filter as the CPU fallback (ArenaWarp), positions are pixel centres in canvas coordinates,
+// origin is the canvas position of the first image pixel.
 
-const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE;
+const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 
-float clampRGB( float x ) {
-    return x > 1.f ? 1.f
-         : x < 0.f   ? 0.f
-         : x;
+// Catmull-Rom weights
+float4 catmullRom(float t) {
+    return (float4)(((-0.5f * t + 1.f) * t - 0.5f) * t,
+                    (1.5f * t - 2.5f) * t * t + 1.f,
+                    ((-1.5f * t + 2.f) * t + 0.5f) * t,
+                    (0.5f * t - 0.5f) * t * t);
 }
 
-kernel void filter (read_only image2d_t in, write_only image2d_t out, double centerW, double centerH, double amount, double radius) {
-
-    int2 d = get_image_dim(in);
-    int2 pos = (int2)(get_global_id(0),get_global_id(1));
-    int x = pos.x - centerW;
-    int y = pos.y - centerH;
-
-    float a = amount*exp(-(x*x+y*y)/(radius*radius));
-    float u = (cos(a)*x + sin(a)*y);
-    float v = (-sin(a)*x + cos(a)*y);
-
-    u += (float)centerW;
-    v += (float)centerH;
-
-    float4 fp = read_imagef(in,sampler,(int2)((int)u,(int)v));
-
-    // Interpolation
-    int2 p11 = (int2)(floor(u),floor(v));
-    float dx = u-(float)p11.x;
-    float dy = v-(float)p11.y;
-
-    float4 C[5];
-    float4 d0,d2,d3,a0,a1,a2,a3;
-
-    for (int i = 0; i < 4; i++) {
-        d0 = read_imagef(in,sampler,(int2)((int)u-1,(int)v+i)) - read_imagef(in,sampler,(int2)((int)u,(int)v+i));
-        d2 = read_imagef(in,sampler,(int2)((int)u+1,(int)v+i)) - read_imagef(in,sampler,(int2)((int)u,(int)v+i));
-        d3 = read_imagef(in,sampler,(int2)((int)u+2,(int)v+i)) - read_imagef(in,sampler,(int2)((int)u,(int)v+i));
-        a0 = read_imagef(in,sampler,(int2)((int)u,  (int)v+i));
-        a1 =  -1.0f/3.f*d0 + d2 - 1.0f/6.f*d3;
-        a2 = 1.0f/2.f*d0 + 1.0f/2.f*d2;
-        a3 = -1.0f/6.f*d0 - 1.0f/2.f*d2 + 1.0f/6.f*d3;
-
-        C[i] = a0 + a1*dx + a2*dx*dx + a3*dx*dx*dx;
+float4 bicubic(read_only image2d_t in, float u, float v) {
+    float fx = u - 0.5f;
+    float fy = v - 0.5f;
+    float floorX = floor(fx);
+    float floorY = floor(fy);
+    int x0 = (int)floorX - 1;
+    int y0 = (int)floorY - 1;
+    float4 wx = catmullRom(fx - floorX);
+    float4 wy = catmullRom(fy - floorY);
+    float w[4] = { wy.x, wy.y, wy.z, wy.w };
+    float4 acc = (float4)(0.f, 0.f, 0.f, 0.f);
+    for (int j = 0; j < 4; j++) {
+        float4 sum = read_imagef(in, sampler, (int2)(x0, y0 + j)) * wx.x
+                   + read_imagef(in, sampler, (int2)(x0 + 1, y0 + j)) * wx.y
+                   + read_imagef(in, sampler, (int2)(x0 + 2, y0 + j)) * wx.z
+                   + read_imagef(in, sampler, (int2)(x0 + 3, y0 + j)) * wx.w;
+        acc += sum * w[j];
     }
+    return acc;
+}
 
-    d0 = C[0]-C[1];
-    d2 = C[2]-C[1];
-    d3 = C[3]-C[1];
-    a0 = C[1];
-    a1 = -1.0f/3.f*d0 + d2 -1.0f/6.f*d3;
-    a2 = 1.0f/2.f*d0 + 1.0f/2.f*d2;
-    a3 = -1.0f/6.f*d0 - 1.0f/2.f*d2 + 1.0f/6.f*d3;
-    fp = (float4)(a0 + a1*dy + a2*dy*dy + a3*dy*dy*dy);
-    fp.x = clampRGB(fp.x);
-    fp.y = clampRGB(fp.y);
-    fp.z = clampRGB(fp.z);
-    fp.w = clampRGB(fp.w);
+kernel void filter (read_only image2d_t in, write_only image2d_t out, float originX, float originY, float centerX, float centerY, float amount, float radius) {
+    int2 pos = (int2)(get_global_id(0), get_global_id(1));
+    float dx = originX + (float)pos.x + 0.5f - centerX;
+    float dy = originY + (float)pos.y + 0.5f - centerY;
 
-    write_imagef(out,(int2)(pos.x,pos.y),fp);
-}
+    float a = radius > 0.f ? amount * exp(-(dx * dx + dy * dy) / (radius * radius)) : 0.f;
+    float u = cos(a) * dx + sin(a) * dy + centerX - originX;
+    float v = cos(a) * dy - sin(a) * dx + centerY - originY;
 
+    write_imagef(out, pos, clamp(bicubic(in, u, v), 0.f, 1.f));
+}
@@ -56,6 +56,7 @@ OTHER_FILES += \
             Magick/HaldCLUT/net.fxarena.openfx.HaldCLUT.xml \
             Magick/HaldCLUT/Makefile
 INCLUDEPATH += . \
+            Common \
             SupportExt \
             OpenFX/Support/include \
             OpenFX/include \
@@ -157,7 +158,17 @@ HEADERS += \
             /usr/local/magick7/include/ImageMagick-7/Magick++.h \
             OCL/ofxsTransformInteractCustom.h \
             OCL/OCLPlugin.h \
-            Magick/MagickPlugin.h
+            Magick/MagickPlugin.h \
+            Magick/MagickPixels.h \
+            Magick/MagickThreads.h \
+            Magick/MagickCache.h \
+            Magick/MagickAbort.h \
+            Common/ArenaTimer.h \
+            Common/ArenaWarp.h \
+            Common/ArenaLut.h \
+            Common/ArenaLutArchive.h \
+            Common/ArenaEdge.h \
+            Magick/HaldCLUT/HaldPresets.h
 SOURCES += \
             Extra/OpenRaster.cpp \
             Extra/ReadSVG.cpp \
@@ -201,7 +212,17 @@ SOURCES += \
             OCL/Bokeh/Bokeh.cpp \
             OCL/CLFilter/CLFilter.cpp \
             Magick/MagickPlugin.cpp \
+            Magick/MagickPixels.cpp \
+            Magick/MagickThreads.cpp \
+            Magick/MagickCache.cpp \
+            Common/ArenaTimer.cpp \
+            Common/ArenaWarp.cpp \
+            Common/ArenaLut.cpp \
+            Common/ArenaLutArchive.cpp \
+            Common/ArenaEdge.cpp \
             Magick/Swirl/Swirl.cpp \
             Magick/Wave/Wave.cpp \
             Magick/Roll/Roll.cpp \
-            Magick/HaldCLUT/HaldCLUT.cpp
+            Magick/HaldCLUT/HaldCLUT.cpp \
+            Magick/HaldCLUT/HaldPresets.cpp \
+            Magick/HaldCLUT/HaldPack.cpp